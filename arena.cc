@@ -0,0 +1,40 @@
+#include <stdlib.h>
+#include "arena.h"
+
+Arena::Arena(size_t _block_size): blocks(NULL), cur(NULL), end(NULL), cleanups(NULL), block_size(_block_size) {
+/* empty */
+}
+
+Arena::~Arena() {
+    for (Cleanup *c = cleanups; c != NULL; c = c->next)
+        c->destroy(c->obj);
+
+    Block *b = blocks;
+    while (b != NULL) {
+        Block *next = b->next;
+        free(b);
+        b = next;
+    }
+}
+
+void Arena::grow(size_t size, size_t align) {
+    size_t need = sizeof(Block) + size + align;
+    size_t alloc = need > block_size ? need : block_size;
+
+    Block *b = (Block *)malloc(alloc);
+    if (b == NULL)
+        throw std::bad_alloc();
+    b->next = blocks;
+    b->size = alloc;
+    blocks = b;
+
+    cur = (char *)(b + 1);
+    end = (char *)b + alloc;
+}
+
+size_t Arena::allocated() const {
+    size_t total = 0;
+    for (Block *b = blocks; b != NULL; b = b->next)
+        total += b->size;
+    return total - (end - cur);
+}
@@ -0,0 +1,83 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Bump allocator that owns everything built while parsing a translation
+ * unit. Memory is handed out from large blocks and released all at once
+ * when the arena is destroyed; objects that are not trivially
+ * destructible get their destructor queued on a cleanup list.
+ */
+class Arena {
+    private:
+        struct Block {
+            Block *next;
+            size_t size;
+        };
+
+        struct Cleanup {
+            Cleanup *next;
+            void (*destroy)(void *);
+            void *obj;
+        };
+
+        Block *blocks;
+        char *cur, *end;
+        Cleanup *cleanups;
+        size_t block_size;
+
+        void grow(size_t size, size_t align);
+
+        template<class T>
+        static void destroy(void *obj) {
+            static_cast<T *>(obj)->~T();
+        }
+
+    public:
+        Arena(size_t _block_size = 64*1024);
+        ~Arena();
+
+        // bytes taken from the system, less what is left of the last block
+        size_t allocated() const;
+
+        void *allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+            size_t pad = -(size_t)cur & (align - 1);
+            if (cur == NULL || (size_t)(end - cur) < size + pad) {
+                grow(size, align);
+                pad = -(size_t)cur & (align - 1);
+            }
+            void *ret = cur + pad;
+            cur += size + pad;
+            return ret;
+        }
+
+        const char *copy(const char *str, size_t len) {
+            char *ret = (char *)allocate(len, 1);
+            memcpy(ret, str, len);
+            return ret;
+        }
+
+        template<class T, class... Args>
+        T *make(Args&&... args) {
+            T *obj = ::new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            if (!std::is_trivially_destructible<T>::value) {
+                Cleanup *c = ::new (allocate(sizeof(Cleanup), alignof(Cleanup))) Cleanup;
+                c->next = cleanups;
+                c->destroy = &Arena::destroy<T>;
+                c->obj = obj;
+                cleanups = c;
+            }
+            return obj;
+        }
+
+    private:
+        Arena(const Arena &);
+        Arena &operator=(const Arena &);
+};
+
+#endif//__ARENA_H__
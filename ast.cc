@@ -2,59 +2,6 @@
 
 namespace ast {
 
-Node::Node(): parentNode(NULL), nextSibling(NULL), firstChild(NULL), lastChild(NULL), num_children(0) {
-/* empty */
-}
-
-Node::~Node() {
-    Node *n = firstChild;
-    while (n != NULL) {
-        Node *next = n->nextSibling;
-        delete n;
-        n = next;
-    }
-    childNodes.clear();
-    for (size_t i = 0; i < slist.size(); i++)
-        delete slist[i];
-    slist.clear();
-}
-
-void Node::appendChild(Node *n) {
-    if (firstChild != NULL) {
-        lastChild->nextSibling = n;
-    } else {
-        firstChild = n;
-    }
-    lastChild = n;
-    n->parentNode = this;
-    n->nextSibling = NULL;
-    num_children++;
-    childNodes.push_back(n);
-}
-
-void Node::addString(std::string *s) {
-    slist.push_back(s);
-}
-
-// void Node::prependChild(Node *n) {
-//     childNodes.insert(childNodes.begin(), n);
-//     n->nextSibling = firstChild;
-//     n->parentNode = this;
-//     firstChild = n;
-// }
-
-void Node::extend(Node *n) {
-    Node *c = n->firstChild;
-    while (c != NULL) {
-        Node *next = c->nextSibling;
-        appendChild(c);
-        c = next;
-    }
-    n->firstChild = NULL;
-    n->num_children = 0;
-    delete n;
-}
-
 void True::accept(Visitor *v) { v->visit(this); }
 void False::accept(Visitor *v) { v->visit(this); }
 void Integer::accept(Visitor *v) { v->visit(this); }
@@ -92,5 +39,17 @@ void RecordDef::accept(Visitor *v) { v->visit(this); }
 void UnionDef::accept(Visitor *v) { v->visit(this); }
 void ExprList::accept(Visitor *v) { v->visit(this); }
 void StmtList::accept(Visitor *v) { v->visit(this); }
+void IfaceDef::accept(Visitor *v) { v->visit(this); }
+void Cast::accept(Visitor *v) { v->visit(this); }
+void Member::accept(Visitor *v) { v->visit(this); }
+void New::accept(Visitor *v) { v->visit(this); }
+void Slice::accept(Visitor *v) { v->visit(this); }
+void SliceType::accept(Visitor *v) { v->visit(this); }
+void GenericType::accept(Visitor *v) { v->visit(this); }
+void Match::accept(Visitor *v) { v->visit(this); }
+void MatchArm::accept(Visitor *v) { v->visit(this); }
+void NamedArg::accept(Visitor *v) { v->visit(this); }
+void Tuple::accept(Visitor *v) { v->visit(this); }
+void Unpack::accept(Visitor *v) { v->visit(this); }
 
 }
@@ -1,9 +1,15 @@
 #ifndef __AST_H__
 #define __AST_H__
 
-#include <map>
-#include <vector>
+#include <stdint.h>
+#include <string.h>
 #include <string>
+#include "arena.h"
+#include "symbol.h"
+
+namespace sema {
+    class Type;
+}
 
 namespace ast {
     typedef int64_t integer_t;
@@ -11,25 +17,101 @@ namespace ast {
     typedef double real_t;
 
     class Node;
+    class Type;
+    class ExprList;
+    class FuncDecl;
+    class TypeList;
     class Visitor;
-    typedef std::vector<Node *> NodeList;
+
+    /*
+     * Child array for nodes with a variable number of children. The first
+     * N entries are stored inline, longer lists spill into the arena. Like
+     * every node it is trivially destructible, so a whole tree is released
+     * together with its arena.
+     */
+    template<class T, unsigned N>
+    class SmallList {
+        private:
+            T *data;
+            uint32_t count;
+            uint32_t capacity;
+            T inline_data[N];
+
+            SmallList(const SmallList &);
+            SmallList &operator=(const SmallList &);
+
+        public:
+            SmallList(): data(inline_data), count(0), capacity(N) { }
+
+            void push_back(Arena &arena, T val) {
+                if (count == capacity) {
+                    T *grown = (T *)arena.allocate(2*capacity*sizeof(T), alignof(T));
+                    memcpy(grown, data, count*sizeof(T));
+                    data = grown;
+                    capacity *= 2;
+                }
+                data[count++] = val;
+            }
+
+            size_t size() const { return count; }
+            bool empty() const { return count == 0; }
+            T &operator[](size_t i) const { return data[i]; }
+            T &back() const { return data[count-1]; }
+            T *begin() const { return data; }
+            T *end() const { return data + count; }
+    };
+
+    typedef SmallList<Node *, 4> NodeList;
+
+    /*
+     * Stable number for every kind of node, used by tools that write
+     * trees out (fingerprints, the binary AST format). Only append to it.
+     */
+    enum NodeTag {
+        TAG_NIL, TAG_TRUE, TAG_FALSE, TAG_INTEGER, TAG_REAL, TAG_STRING,
+        TAG_VARIABLE, TAG_DECLARATION, TAG_ASSIGN, TAG_CALL, TAG_RETURN,
+        TAG_UNARY, TAG_BINARY, TAG_AND, TAG_OR, TAG_IFELSE, TAG_WHILE,
+        TAG_BREAK, TAG_CONTINUE, TAG_FOR, TAG_ARRAY, TAG_SUBSCRIPT, TAG_EXPR,
+        TAG_FUNCTION, TAG_FUNCDECL, TAG_UNIONITEM, TAG_UNIONLIST,
+        TAG_RECORDDEF, TAG_UNIONDEF, TAG_EXPRLIST, TAG_STMTLIST,
+        TAG_SIMPLETYPE, TAG_REFTYPE, TAG_PTRTYPE, TAG_ARRAYTYPE,
+        TAG_TUPLETYPE, TAG_FUNCTYPE, TAG_TYPELIST, TAG_IFACEDEF, TAG_CAST,
+        TAG_MEMBER, TAG_NEW, TAG_SLICE, TAG_SLICETYPE, TAG_GENERICTYPE,
+        TAG_MATCH, TAG_MATCHARM, TAG_NAMEDARG, TAG_TUPLE, TAG_UNPACK
+    };
+
+    /*
+     * Text of a string literal, copied into the arena by the lexer
+     * without its quotes and with the escapes decoded.
+     */
+    struct Span {
+        const char *ptr;
+        uint32_t len;
+
+        std::string str() const { return std::string(ptr, len); }
+    };
 
     class Node {
         public:
-            Node *parentNode;
-            Node *nextSibling;
-            Node *firstChild;
-            Node *lastChild;
-            size_t num_children;
-            NodeList childNodes;
-            std::vector<std::string *> slist;
+            // resolved type, set by the type checker
+            const sema::Type *ty;
 
-            Node();
-            virtual ~Node();
+            Node(): ty(nullptr) { }
             virtual void accept(Visitor *v) = 0;
-            void appendChild(Node *);
-            void addString(std::string *);
-            void extend(Node *);
+
+            // nodes are owned by the arena of the MambaContext that parsed
+            // them, use Arena::make to create them. The destructor is left
+            // trivial on purpose so the arena never has to run it.
+            static void *operator new(size_t) = delete;
+    };
+
+    class ListNode: public Node {
+        public:
+            NodeList items;
+            ListNode(): Node() { }
+            void appendChild(Arena &arena, Node *n) {
+                items.push_back(arena, n);
+            }
     };
 
     /*
@@ -43,15 +125,16 @@ namespace ast {
 
     class TypeList: public Type {
         public:
-            std::vector<std::string*> names;
-            std::vector<Type*> types;
+            SmallList<symbol_t, 4> names;
+            SmallList<Type*, 4> types;
             TypeList(): Type() { }
             virtual void accept(Visitor *v);
-            void appendNamedChild(std::string *name, Type *type) {
-                names.push_back(name);
-                types.push_back(type);
-                addString(name);
-                appendChild(type);
+            void appendChild(Arena &arena, Type *type) {
+                types.push_back(arena, type);
+            }
+            void appendNamedChild(Arena &arena, symbol_t name, Type *type) {
+                names.push_back(arena, name);
+                types.push_back(arena, type);
             }
             virtual std::string type_name() const {
                 std::string ret = "";
@@ -68,22 +151,30 @@ namespace ast {
 
     class SimpleType: public Type {
         public:
-            std::string *tname;
-            SimpleType(std::string *_tname): Type(), tname(_tname) {
-                addString(tname);
+            symbol_t tname;
+            SimpleType(symbol_t _tname): Type(), tname(_tname) { }
+            virtual void accept(Visitor *v);
+            virtual std::string type_name() const {
+                return Symbols::name(tname);
             }
+    };
+
+    // Name{args}, an instance of a generic union
+    class GenericType: public Type {
+        public:
+            symbol_t tname;
+            TypeList *args;
+            GenericType(symbol_t _tname, TypeList *_args): Type(), tname(_tname), args(_args) { }
             virtual void accept(Visitor *v);
             virtual std::string type_name() const {
-                return *tname;
+                return Symbols::name(tname) + "{" + args->type_name() + "}";
             }
     };
 
     class RefType: public Type {
         public:
             Type *base_type;
-            RefType(Type *_base_type): Type(), base_type(_base_type) {
-                appendChild(base_type);
-            }
+            RefType(Type *_base_type): Type(), base_type(_base_type) { }
             virtual void accept(Visitor *v);
             virtual std::string type_name() const {
                 return "&" + base_type->type_name();
@@ -93,9 +184,7 @@ namespace ast {
     class PtrType: public Type {
         public:
             Type *base_type;
-            PtrType(Type *_base_type): Type(), base_type(_base_type) {
-                appendChild(base_type);
-            }
+            PtrType(Type *_base_type): Type(), base_type(_base_type) { }
             virtual void accept(Visitor *v);
             virtual std::string type_name() const {
                 return "*" + base_type->type_name();
@@ -105,21 +194,27 @@ namespace ast {
     class ArrayType: public Type {
         public:
             Type *base_type;
-            ArrayType(Type *_base_type): Type(), base_type(_base_type) {
-                appendChild(base_type);
-            }
+            ArrayType(Type *_base_type): Type(), base_type(_base_type) { }
             virtual void accept(Visitor *v);
             virtual std::string type_name() const {
                 return "[" + base_type->type_name() + "]";
             }
     };
 
-    class TupleType: public Type {
+    class SliceType: public Type {
         public:
             Type *base_type;
-            TupleType(Type *_base_type): Type(), base_type(_base_type) {
-                appendChild(base_type);
+            SliceType(Type *_base_type): Type(), base_type(_base_type) { }
+            virtual void accept(Visitor *v);
+            virtual std::string type_name() const {
+                return "[" + base_type->type_name() + ":]";
             }
+    };
+
+    class TupleType: public Type {
+        public:
+            Type *base_type;
+            TupleType(Type *_base_type): Type(), base_type(_base_type) { }
             virtual void accept(Visitor *v);
             virtual std::string type_name() const {
                 return "(" + base_type->type_name() + ")";
@@ -130,10 +225,7 @@ namespace ast {
         public:
             TypeList *params;
             Type *ret;
-            FuncType(TypeList *_params, Type *_ret): Type(), params(_params), ret(_ret) {
-                appendChild(params);
-                if (ret) appendChild(ret);
-            }
+            FuncType(TypeList *_params, Type *_ret): Type(), params(_params), ret(_ret) { }
             virtual void accept(Visitor *v);
             virtual std::string type_name() const {
                 return "(" + params->type_name() + ")->" + (ret ? ret->type_name() : "");
@@ -173,10 +265,8 @@ namespace ast {
 
     class String: public Node {
         public:
-            std::string *val;
-            String(std::string *_val): Node(), val(_val) {
-                addString(val);
-            }
+            Span val;
+            String(Span _val): Node(), val(_val) { }
             virtual void accept(Visitor *v);
     };
 
@@ -186,10 +276,8 @@ namespace ast {
 
     class Variable: public Node {
         public:
-            std::string *val;
-            Variable(std::string *_val): Node(), val(_val) {
-                addString(val);
-            }
+            symbol_t val;
+            Variable(symbol_t _val): Node(), val(_val) { }
             virtual void accept(Visitor *v);
     };
 
@@ -197,10 +285,7 @@ namespace ast {
         public:
             int op;
             Node *left, *right;
-            Binary(int _op, Node *_left, Node *_right): Node(), op(_op), left(_left), right(_right) {
-                appendChild(left);
-                appendChild(right);
-            }
+            Binary(int _op, Node *_left, Node *_right): Node(), op(_op), left(_left), right(_right) { }
             virtual void accept(Visitor *v);
     };
 
@@ -208,29 +293,21 @@ namespace ast {
         public:
             int op;
             Node *down;
-            Unary(int _op, Node *_down): Node(), op(_op), down(_down) {
-                appendChild(down);
-            }
+            Unary(int _op, Node *_down): Node(), op(_op), down(_down) { }
             virtual void accept(Visitor *v);
     };
 
     class And: public Node {
         public:
             Node *left, *right;
-            And(Node *_left, Node *_right): Node(), left(_left), right(_right) {
-                appendChild(left);
-                appendChild(right);
-            }
+            And(Node *_left, Node *_right): Node(), left(_left), right(_right) { }
             virtual void accept(Visitor *v);
     };
 
     class Or: public Node {
         public:
             Node *left, *right;
-            Or(Node *_left, Node *_right): Node(), left(_left), right(_right) {
-                appendChild(left);
-                appendChild(right);
-            }
+            Or(Node *_left, Node *_right): Node(), left(_left), right(_right) { }
             virtual void accept(Visitor *v);
     };
 
@@ -238,70 +315,115 @@ namespace ast {
         public:
             FuncType *proto;
             Node *body;
-            Function(FuncType *_proto, Node *_body): Node(), proto(_proto), body(_body) {
-                appendChild(proto);
-                appendChild(body);
-            }
+            Function(FuncType *_proto, Node *_body): Node(), proto(_proto), body(_body) { }
             virtual void accept(Visitor *v);
     };
 
     class Return: public Node {
         public:
             Node *e;
-            Return(Node *_e): Node(), e(_e) {
-                if (e)
-                    appendChild(e);
-            }
+            Return(Node *_e): Node(), e(_e) { }
             virtual void accept(Visitor *v);
     };
 
     class Call: public Node {
         public:
-            Node *parent, *params;
-            Call(Node *_parent, Node *_params): Node(), parent(_parent), params(_params) {
-                appendChild(parent);
-                appendChild(params);
-            }
+            Node *parent;
+            ExprList *params;
+            // instance of a generic function, set by the type checker
+            FuncDecl *instance;
+            Call(Node *_parent, ExprList *_params): Node(), parent(_parent), params(_params), instance(nullptr) { }
+            virtual void accept(Visitor *v);
+    };
+
+    class Member: public Node {
+        public:
+            Node *obj;
+            symbol_t name;
+            // vtable slot of an interface method, set by the type checker
+            int slot;
+            // index of a record field in its declaration, set by the type
+            // checker
+            int field;
+            // type behind the interface value when it is known statically,
+            // set by the Devirtualizer
+            const sema::Type *concrete;
+            Member(Node *_obj, symbol_t _name): Node(), obj(_obj), name(_name), slot(-1), field(-1), concrete(nullptr) { }
+            virtual void accept(Visitor *v);
+    };
+
+    // name=expr, an argument of a record constructor
+    class NamedArg: public Node {
+        public:
+            symbol_t name;
+            Node *expr;
+            NamedArg(symbol_t _name, Node *_expr): Node(), name(_name), expr(_expr) { }
+            virtual void accept(Visitor *v);
+    };
+
+    class Cast: public Node {
+        public:
+            Node *expr;
+            Type *type;
+            Cast(Node *_expr, Type *_type): Node(), expr(_expr), type(_type) { }
+            virtual void accept(Visitor *v);
+    };
+
+    // *expr, a reference counted copy of expr on the heap
+    class New: public Node {
+        public:
+            Node *expr;
+            New(Node *_expr): Node(), expr(_expr) { }
             virtual void accept(Visitor *v);
     };
 
     class Array: public Node {
         public:
-            Node *elems;
-            Array(Node *_elems): Node(), elems(_elems) {
-                appendChild(elems);
-            }
+            ExprList *elems;
+            Array(ExprList *_elems): Node(), elems(_elems) { }
+            virtual void accept(Visitor *v);
+    };
+
+    // (a, b, ...), a tuple of two or more values
+    class Tuple: public Node {
+        public:
+            ExprList *elems;
+            Tuple(ExprList *_elems): Node(), elems(_elems) { }
             virtual void accept(Visitor *v);
     };
 
     class Subscript: public Node {
         public:
             Node *var, *idx;
-            Subscript(Node *_var, Node *_idx): Node(), var(_var), idx(_idx) {
-                appendChild(var);
-                appendChild(idx);
-            }
+            Subscript(Node *_var, Node *_idx): Node(), var(_var), idx(_idx) { }
+            virtual void accept(Visitor *v);
+    };
+
+    // var[lo:hi:step], a view of the elements of var. The bounds that
+    // are left out are nullptr.
+    class Slice: public Node {
+        public:
+            Node *var, *lo, *hi, *step;
+            Slice(Node *_var, Node *_lo, Node *_hi, Node *_step): Node(), var(_var), lo(_lo), hi(_hi), step(_step) { }
             virtual void accept(Visitor *v);
     };
 
     class Expr: public Node {
         public:
             Node *e;
-            Expr(Node *_e): Node(), e(_e) {
-                appendChild(e);
-            }
+            Expr(Node *_e): Node(), e(_e) { }
             virtual void accept(Visitor *v);
     };
 
-    class ExprList: public Node {
+    class ExprList: public ListNode {
         public:
-            ExprList(): Node() { }
+            ExprList(): ListNode() { }
             virtual void accept(Visitor *v);
     };
 
-    class StmtList: public Node {
+    class StmtList: public ListNode {
         public:
-            StmtList(): Node() { }
+            StmtList(): ListNode() { }
             virtual void accept(Visitor *v);
     };
 
@@ -309,10 +431,8 @@ namespace ast {
         public:
             Node *expr;
             NodeList vars;
-            Assign(Node *var, Node *_expr): Node(), expr(_expr) {
-                vars.push_back(var);
-                appendChild(expr);
-                appendChild(var);
+            Assign(Arena &arena, Node *var, Node *_expr): Node(), expr(_expr) {
+                vars.push_back(arena, var);
             }
 
             virtual void accept(Visitor *v);
@@ -321,41 +441,57 @@ namespace ast {
     class IfElse: public Node {
         public:
             Node *expr, *body, *ifelse;
-            IfElse(Node *_expr, Node *_body, Node *_ifelse): Node(), expr(_expr), body(_body), ifelse(_ifelse) {
-                appendChild(expr);
-                appendChild(body);
-                if (ifelse != NULL)
-                    appendChild(ifelse);
-            }
+            IfElse(Node *_expr, Node *_body, Node *_ifelse): Node(), expr(_expr), body(_body), ifelse(_ifelse) { }
             virtual void accept(Visitor *v);
     };
 
     class Loop: public Node {
         public:
-            address_t start_loop;
-            std::vector<address_t> end_loop;
             Loop(): Node() { }
     };
 
     class For: public Loop {
         public:
-            std::string *vname;
-            Node *var, *iterable, *body;
-            For(std::string *_vname, Node *_iterable, Node *_body): Loop(), vname(_vname), iterable(_iterable), body(_body) {
-                addString(vname);
-                appendChild(iterable);
-                appendChild(body);
-            }
+            // the elements of an array or slice, the integers of
+            // range(a, b, step), the payloads an iterator *I returns from
+            // I.next, or those of the iterator T.iter returns
+            enum Walk { SEQUENCE, RANGE, ITERATOR, ITERABLE };
+
+            symbol_t vname;
+            Node *iterable, *body;
+            // how the loop walks iterable, the type of vname and the
+            // functions T.iter and I.next it calls, set by the type
+            // checker
+            Walk walk;
+            const sema::Type *elem, *iter, *next;
+            For(symbol_t _vname, Node *_iterable, Node *_body): Loop(), vname(_vname), iterable(_iterable), body(_body),
+                walk(SEQUENCE), elem(nullptr), iter(nullptr), next(nullptr) { }
+            virtual void accept(Visitor *v);
+    };
+
+    // name(var): body, an arm of a match. var is EMPTY when the payload
+    // is not bound, name is EMPTY for the else arm.
+    class MatchArm: public Node {
+        public:
+            symbol_t name, var;
+            Node *body;
+            MatchArm(symbol_t _name, symbol_t _var, Node *_body): Node(), name(_name), var(_var), body(_body) { }
+            virtual void accept(Visitor *v);
+    };
+
+    class Match: public Node {
+        public:
+            Node *expr;
+            // MatchArms
+            StmtList *arms;
+            Match(Node *_expr, StmtList *_arms): Node(), expr(_expr), arms(_arms) { }
             virtual void accept(Visitor *v);
     };
 
     class While: public Loop {
         public:
             Node *expr, *body;
-            While(Node *_expr, Node *_body): Loop(), expr(_expr), body(_body) {
-                appendChild(expr);
-                appendChild(body);
-            }
+            While(Node *_expr, Node *_body): Loop(), expr(_expr), body(_body) { }
             virtual void accept(Visitor *v);
     };
 
@@ -371,68 +507,82 @@ namespace ast {
             virtual void accept(Visitor *v);
     };
 
+    // var (a, b) = expr of a tuple, or var Name(a, b) = expr of the
+    // record Name, by field in declaration order. tname is EMPTY for a
+    // tuple, only the names of vars are set.
+    class Unpack: public Node {
+        public:
+            symbol_t tname;
+            TypeList *vars;
+            Node *expr;
+            Unpack(symbol_t _tname, TypeList *_vars, Node *_expr): Node(), tname(_tname), vars(_vars), expr(_expr) { }
+            virtual void accept(Visitor *v);
+    };
+
     class Declaration: public Node {
         public:
-            std::string *name;
+            symbol_t name;
             Node *expr;
             Node *type_spec;
-            Declaration(std::string *_name, Node *_expr, Node *_type_spec): Node(), name(_name), expr(_expr), type_spec(_type_spec) {
-                addString(name);
-                appendChild(expr);
-                if (type_spec)
-                    appendChild(type_spec);
-            }
+            Declaration(symbol_t _name, Node *_expr, Node *_type_spec): Node(), name(_name), expr(_expr), type_spec(_type_spec) { }
             virtual void accept(Visitor *v);
     };
 
     class FuncDecl: public Node {
         public:
-            std::string *name;
+            symbol_t name;
             Node *func;
-            FuncDecl(std::string *_name, Node *_func): Node(), name(_name), func(_func) {
-                addString(name);
-                appendChild(func);
-            }
+            // type parameters and their constraints (null when there is
+            // none) of a generic function
+            TypeList *generics;
+            // instances of a generic function, set by the type checker
+            SmallList<FuncDecl *, 1> instances;
+            FuncDecl(symbol_t _name, Node *_func, TypeList *_generics = nullptr): Node(), name(_name), func(_func), generics(_generics) { }
             virtual void accept(Visitor *v);
     };
 
+    // record Name as layout: fields. layout is EMPTY, fixed, which keeps
+    // the fields in order, or soa, which stores arrays of the record as
+    // one array per field.
     class RecordDef: public Node {
         public:
-            std::string *name;
+            symbol_t name;
             Node *decl_list;
-            RecordDef(std::string *_name, Node *_decl_list): Node(), name(_name), decl_list(_decl_list) {
-                addString(name);
-                appendChild(decl_list);
-            }
+            symbol_t layout;
+            RecordDef(symbol_t _name, Node *_decl_list, symbol_t _layout = Symbols::EMPTY): Node(), name(_name), decl_list(_decl_list), layout(_layout) { }
             virtual void accept(Visitor *v);
     };
 
     class UnionItem: public Node {
         public:
-            std::string *name;
+            symbol_t name;
             Node *type_spec;
-            UnionItem(std::string *_name, Node *_type_spec): Node(), name(_name), type_spec(_type_spec) {
-                addString(name);
-                if (type_spec)
-                    appendChild(type_spec);
-            }
+            UnionItem(symbol_t _name, Node *_type_spec): Node(), name(_name), type_spec(_type_spec) { }
             virtual void accept(Visitor *v);
     };
 
-    class UnionList: public Node {
+    class UnionList: public ListNode {
         public:
-            UnionList(): Node() { }
+            UnionList(): ListNode() { }
             virtual void accept(Visitor *v);
     };
 
     class UnionDef: public Node {
         public:
-            std::string *name;
+            symbol_t name;
             Node *type_list;
-            UnionDef(std::string *_name, Node *_type_list): Node(), name(_name), type_list(_type_list) {
-                addString(name);
-                appendChild(type_list);
-            }
+            // type parameters of a generic union, null when there is none
+            TypeList *generics;
+            UnionDef(symbol_t _name, Node *_type_list, TypeList *_generics = nullptr): Node(), name(_name), type_list(_type_list), generics(_generics) { }
+            virtual void accept(Visitor *v);
+    };
+
+    class IfaceDef: public Node {
+        public:
+            symbol_t name;
+            // method names and their FuncTypes
+            TypeList *methods;
+            IfaceDef(symbol_t _name, TypeList *_methods): Node(), name(_name), methods(_methods) { }
             virtual void accept(Visitor *v);
     };
 
@@ -475,6 +625,18 @@ namespace ast {
             virtual void visit(TupleType *) = 0;
             virtual void visit(FuncType *) = 0;
             virtual void visit(TypeList *) = 0;
+            virtual void visit(IfaceDef *) = 0;
+            virtual void visit(Cast *) = 0;
+            virtual void visit(Member *) = 0;
+            virtual void visit(New *) = 0;
+            virtual void visit(Slice *) = 0;
+            virtual void visit(SliceType *) = 0;
+            virtual void visit(GenericType *) = 0;
+            virtual void visit(Match *) = 0;
+            virtual void visit(MatchArm *) = 0;
+            virtual void visit(NamedArg *) = 0;
+            virtual void visit(Tuple *) = 0;
+            virtual void visit(Unpack *) = 0;
     };
 }
 
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../runtime/runtime.h"
+
+/*
+ * Allocation throughput of the runtime allocator against malloc. Every
+ * thread allocates small records of 16 to 64 bytes, keeping the last
+ * few thousand alive and freeing the oldest, as a program building and
+ * dropping records does. Arena scopes allocate a batch and pop it.
+ *
+ *     bench/alloc_bench [allocations per thread] [threads]
+ */
+
+namespace {
+
+const size_t LIVE = 4096;
+const size_t BATCH = 1024;
+
+double seconds(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+}
+
+// records of 16, 32, 48 and 64 bytes
+size_t recordSize(long i) {
+    return 16 + (i*7 % 4)*16;
+}
+
+template<class Alloc, class Free>
+void churn(long n, Alloc alloc, Free release) {
+    std::vector<void *> live(LIVE, nullptr);
+    for (long i = 0; i < n; i++) {
+        void *&slot = live[i % LIVE];
+        if (slot)
+            release(slot);
+        slot = alloc(recordSize(i));
+        *(long *)slot = i;
+    }
+    for (auto p: live)
+        if (p)
+            release(p);
+}
+
+void runMalloc(long n) {
+    churn(n, [](size_t size) { return malloc(size); }, [](void *p) { free(p); });
+}
+
+void runMamba(long n) {
+    churn(n, [](size_t size) { return mamba_alloc(size); }, [](void *p) { mamba_free(p); });
+}
+
+void runArena(long n) {
+    for (long i = 0; i < n; i += BATCH) {
+        mamba_arena_push();
+        for (long k = i; k < i + (long)BATCH && k < n; k++)
+            *(long *)mamba_alloc(recordSize(k)) = k;
+        mamba_arena_pop();
+    }
+}
+
+// Run f(n) on every thread at once, the time is that of the slowest.
+double measure(void (*f)(long), long n, unsigned threads) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; t++)
+        pool.emplace_back(f, n);
+    for (auto &t: pool)
+        t.join();
+    return seconds(std::chrono::steady_clock::now() - start);
+}
+
+void report(const char *name, void (*f)(long), long n, unsigned threads) {
+    // best of a few runs, the first one also pays for growing the heap
+    double best = 0;
+    for (int r = 0; r < 3; r++) {
+        double t = measure(f, n, threads);
+        if (r == 0 || t < best)
+            best = t;
+    }
+    double ops = (double)n*threads;
+    printf("%-8s %2u threads: %6.1f ns per allocation, %7.1f M allocations/s\n",
+           name, threads, best*1e9*threads/ops, ops/best/1e6);
+}
+
+}
+
+int main(int argc, char **argv) {
+    long n = argc > 1 ? atol(argv[1]) : 10000000;
+    unsigned threads = argc > 2 ? atoi(argv[2]) : std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+
+    report("malloc", runMalloc, n, 1);
+    report("mamba", runMamba, n, 1);
+    report("arena", runArena, n, 1);
+    if (threads > 1) {
+        report("malloc", runMalloc, n, threads);
+        report("mamba", runMamba, n, threads);
+        report("arena", runArena, n, threads);
+    }
+    return 0;
+}
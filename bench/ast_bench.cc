@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "../ast.h"
+
+/*
+ * Bytes per node and traversal speed of the AST. Builds a synthetic
+ * program of many functions with loops, branches, calls and arithmetic,
+ * then walks it with a visitor that touches every node.
+ *
+ *     bench/ast_bench [functions]
+ */
+
+using namespace ast;
+
+namespace {
+
+// Visits every child and counts the nodes.
+class Walker: public Visitor {
+    public:
+        size_t nodes;
+        Walker(): nodes(0) { }
+
+        void node(Node *n) {
+            if (n)
+                n->accept(this);
+        }
+
+        template<class T, unsigned N>
+        void list(const SmallList<T, N> &l) {
+            for (auto &n: l)
+                node(n);
+        }
+
+        virtual void visit(True *) { nodes++; }
+        virtual void visit(False *) { nodes++; }
+        virtual void visit(Integer *) { nodes++; }
+        virtual void visit(Real *) { nodes++; }
+        virtual void visit(String *) { nodes++; }
+        virtual void visit(Variable *) { nodes++; }
+        virtual void visit(Declaration *v) { nodes++; node(v->expr); node(v->type_spec); }
+        virtual void visit(Assign *v) { nodes++; node(v->expr); list(v->vars); }
+        virtual void visit(Call *v) { nodes++; node(v->parent); node(v->params); }
+        virtual void visit(Return *v) { nodes++; node(v->e); }
+        virtual void visit(Unary *v) { nodes++; node(v->down); }
+        virtual void visit(Binary *v) { nodes++; node(v->left); node(v->right); }
+        virtual void visit(And *v) { nodes++; node(v->left); node(v->right); }
+        virtual void visit(Or *v) { nodes++; node(v->left); node(v->right); }
+        virtual void visit(IfElse *v) { nodes++; node(v->expr); node(v->body); node(v->ifelse); }
+        virtual void visit(While *v) { nodes++; node(v->expr); node(v->body); }
+        virtual void visit(Break *) { nodes++; }
+        virtual void visit(Continue *) { nodes++; }
+        virtual void visit(For *v) { nodes++; node(v->iterable); node(v->body); }
+        virtual void visit(Array *v) { nodes++; node(v->elems); }
+        virtual void visit(Subscript *v) { nodes++; node(v->var); node(v->idx); }
+        virtual void visit(Expr *v) { nodes++; node(v->e); }
+        virtual void visit(Function *v) { nodes++; node(v->proto); node(v->body); }
+        virtual void visit(FuncDecl *v) { nodes++; node(v->func); node(v->generics); }
+        virtual void visit(UnionItem *v) { nodes++; node(v->type_spec); }
+        virtual void visit(UnionList *v) { nodes++; list(v->items); }
+        virtual void visit(RecordDef *v) { nodes++; node(v->decl_list); }
+        virtual void visit(UnionDef *v) { nodes++; node(v->type_list); node(v->generics); }
+        virtual void visit(ExprList *v) { nodes++; list(v->items); }
+        virtual void visit(StmtList *v) { nodes++; list(v->items); }
+        virtual void visit(SimpleType *) { nodes++; }
+        virtual void visit(RefType *v) { nodes++; node(v->base_type); }
+        virtual void visit(PtrType *v) { nodes++; node(v->base_type); }
+        virtual void visit(ArrayType *v) { nodes++; node(v->base_type); }
+        virtual void visit(TupleType *v) { nodes++; node(v->base_type); }
+        virtual void visit(FuncType *v) { nodes++; node(v->params); node(v->ret); }
+        virtual void visit(TypeList *v) { nodes++; list(v->types); }
+        virtual void visit(IfaceDef *v) { nodes++; node(v->methods); }
+        virtual void visit(Cast *v) { nodes++; node(v->expr); node(v->type); }
+        virtual void visit(Member *v) { nodes++; node(v->obj); }
+        virtual void visit(New *v) { nodes++; node(v->expr); }
+        virtual void visit(Slice *v) { nodes++; node(v->var); node(v->lo); node(v->hi); node(v->step); }
+        virtual void visit(SliceType *v) { nodes++; node(v->base_type); }
+        virtual void visit(GenericType *v) { nodes++; node(v->args); }
+        virtual void visit(Match *v) { nodes++; node(v->expr); node(v->arms); }
+        virtual void visit(MatchArm *v) { nodes++; node(v->body); }
+        virtual void visit(NamedArg *v) { nodes++; node(v->expr); }
+        virtual void visit(Tuple *v) { nodes++; node(v->elems); }
+        virtual void visit(Unpack *v) { nodes++; node(v->vars); node(v->expr); }
+};
+
+struct Builder {
+    Arena &arena;
+    symbol_t x, y, i, n, f, Int;
+
+    Builder(Arena &_arena): arena(_arena), x(Symbols::intern("x")), y(Symbols::intern("y")),
+        i(Symbols::intern("i")), n(Symbols::intern("n")), f(Symbols::intern("f")), Int(Symbols::intern("Int")) { }
+
+    Node *var(symbol_t s) { return arena.make<Variable>(s); }
+    Node *num(int v) { return arena.make<Integer>(v); }
+    Node *bin(int op, Node *l, Node *r) { return arena.make<Binary>(op, l, r); }
+
+    Node *call(symbol_t callee, Node *arg) {
+        ExprList *args = arena.make<ExprList>();
+        args->appendChild(arena, arg);
+        return arena.make<Call>(var(callee), args);
+    }
+
+    /*
+     * fun f |Int n| -> Int:
+     *     var x = n*3 + 1
+     *     var y = 0
+     *     var i = 0
+     *     while i < n:
+     *         if x % 2 == 0:
+     *             x = x/2
+     *         else:
+     *             x = f(x - 1)
+     *         y = y + x*i
+     *         i = i + 1
+     *     return y
+     */
+    Node *function(symbol_t name) {
+        StmtList *body = arena.make<StmtList>();
+        body->appendChild(arena, arena.make<Declaration>(x, bin('+', bin('*', var(n), num(3)), num(1)), nullptr));
+        body->appendChild(arena, arena.make<Declaration>(y, num(0), nullptr));
+        body->appendChild(arena, arena.make<Declaration>(i, num(0), nullptr));
+
+        StmtList *then = arena.make<StmtList>();
+        then->appendChild(arena, arena.make<Assign>(arena, var(x), bin('/', var(x), num(2))));
+        StmtList *other = arena.make<StmtList>();
+        other->appendChild(arena, arena.make<Assign>(arena, var(x), call(f, bin('-', var(x), num(1)))));
+
+        StmtList *loop = arena.make<StmtList>();
+        loop->appendChild(arena, arena.make<IfElse>(bin('=', bin('%', var(x), num(2)), num(0)), then, other));
+        loop->appendChild(arena, arena.make<Assign>(arena, var(y), bin('+', var(y), bin('*', var(x), var(i)))));
+        loop->appendChild(arena, arena.make<Assign>(arena, var(i), bin('+', var(i), num(1))));
+        body->appendChild(arena, arena.make<While>(bin('<', var(i), var(n)), loop));
+        body->appendChild(arena, arena.make<Return>(var(y)));
+
+        TypeList *params = arena.make<TypeList>();
+        params->appendNamedChild(arena, n, arena.make<SimpleType>(Int));
+        FuncType *proto = arena.make<FuncType>(params, arena.make<SimpleType>(Int));
+        return arena.make<FuncDecl>(name, arena.make<Function>(proto, body));
+    }
+};
+
+double seconds(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+}
+
+}
+
+int main(int argc, char **argv) {
+    long functions = argc > 1 ? atol(argv[1]) : 100000;
+
+    Arena arena;
+    Builder b(arena);
+    StmtList *program = arena.make<StmtList>();
+    auto start = std::chrono::steady_clock::now();
+    for (long k = 0; k < functions; k++)
+        program->appendChild(arena, b.function(Symbols::intern("f" + std::to_string(k))));
+    double build = seconds(std::chrono::steady_clock::now() - start);
+
+    Walker count;
+    program->accept(&count);
+    printf("nodes:          %zu in %ld functions\n", count.nodes, functions);
+    printf("arena bytes:    %zu\n", arena.allocated());
+    printf("bytes per node: %.1f\n", (double)arena.allocated()/count.nodes);
+    printf("build:          %.1f ns per node\n", build*1e9/count.nodes);
+
+    // best of a few walks, the tree is warm in cache only if it fits
+    double best = 0;
+    for (int r = 0; r < 5; r++) {
+        Walker w;
+        start = std::chrono::steady_clock::now();
+        program->accept(&w);
+        double t = seconds(std::chrono::steady_clock::now() - start);
+        if (r == 0 || t < best)
+            best = t;
+    }
+    printf("traversal:      %.2f ns per node, %.1f M nodes/s\n", best*1e9/count.nodes, count.nodes/best/1e6);
+    return 0;
+}
@@ -0,0 +1,211 @@
+#include <set>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include "bounds.h"
+
+using ::llvm::BasicBlock;
+using ::llvm::BranchInst;
+using ::llvm::ConstantInt;
+using ::llvm::Function;
+using ::llvm::ICmpInst;
+using ::llvm::Module;
+using ::llvm::PHINode;
+using ::llvm::Value;
+
+namespace {
+
+class BoundsCheckOpt: public llvm::FunctionPass {
+    private:
+        // how far the proof follows phis and increments
+        static const int MAX_DEPTH = 8;
+
+        Function *fail;
+        llvm::DominatorTree *DT;
+        // length of the check being proved
+        Value *len;
+
+        Value *checkedIndex(BranchInst *br);
+        bool edgeBound(BasicBlock *from, BasicBlock *to, Value *x, Value *&bound);
+        bool belowLength(Value *bound);
+        bool bounded(Value *x, BasicBlock *at, bool any, int depth);
+        bool nonNegative(Value *x, std::set<PHINode *> &assumed, int depth);
+        bool inBounds(Value *idx, BasicBlock *at);
+
+    public:
+        static char ID;
+
+        BoundsCheckOpt(): FunctionPass(ID), fail(nullptr), DT(nullptr), len(nullptr) { }
+
+        virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const {
+            AU.addRequired<llvm::DominatorTreeWrapperPass>();
+            AU.setPreservesCFG();
+        }
+
+        virtual bool doInitialization(Module &M);
+        virtual bool runOnFunction(Function &F);
+};
+
+char BoundsCheckOpt::ID = 0;
+
+bool BoundsCheckOpt::doInitialization(Module &M) {
+    fail = M.getFunction("mamba_bounds_fail");
+    return false;
+}
+
+// The index of a bounds check, which sets len, or nullptr.
+Value *BoundsCheckOpt::checkedIndex(BranchInst *br) {
+    if (!br->isConditional())
+        return nullptr;
+    ICmpInst *cmp = llvm::dyn_cast<ICmpInst>(br->getCondition());
+    llvm::CallInst *call = llvm::dyn_cast_or_null<llvm::CallInst>(br->getSuccessor(1)->getFirstNonPHI());
+    if (!cmp || cmp->getPredicate() != ICmpInst::ICMP_ULT || !call || call->getCalledFunction() != fail)
+        return nullptr;
+    len = cmp->getOperand(1);
+    return cmp->getOperand(0);
+}
+
+// Taking the edge from -> to means x <s bound.
+bool BoundsCheckOpt::edgeBound(BasicBlock *from, BasicBlock *to, Value *x, Value *&bound) {
+    BranchInst *br = llvm::dyn_cast<BranchInst>(from->getTerminator());
+    if (!br || !br->isConditional() || br->getSuccessor(0) == br->getSuccessor(1))
+        return false;
+    ICmpInst *cmp = llvm::dyn_cast<ICmpInst>(br->getCondition());
+    if (cmp == nullptr)
+        return false;
+
+    ICmpInst::Predicate pred = br->getSuccessor(0) == to ? cmp->getPredicate() : cmp->getInversePredicate();
+    Value *a = cmp->getOperand(0), *b = cmp->getOperand(1);
+    if (b == x) {
+        std::swap(a, b);
+        pred = ICmpInst::getSwappedPredicate(pred);
+    }
+    if (a != x || pred != ICmpInst::ICMP_SLT)
+        return false;
+    bound = b;
+    return true;
+}
+
+// A non-negative value below bound is below len. Truncating the length
+// to the type of a loop counter keeps it at or below the length.
+bool BoundsCheckOpt::belowLength(Value *bound) {
+    if (bound == len)
+        return true;
+    if (llvm::TruncInst *trunc = llvm::dyn_cast<llvm::TruncInst>(bound))
+        return trunc->getOperand(0) == len;
+    ConstantInt *b = llvm::dyn_cast<ConstantInt>(bound), *l = llvm::dyn_cast<ConstantInt>(len);
+    return b && l && !b->isNegative() && b->getZExtValue() <= l->getZExtValue();
+}
+
+// x <s bound holds in block at, for a bound below the length or, with
+// any, for some bound.
+bool BoundsCheckOpt::bounded(Value *x, BasicBlock *at, bool any, int depth) {
+    if (depth > MAX_DEPTH)
+        return false;
+    if (ConstantInt *c = llvm::dyn_cast<ConstantInt>(x)) {
+        if (any)
+            return !c->isMaxValue(true);
+        ConstantInt *l = llvm::dyn_cast<ConstantInt>(len);
+        if (l && !c->isNegative() && c->getZExtValue() < l->getZExtValue())
+            return true;
+    }
+
+    // conditions on the way to at
+    for (llvm::DomTreeNode *node = DT->getNode(at); node; node = node->getIDom()) {
+        BasicBlock *block = node->getBlock();
+        BasicBlock *pred = block->getSinglePredecessor();
+        Value *bound;
+        if (pred && edgeBound(pred, block, x, bound) && (any || belowLength(bound)))
+            return true;
+    }
+
+    // every value a phi takes, as in a rotated loop where the guard
+    // bounds the first value and the latch the next ones
+    PHINode *phi = llvm::dyn_cast<PHINode>(x);
+    if (phi == nullptr)
+        return false;
+    for (unsigned i = 0; i < phi->getNumIncomingValues(); i++) {
+        Value *v = phi->getIncomingValue(i), *bound;
+        BasicBlock *pred = phi->getIncomingBlock(i);
+        if (edgeBound(pred, phi->getParent(), v, bound) && (any || belowLength(bound)))
+            continue;
+        if (v == phi || !bounded(v, pred, any, depth + 1))
+            return false;
+    }
+    return true;
+}
+
+// Phis in assumed are taken to be non-negative, which holds by
+// induction once every value flowing into them is.
+bool BoundsCheckOpt::nonNegative(Value *x, std::set<PHINode *> &assumed, int depth) {
+    if (depth > MAX_DEPTH)
+        return false;
+    if (ConstantInt *c = llvm::dyn_cast<ConstantInt>(x))
+        return !c->isNegative();
+    if (llvm::isa<llvm::ZExtInst>(x))
+        return true;
+
+    if (PHINode *phi = llvm::dyn_cast<PHINode>(x)) {
+        if (!assumed.insert(phi).second)
+            return true;
+        for (unsigned i = 0; i < phi->getNumIncomingValues(); i++)
+            if (!nonNegative(phi->getIncomingValue(i), assumed, depth + 1))
+                return false;
+        return true;
+    }
+
+    // o + c, which does not wrap when it is nsw, or when c is one and
+    // o is below some bound
+    llvm::BinaryOperator *add = llvm::dyn_cast<llvm::BinaryOperator>(x);
+    if (add == nullptr || add->getOpcode() != llvm::Instruction::Add)
+        return false;
+    Value *o = add->getOperand(0);
+    ConstantInt *c = llvm::dyn_cast<ConstantInt>(add->getOperand(1));
+    if (c == nullptr) {
+        o = add->getOperand(1);
+        c = llvm::dyn_cast<ConstantInt>(add->getOperand(0));
+    }
+    if (c == nullptr || c->isNegative() || !nonNegative(o, assumed, depth + 1))
+        return false;
+    return add->hasNoSignedWrap() || c->isZero() || (c->isOne() && bounded(o, add->getParent(), true, depth + 1));
+}
+
+bool BoundsCheckOpt::inBounds(Value *idx, BasicBlock *at) {
+    ConstantInt *c = llvm::dyn_cast<ConstantInt>(idx), *l = llvm::dyn_cast<ConstantInt>(len);
+    if (c && l)
+        return c->getValue().ult(l->getValue());
+
+    // Codegen widens narrower indices to the type of the length
+    Value *x = idx;
+    if (llvm::isa<llvm::SExtInst>(idx) || llvm::isa<llvm::ZExtInst>(idx))
+        x = llvm::cast<llvm::Instruction>(idx)->getOperand(0);
+    std::set<PHINode *> assumed;
+    return nonNegative(x, assumed, 0) && bounded(x, at, false, 0);
+}
+
+bool BoundsCheckOpt::runOnFunction(Function &F) {
+    if (fail == nullptr)
+        return false;
+
+    DT = &getAnalysis<llvm::DominatorTreeWrapperPass>().getDomTree();
+    bool changed = false;
+    for (auto &block: F) {
+        BranchInst *br = llvm::dyn_cast<BranchInst>(block.getTerminator());
+        Value *idx = br ? checkedIndex(br) : nullptr;
+        if (idx && inBounds(idx, &block)) {
+            // the failing block goes away with the next CFG simplification
+            br->setCondition(ConstantInt::getTrue(F.getContext()));
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+}
+
+llvm::FunctionPass *createBoundsCheckPass() {
+    return new BoundsCheckOpt();
+}
@@ -0,0 +1,17 @@
+#ifndef __BOUNDS_H__
+#define __BOUNDS_H__
+
+#include <llvm/Pass.h>
+
+/*
+ * Removes the array bounds checks Codegen emits, branches on
+ * idx u< len whose failing side calls mamba_bounds_fail, when the
+ * check always passes. An index is in bounds when it is not negative
+ * and a condition guarding the check puts it below the length, or below
+ * the same length truncated to the index type. For a phi, as in the
+ * header of a loop, every incoming edge must set that bound. Loops
+ * without checks are left for the vectorizer.
+ */
+llvm::FunctionPass *createBoundsCheckPass();
+
+#endif//__BOUNDS_H__
@@ -0,0 +1,98 @@
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <llvm/Support/MD5.h>
+#include "cache.h"
+
+#define CACHE_FORMAT "mamba-cache-2"
+
+// hash a NUL terminated field so adjacent fields cannot run together
+static void field(llvm::MD5 &md5, llvm::StringRef str) {
+    md5.update(llvm::ArrayRef<uint8_t>((const uint8_t *)str.data(), str.size() + 1));
+}
+
+// MD5 of the binary holding the compiler, so entries written by any
+// other build of it are never reused. Empty when it cannot be read, which
+// turns the cache off.
+static const std::string &buildId() {
+    static const std::string id = []() {
+        Dl_info info;
+        if (dladdr((void *)&buildId, &info) == 0 || info.dli_fname == NULL)
+            return std::string();
+        std::ifstream in(info.dli_fname, std::ios::binary);
+        if (!in)
+            return std::string();
+
+        llvm::MD5 md5;
+        char buf[64*1024];
+        while (in.read(buf, sizeof(buf)) || in.gcount() > 0)
+            md5.update(llvm::ArrayRef<uint8_t>((const uint8_t *)buf, in.gcount()));
+        if (in.bad())
+            return std::string();
+
+        llvm::MD5::MD5Result result;
+        llvm::SmallString<32> str;
+        md5.final(result);
+        llvm::MD5::stringifyResult(result, str);
+        return str.str().str();
+    }();
+    return id;
+}
+
+std::string BuildCache::key(const char *kind, const std::string &module, const char *data, size_t size) const {
+    llvm::MD5 md5;
+    field(md5, CACHE_FORMAT);
+    field(md5, buildId());
+    field(md5, options.c_str());
+    field(md5, kind);
+    field(md5, module.c_str());
+    md5.update(llvm::ArrayRef<uint8_t>((const uint8_t *)data, size));
+
+    llvm::MD5::MD5Result result;
+    llvm::SmallString<32> str;
+    md5.final(result);
+    llvm::MD5::stringifyResult(result, str);
+    return str.str();
+}
+
+bool BuildCache::lookup(const std::string &key, std::string &bitcode) const {
+    if (buildId().empty())
+        return false;
+    std::ifstream in((dir + "/" + key + ".bc").c_str(), std::ios::binary);
+    if (!in)
+        return false;
+
+    std::ostringstream data;
+    data << in.rdbuf();
+    if (in.bad())
+        return false;
+    bitcode = data.str();
+    return true;
+}
+
+void BuildCache::store(const std::string &key, const std::string &bitcode) const {
+    if (buildId().empty())
+        return;
+    if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+        return;
+
+    std::ostringstream tmp;
+    tmp << dir << "/" << key << ".tmp." << getpid() << "." << std::this_thread::get_id();
+    std::string path = dir + "/" + key + ".bc";
+
+    {
+        std::ofstream out(tmp.str().c_str(), std::ios::binary);
+        out.write(bitcode.data(), bitcode.size());
+        if (!out) {
+            unlink(tmp.str().c_str());
+            return;
+        }
+    }
+    if (rename(tmp.str().c_str(), path.c_str()) != 0)
+        unlink(tmp.str().c_str());
+}
@@ -0,0 +1,27 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <string>
+
+/*
+ * On-disk store of generated module bitcode. Entries are keyed by an MD5
+ * over the cache format, the compiler binary itself, the compiler
+ * options, the module name and either the module source or the
+ * fingerprint of its tree, so a rebuilt compiler never reuses code an
+ * older one generated. Writes go to a temporary file that is renamed
+ * into place, so concurrent builds never observe partial entries.
+ */
+class BuildCache {
+    private:
+        std::string dir;
+        std::string options;
+
+    public:
+        BuildCache(const std::string &_dir, const std::string &_options = ""): dir(_dir), options(_options) { }
+
+        std::string key(const char *kind, const std::string &module, const char *data, size_t size) const;
+        bool lookup(const std::string &key, std::string &bitcode) const;
+        void store(const std::string &key, const std::string &bitcode) const;
+};
+
+#endif//__CACHE_H__
@@ -0,0 +1,109 @@
+#include "clone.h"
+
+namespace ast {
+
+class Cloner: public Visitor {
+private:
+    Arena &arena;
+    Node *result;
+
+    template<class T>
+    T *copy(T *n) {
+        if (n == nullptr)
+            return nullptr;
+        n->accept(this);
+        return static_cast<T *>(result);
+    }
+
+    template<class T>
+    T *items(T *to, ListNode *from) {
+        for (auto n: from->items)
+            to->appendChild(arena, copy(n));
+        return to;
+    }
+
+    template<class T, class... Args>
+    void make(Args... args) {
+        result = arena.make<T>(args...);
+    }
+
+public:
+    Cloner(Arena &_arena): arena(_arena), result(nullptr) { }
+
+    Node *run(Node *root) { return copy(root); }
+
+    virtual void visit(True *) { make<True>(); }
+    virtual void visit(False *) { make<False>(); }
+    virtual void visit(Integer *v) { make<Integer>(v->val); }
+    virtual void visit(Real *v) { make<Real>(v->val); }
+    // the text of a literal is never modified, share it
+    virtual void visit(String *v) { make<String>(v->val); }
+    virtual void visit(Variable *v) { make<Variable>(v->val); }
+    virtual void visit(Declaration *v) { make<Declaration>(v->name, copy(v->expr), copy(v->type_spec)); }
+
+    virtual void visit(Assign *v) {
+        Node *expr = copy(v->expr);
+        Assign *a = arena.make<Assign>(arena, copy(v->vars[0]), expr);
+        for (size_t i = 1; i < v->vars.size(); i++)
+            a->vars.push_back(arena, copy(v->vars[i]));
+        result = a;
+    }
+
+    virtual void visit(Call *v) { make<Call>(copy(v->parent), copy(v->params)); }
+    virtual void visit(Return *v) { make<Return>(copy(v->e)); }
+    virtual void visit(Unary *v) { make<Unary>(v->op, copy(v->down)); }
+    virtual void visit(Binary *v) { make<Binary>(v->op, copy(v->left), copy(v->right)); }
+    virtual void visit(And *v) { make<And>(copy(v->left), copy(v->right)); }
+    virtual void visit(Or *v) { make<Or>(copy(v->left), copy(v->right)); }
+    virtual void visit(IfElse *v) { make<IfElse>(copy(v->expr), copy(v->body), copy(v->ifelse)); }
+    virtual void visit(While *v) { make<While>(copy(v->expr), copy(v->body)); }
+    virtual void visit(Break *) { make<Break>(); }
+    virtual void visit(Continue *) { make<Continue>(); }
+    virtual void visit(For *v) { make<For>(v->vname, copy(v->iterable), copy(v->body)); }
+    virtual void visit(Array *v) { make<Array>(copy(v->elems)); }
+    virtual void visit(Subscript *v) { make<Subscript>(copy(v->var), copy(v->idx)); }
+    virtual void visit(Expr *v) { make<Expr>(copy(v->e)); }
+    virtual void visit(Function *v) { make<Function>(copy(v->proto), copy(v->body)); }
+    virtual void visit(FuncDecl *v) { make<FuncDecl>(v->name, copy(v->func), copy(v->generics)); }
+    virtual void visit(UnionItem *v) { make<UnionItem>(v->name, copy(v->type_spec)); }
+    virtual void visit(UnionList *v) { result = items(arena.make<UnionList>(), v); }
+    virtual void visit(RecordDef *v) { make<RecordDef>(v->name, copy(v->decl_list), v->layout); }
+    virtual void visit(UnionDef *v) { make<UnionDef>(v->name, copy(v->type_list), copy(v->generics)); }
+    virtual void visit(ExprList *v) { result = items(arena.make<ExprList>(), v); }
+    virtual void visit(StmtList *v) { result = items(arena.make<StmtList>(), v); }
+    virtual void visit(SimpleType *v) { make<SimpleType>(v->tname); }
+    virtual void visit(RefType *v) { make<RefType>(copy(v->base_type)); }
+    virtual void visit(PtrType *v) { make<PtrType>(copy(v->base_type)); }
+    virtual void visit(ArrayType *v) { make<ArrayType>(copy(v->base_type)); }
+    virtual void visit(TupleType *v) { make<TupleType>(copy(v->base_type)); }
+    virtual void visit(FuncType *v) { make<FuncType>(copy(v->params), copy(v->ret)); }
+
+    virtual void visit(TypeList *v) {
+        TypeList *t = arena.make<TypeList>();
+        for (auto n: v->types)
+            t->types.push_back(arena, copy(n));
+        for (auto n: v->names)
+            t->names.push_back(arena, n);
+        result = t;
+    }
+
+    virtual void visit(IfaceDef *v) { make<IfaceDef>(v->name, copy(v->methods)); }
+    virtual void visit(Cast *v) { make<Cast>(copy(v->expr), copy(v->type)); }
+    virtual void visit(Member *v) { make<Member>(copy(v->obj), v->name); }
+    virtual void visit(New *v) { make<New>(copy(v->expr)); }
+    virtual void visit(Slice *v) { make<Slice>(copy(v->var), copy(v->lo), copy(v->hi), copy(v->step)); }
+    virtual void visit(SliceType *v) { make<SliceType>(copy(v->base_type)); }
+    virtual void visit(GenericType *v) { make<GenericType>(v->tname, copy(v->args)); }
+    virtual void visit(Match *v) { make<Match>(copy(v->expr), copy(v->arms)); }
+    virtual void visit(MatchArm *v) { make<MatchArm>(v->name, v->var, copy(v->body)); }
+    virtual void visit(NamedArg *v) { make<NamedArg>(v->name, copy(v->expr)); }
+    virtual void visit(Tuple *v) { make<Tuple>(copy(v->elems)); }
+    virtual void visit(Unpack *v) { make<Unpack>(v->tname, copy(v->vars), copy(v->expr)); }
+};
+
+Node *clone(Node *root, Arena &arena) {
+    Cloner cloner(arena);
+    return cloner.run(root);
+}
+
+}
@@ -0,0 +1,16 @@
+#ifndef __CLONE_H__
+#define __CLONE_H__
+
+#include "arena.h"
+#include "ast.h"
+
+/*
+ * Deep copy of a tree into arena. Types resolved by the checker are not
+ * copied, so the copy can be checked again under different bindings (the
+ * instances of a generic function).
+ */
+namespace ast {
+    Node *clone(Node *root, Arena &arena);
+}
+
+#endif//__CLONE_H__
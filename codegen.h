@@ -1,7 +1,13 @@
+#ifndef __CODEGEN_H__
+#define __CODEGEN_H__
+
 #include "ast.h"
+#include "typeclass.h"
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <map>
+#include <mutex>
 #include <stack>
 #include <vector>
 #include <memory>
@@ -9,60 +15,256 @@
 #include <llvm/Transforms/Scalar.h>
 #include <llvm/Analysis/Passes.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/JIT.h>
+#include <llvm/IR/Constants.h>
 #include <llvm/IR/DataLayout.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/IR/Value.h>
 #include <llvm/IR/Module.h>
-#include <llvm/IR/IRbuilder.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Verifier.h>
 #include <llvm/Support/TargetSelect.h>
+#include "native.h"
+#include "optimizer.h"
+#include "tiered_jit.h"
+#include "runtime/runtime.h"
 
 using ::llvm::IRBuilder;
 using ::llvm::ExecutionEngine;
 using ::llvm::FunctionPassManager;
 using ::llvm::BasicBlock;
+using ::llvm::ConstantFP;
+using ::llvm::Function;
 using ::llvm::Module;
 using ::llvm::LLVMContext;
+using ::llvm::PHINode;
 using ::llvm::Value;
 using std::unique_ptr;
 
-struct Expr {
-    std::string type_name;
-    ::llvm::Type *type;
-    Value *value;
+// bindings shadowed when a scope was opened, restored when it closes
+typedef std::vector<std::pair<ast::symbol_t, Expr*> > scope_t;
+
+/*
+ * How the fields of a record are laid out. Fields go by decreasing
+ * alignment, which leaves no padding between them, unless the record is
+ * declared as fixed. An array of an soa record stores one array per
+ * field, in that same order, one after the other in its buffer:
+ *
+ *     [x0 x1 ... xn-1][y0 y1 ... yn-1]
+ *
+ * so a loop reading p.x only touches the xs.
+ */
+struct RecordLayout {
+    ::llvm::StructType *type;
+    // position of every field in type, by declaration
+    std::vector<unsigned> slots;
+    bool soa;
 };
 
-typedef std::map<std::string, Expr*> env_t;
+/*
+ * How the values of a union type are laid out, by the payloads of its
+ * variants. The tag of a variant is its index.
+ *
+ *   ENUM     no payloads: {tag}
+ *   POINTER  one payload that starts with a pointer that is never null
+ *            (a pointer, reference, function, array, slice or
+ *            interface) and fewer than NICHES other variants: {payload},
+ *            the others are the addresses 0, 1, ... in that pointer.
+ *            Maybe{*T} is a nullable pointer.
+ *   BOOL     one Bool payload: {i8}, 0 and 1 hold the payload, 2, 3,
+ *            ... the other variants
+ *   TAGGED   one other payload: {payload, tag}, the tag goes in the
+ *            tail padding of the payload if it has some
+ *   SHARED   more payloads: {[n x i64], tag}, every payload is read and
+ *            written through a pointer cast from the storage
+ *
+ * The tag is an i8, or an i32 past 256 variants.
+ */
+struct UnionLayout {
+    enum Kind { ENUM, POINTER, BOOL, TAGGED, SHARED };
+    // the first page is never mapped
+    static const uint64_t NICHES = 4096;
+
+    Kind kind;
+    ::llvm::StructType *type;
+    // per variant, nullptr when it has none
+    std::vector<const sema::Type*> payloads;
+    // value of the discriminant for every variant, nullptr for the
+    // payload of POINTER and BOOL, which takes all the other values
+    std::vector< ::llvm::ConstantInt*> cases;
+    // variants without a payload
+    size_t empty;
+};
 
 class Codegen: public ast::Visitor {
 private:
     std::stack<Expr*> stack;
-    std::vector<env_t> env;
+    std::vector<Expr*> bindings;
+    std::vector<scope_t> env;
+    // variables of each scope that hold a heap reference
+    std::vector<std::vector<Expr*> > owners;
     std::stack<BasicBlock*> continue_blocks;
     std::stack<BasicBlock*> break_blocks;
-
+    // scope depth where the current function and loops begin
+    std::stack<size_t> function_depths;
+    std::stack<size_t> loop_depths;
+    // where the current function stores its result, null when it returns
+    // it in registers
+    std::stack<Value*> sret_slots;
+    std::vector<ast::IfaceDef*> ifaces;
+    std::map<ast::symbol_t, ::llvm::StructType*> iface_types;
+    std::vector<ast::UnionDef*> unions;
+    // the union and index of every variant
+    std::vector<std::pair<ast::UnionDef*, size_t> > variants;
+    std::map<const sema::Type*, UnionLayout> union_layouts;
+    std::vector<ast::RecordDef*> records;
+    std::map<const sema::Type*, RecordLayout> record_layouts;
+
+    OptLevel level;
+    bool finalized;
+    std::mutex module_lock;
     unique_ptr<Module> module;
     unique_ptr<ExecutionEngine> engine;
     unique_ptr<IRBuilder<> > builder;
     unique_ptr<FunctionPassManager> pass_manager;
+    unique_ptr<TieredJIT> tiers;
 
 public:
-    Codegen():
-        module(unique_ptr<Module>(new Module("jit", llvm::getGlobalContext()))),
-        engine(unique_ptr<ExecutionEngine>(ExecutionEngine::createJIT(module.get()))),
+    // With jit set the module is handed to a JIT execution engine and,
+    // unless level is -O0, functions start at the baseline tier.
+    // Otherwise the module is only built with the function passes of
+    // level, which lets every thread generate code into its own
+    // LLVMContext.
+    Codegen(LLVMContext &ctx = llvm::getGlobalContext(), const std::string &name = "jit", bool jit = true, const OptLevel &_level = OptLevel()):
+        level(_level), finalized(false),
+        module(unique_ptr<Module>(new Module(name, ctx))),
+        engine(unique_ptr<ExecutionEngine>(jit ? ExecutionEngine::createJIT(module.get()) : nullptr)),
         builder(unique_ptr<IRBuilder<>>(new IRBuilder<>(module->getContext()))),
         pass_manager(unique_ptr<FunctionPassManager>(new FunctionPassManager(module.get()))) {
 
-        pass_manager->add(new llvm::DataLayoutPass(*engine->getDataLayout()));
-        pass_manager->add(llvm::createBasicAliasAnalysisPass());
-        pass_manager->add(llvm::createPromoteMemoryToRegisterPass());
-        pass_manager->add(llvm::createInstructionCombiningPass());
-        pass_manager->add(llvm::createReassociatePass());
-        pass_manager->add(llvm::createGVNPass());
-        pass_manager->add(llvm::createCFGSimplificationPass());
+        // the layout is known before any pass runs, the module passes and
+        // NativeBackend::prepare see the same one
+        const llvm::DataLayout *layout = engine ? engine->getDataLayout() : NativeBackend::hostDataLayout();
+        if (layout) {
+            module->setDataLayout(layout);
+            pass_manager->add(new llvm::DataLayoutPass(*layout));
+        }
+        if (engine) {
+            if (level.enabled()) {
+                tiers = unique_ptr<TieredJIT>(new TieredJIT(engine.get(), module.get(), module_lock));
+                TieredJIT::addBaselinePasses(*pass_manager);
+            }
+        } else {
+            level.addFunctionPasses(*pass_manager);
+        }
+
+        // declared up front, the refcount pass looks them up once
+        ::llvm::Type *void_ty = builder->getVoidTy(), *ptr_ty = builder->getInt8PtrTy();
+        runtime("mamba_alloc", ptr_ty, builder->getInt64Ty(), (void *)&mamba_alloc)->setDoesNotAlias(0);
+        runtime("mamba_retain", void_ty, ptr_ty, (void *)&mamba_retain);
+        runtime("mamba_release", void_ty, ptr_ty, (void *)&mamba_release);
+        runtime("mamba_free", void_ty, ptr_ty, (void *)&mamba_free);
+        runtime("mamba_release_last", builder->getInt32Ty(), ptr_ty, (void *)&mamba_release_last);
+        runtime("mamba_arena_push", void_ty, ::llvm::ArrayRef< ::llvm::Type*>(), (void *)&mamba_arena_push);
+        runtime("mamba_arena_pop", void_ty, ::llvm::ArrayRef< ::llvm::Type*>(), (void *)&mamba_arena_pop);
+        ::llvm::Type *index_ty[] = { builder->getInt64Ty(), builder->getInt64Ty() };
+        Function *bounds = runtime("mamba_bounds_fail", void_ty, index_ty, (void *)&mamba_bounds_fail);
+        bounds->setDoesNotReturn();
+        bounds->setDoesNotThrow();
+        ::llvm::Type *slice_ty[] = { builder->getInt64Ty(), builder->getInt64Ty(), builder->getInt64Ty(), builder->getInt64Ty() };
+        Function *slice = runtime("mamba_slice_fail", void_ty, slice_ty, (void *)&mamba_slice_fail);
+        slice->setDoesNotReturn();
+        slice->setDoesNotThrow();
+        Function *panic = runtime("mamba_panic", void_ty, ptr_ty, (void *)&mamba_panic);
+        panic->setDoesNotReturn();
+        panic->setDoesNotThrow();
+
         pass_manager->doInitialization();
+        pushScope();
+    }
+
+    ~Codegen() {
+        // the execution engine owns the module it runs
+        if (engine)
+            module.release();
     }
 
     static void init() { llvm::InitializeNativeTarget(); }
 
+    Module *getModule() { return module.get(); }
+    TieredJIT *getTiers() { return tiers.get(); }
+
+    // Emit the top level statements of root into a void function named
+    // entry. The tree must have passed the TypeChecker.
+    Function *generate(ast::Node *root, const std::string &entry) {
+        std::lock_guard<std::mutex> guard(module_lock);
+        ::llvm::FunctionType *fty = ::llvm::FunctionType::get(builder->getVoidTy(), false);
+        Function *func = Function::Create(fty, Function::ExternalLinkage, entry, module.get());
+        builder->SetInsertPoint(BasicBlock::Create(module->getContext(), "entry", func));
+
+        // interfaces, unions and records may be used before their definition
+        if (ast::StmtList *stmts = dynamic_cast<ast::StmtList*>(root))
+            for (auto n: stmts->items)
+                if (dynamic_cast<ast::IfaceDef*>(n) || dynamic_cast<ast::UnionDef*>(n) || dynamic_cast<ast::RecordDef*>(n))
+                    n->accept(this);
+        function_depths.push(0);
+        root->accept(this);
+        function_depths.pop();
+
+        if (!builder->GetInsertBlock()->getTerminator()) {
+            releaseScopes(0);
+            builder->CreateRetVoid();
+        }
+        // the variables of this entry are gone once it returns
+        owners[0].clear();
+        ::llvm::verifyFunction(*func);
+        pass_manager->run(*func);
+        return func;
+    }
+
+    // Run the module passes of the optimization level over a module that
+    // is written out.
+    void optimize() {
+        llvm::PassManager pm;
+        if (const llvm::DataLayout *layout = module->getDataLayout())
+            pm.add(new llvm::DataLayoutPass(*layout));
+        level.addModulePasses(pm);
+        pm.run(*module);
+    }
+
+    // JIT compile a function built by generate() and call it.
+    void run(Function *func) {
+        void *code;
+        {
+            std::lock_guard<std::mutex> guard(module_lock);
+            finalize();
+            code = engine->getPointerToFunction(func);
+        }
+        ((void (*)())code)();
+    }
+
+    // Run the baseline module passes once, before the engine compiles
+    // the first function; the passes of the level are left to tier-up.
+    // They may inline or drop internal functions, so the tier counters go
+    // on the ones that are left. Called with the module lock held.
+    void finalize() {
+        if (finalized || !tiers)
+            return;
+        finalized = true;
+        llvm::PassManager pm;
+        if (const llvm::DataLayout *layout = module->getDataLayout())
+            pm.add(new llvm::DataLayoutPass(*layout));
+        TieredJIT::addBaselineModulePasses(pm);
+        pm.run(*module);
+        for (auto &f: *module)
+            if (!f.isDeclaration() && !f.hasExternalLinkage())
+                tiers->instrument(&f);
+    }
+
     void dump() {
         module->dump();
     }
@@ -71,48 +273,971 @@ public:
         std::cout << msg << std::endl;
     }
 
-    Expr *getvar(std::string name) {
-        for (auto it = env.rbegin(); it != env.rend(); ++it) {
-            env_t &e = *it;
-            auto eit = e.find(name);
-            if (eit != e.end())
-                return eit->second;
+    // bindings is indexed by symbol id and always holds the innermost
+    // binding, so a lookup never walks the scope chain.
+    Expr *getvar(ast::symbol_t name) {
+        return name < bindings.size() ? bindings[name] : nullptr;
+    }
+
+    void addvar(ast::symbol_t name, Expr *val) {
+        if (name >= bindings.size())
+            bindings.resize(ast::Symbols::size(), nullptr);
+        env.back().push_back(std::make_pair(name, bindings[name]));
+        bindings[name] = val;
+    }
+
+    // Allocas go to the entry block, where mem2reg can promote them.
+    ::llvm::AllocaInst *createAlloca(::llvm::Type *type, const std::string &name) {
+        BasicBlock &entry = builder->GetInsertBlock()->getParent()->getEntryBlock();
+        IRBuilder<> tmp(&entry, entry.begin());
+        return tmp.CreateAlloca(type, 0, name);
+    }
+
+    ::llvm::Type *lltype(const sema::Type *t) {
+        switch (t->kind) {
+            case sema::Type::VOID:
+                return builder->getVoidTy();
+            case sema::Type::BUILTIN:
+                return typeIdType(builder->getContext(), t->id);
+            case sema::Type::POINTER:
+            case sema::Type::REFERENCE:
+                if (::llvm::Type *base = lltype(t->base))
+                    return base->getPointerTo();
+                break;
+            case sema::Type::FUNCTION:
+                if (::llvm::FunctionType *fty = llfunctype(t))
+                    return fty->getPointerTo();
+                break;
+            case sema::Type::ARRAY:
+                if (::llvm::Type *base = lltype(t->base))
+                    return arrayType(base);
+                break;
+            case sema::Type::SLICE:
+                if (::llvm::Type *base = lltype(t->base))
+                    return sliceType(base);
+                break;
+            case sema::Type::IFACE:
+                return ifaceType(t);
+            case sema::Type::TUPLE: {
+                std::vector< ::llvm::Type*> elems;
+                for (auto e: t->elems) {
+                    elems.push_back(lltype(e));
+                    if (elems.back() == nullptr)
+                        return nullptr;
+                }
+                return ::llvm::StructType::get(builder->getContext(), elems);
+            }
+            case sema::Type::NAMED:
+                if (unionOf(t))
+                    return layout(t).type;
+                if (recordOf(t))
+                    return recordLayout(t).type;
+                break;
+            default:
+                break;
         }
+        error("type " + t->str() + " not supported!");
         return nullptr;
     }
 
-    void addvar(std::string name, Expr *val) {
-        env.back().insert(std::make_pair(name, val));
+    // A result returned through memory is stored to a pointer the
+    // caller passes first, the function returns void.
+    ::llvm::FunctionType *llfunctype(const sema::Type *t) {
+        std::vector< ::llvm::Type*> params;
+        ::llvm::Type *ret = lltype(t->base);
+        if (ret && sret(t->base)) {
+            params.push_back(ret->getPointerTo());
+            ret = builder->getVoidTy();
+        }
+        for (auto p: t->elems) {
+            ::llvm::Type *param = lltype(p);
+            if (param == nullptr)
+                return nullptr;
+            params.push_back(param);
+        }
+        return ret ? ::llvm::FunctionType::get(ret, params, false) : nullptr;
+    }
+
+    /*
+     * Whether a function returns ty through memory. Tuples, records and
+     * unions up to two words are returned as first class aggregates,
+     * which x86-64 and AArch64 return in registers, so a function
+     * returning (value, error) costs no store and no load. Larger ones
+     * go through an sret slot in the frame of the caller.
+     */
+    bool sret(const sema::Type *ty) {
+        ::llvm::Type *type = lltype(ty);
+        uint64_t align;
+        return type && type->isStructTy() && naturalSize(type, align) > 2*8;
+    }
+
+    // Call callee, which returns ty, with args.
+    Value *emitCall(Value *callee, const sema::Type *ty, std::vector<Value*> &args) {
+        if (!sret(ty))
+            return builder->CreateCall(callee, args);
+        ::llvm::AllocaInst *slot = createAlloca(lltype(ty), "sret");
+        args.insert(args.begin(), slot);
+        ::llvm::CallInst *call = builder->CreateCall(callee, args);
+        call->addAttribute(1, ::llvm::Attribute::StructRet);
+        return builder->CreateLoad(slot);
+    }
+
+    // An array is {T *data, i64 length}, data is a heap buffer.
+    ::llvm::StructType *arrayType(::llvm::Type *elem) {
+        ::llvm::Type *fields[] = { elem->getPointerTo(), builder->getInt64Ty() };
+        return ::llvm::StructType::get(builder->getContext(), fields);
+    }
+
+    // A slice is {T *ptr, i64 length, i64 stride, i8 *buf}, the elements
+    // ptr[i*stride] of buf. Slicing shares the buffer and copies nothing.
+    ::llvm::StructType *sliceType(::llvm::Type *elem) {
+        ::llvm::Type *fields[] = { elem->getPointerTo(), builder->getInt64Ty(), builder->getInt64Ty(), builder->getInt8PtrTy() };
+        return ::llvm::StructType::get(builder->getContext(), fields);
+    }
+
+    ast::UnionDef *unionOf(const sema::Type *t) {
+        if (t->kind != sema::Type::NAMED || t->name >= unions.size())
+            return nullptr;
+        return unions[t->name];
+    }
+
+    // Payload of variant i of a union type, as the TypeChecker finds it.
+    const sema::Type *payloadType(const sema::Type *t, size_t i) {
+        ast::UnionDef *u = unionOf(t);
+        ast::Node *spec = static_cast<ast::UnionItem*>(static_cast<ast::UnionList*>(u->type_list)->items[i])->type_spec;
+        if (spec == nullptr || u->generics == nullptr)
+            return spec ? spec->ty : nullptr;
+        std::vector<ast::symbol_t> params(u->generics->names.begin(), u->generics->names.end());
+        return sema::Types::substitute(spec->ty, params, t->elems);
+    }
+
+    // Size and alignment of a type with every scalar aligned to its
+    // size, no less than on any target that aligns scalars at most to
+    // their size.
+    static uint64_t naturalSize(::llvm::Type *t, uint64_t &align) {
+        uint64_t size = 0;
+        align = 1;
+        if (::llvm::StructType *st = ::llvm::dyn_cast< ::llvm::StructType>(t)) {
+            for (auto field = st->element_begin(); field != st->element_end(); ++field) {
+                uint64_t a, n = naturalSize(*field, a);
+                size = (size + a - 1)/a*a + n;
+                align = std::max(align, a);
+            }
+            return (size + align - 1)/align*align;
+        }
+        if (::llvm::ArrayType *at = ::llvm::dyn_cast< ::llvm::ArrayType>(t))
+            return at->getNumElements()*naturalSize(at->getElementType(), align);
+        size = t->isPointerTy() ? 8 : (t->getPrimitiveSizeInBits() + 7)/8;
+        while (align < size)
+            align *= 2;
+        return align;
+    }
+
+    UnionLayout &layout(const sema::Type *t) {
+        auto it = union_layouts.find(t);
+        if (it != union_layouts.end())
+            return it->second;
+
+        // named, so a payload can point to the union itself
+        LLVMContext &ctx = module->getContext();
+        UnionLayout &L = union_layouts[t];
+        L.type = ::llvm::StructType::create(ctx, "union." + t->str());
+        size_t n = static_cast<ast::UnionList*>(unionOf(t)->type_list)->items.size();
+        std::vector< ::llvm::Type*> types;
+        size_t some = n;
+        L.empty = 0;
+        for (size_t i = 0; i < n; i++) {
+            L.payloads.push_back(payloadType(t, i));
+            types.push_back(L.payloads[i] ? lltype(L.payloads[i]) : nullptr);
+            if (L.payloads[i])
+                some = some == n ? i : n + 1;
+            else
+                L.empty++;
+        }
+        ::llvm::IntegerType *tag = n > 256 ? builder->getInt32Ty() : builder->getInt8Ty();
+
+        const sema::Type *P = some < n ? L.payloads[some] : nullptr;
+        sema::Type::Kind pk = P ? P->kind : sema::Type::VOID;
+        bool pointer = pk == sema::Type::POINTER || pk == sema::Type::REFERENCE || pk == sema::Type::FUNCTION ||
+            pk == sema::Type::ARRAY || pk == sema::Type::SLICE || pk == sema::Type::IFACE;
+        std::vector< ::llvm::Type*> fields;
+        ::llvm::IntegerType *disc = tag;
+        uint64_t first = 0;
+        if (some == n) {
+            L.kind = UnionLayout::ENUM;
+            fields.push_back(tag);
+        } else if (some < n && pointer && L.empty < UnionLayout::NICHES) {
+            L.kind = UnionLayout::POINTER;
+            fields.push_back(types[some]);
+            disc = builder->getInt64Ty();
+        } else if (some < n && P->is(TY_BOOL) && L.empty < 255) {
+            L.kind = UnionLayout::BOOL;
+            fields.push_back(builder->getInt8Ty());
+            disc = builder->getInt8Ty();
+            first = 2;
+        } else if (some < n) {
+            L.kind = UnionLayout::TAGGED;
+            fields.push_back(types[some]);
+            fields.push_back(tag);
+        } else {
+            L.kind = UnionLayout::SHARED;
+            uint64_t words = 1;
+            for (auto ty: types) {
+                uint64_t align;
+                if (ty)
+                    words = std::max(words, (naturalSize(ty, align) + 7)/8);
+            }
+            fields.push_back(::llvm::ArrayType::get(builder->getInt64Ty(), words));
+            fields.push_back(tag);
+        }
+        L.type->setBody(fields);
+
+        bool niche = L.kind == UnionLayout::POINTER || L.kind == UnionLayout::BOOL;
+        for (size_t i = 0; i < n; i++) {
+            if (niche && L.payloads[i])
+                L.cases.push_back(nullptr);
+            else
+                L.cases.push_back(::llvm::ConstantInt::get(disc, niche ? first++ : i));
+        }
+        return L;
+    }
+
+    // The value a match switches on.
+    Value *discriminant(const sema::Type *ty, Value *val) {
+        UnionLayout &L = layout(ty);
+        switch (L.kind) {
+            case UnionLayout::ENUM:
+            case UnionLayout::BOOL:
+                return builder->CreateExtractValue(val, 0, "tag");
+            case UnionLayout::POINTER: {
+                Value *ptr = builder->CreateExtractValue(val, 0);
+                if (!ptr->getType()->isPointerTy())
+                    ptr = builder->CreateExtractValue(ptr, 0);
+                return builder->CreatePtrToInt(ptr, builder->getInt64Ty(), "tag");
+            }
+            default:
+                return builder->CreateExtractValue(val, 1, "tag");
+        }
+    }
+
+    // Whether val holds variant i.
+    Value *holds(const sema::Type *ty, Value *val, size_t i) {
+        UnionLayout &L = layout(ty);
+        Value *disc = discriminant(ty, val);
+        if (L.cases[i])
+            return builder->CreateICmpEQ(disc, L.cases[i]);
+        if (L.kind == UnionLayout::BOOL)
+            return builder->CreateICmpULT(disc, builder->getInt8(2));
+        return builder->CreateICmpUGE(disc, builder->getInt64(L.empty));
+    }
+
+    // The payload of variant i, which val holds.
+    Value *payload(const sema::Type *ty, Value *val, size_t i) {
+        UnionLayout &L = layout(ty);
+        switch (L.kind) {
+            case UnionLayout::BOOL:
+                return builder->CreateTrunc(builder->CreateExtractValue(val, 0), builder->getInt1Ty());
+            case UnionLayout::SHARED: {
+                ::llvm::AllocaInst *slot = createAlloca(L.type, "union");
+                builder->CreateStore(val, slot);
+                ::llvm::Type *type = lltype(L.payloads[i]);
+                return builder->CreateLoad(builder->CreateBitCast(builder->CreateStructGEP(slot, 0), type->getPointerTo()));
+            }
+            default:
+                return builder->CreateExtractValue(val, 0);
+        }
+    }
+
+    // Variant i of a union type, with payload P if it has one. The
+    // union holds the reference P holds.
+    Expr *variant(const sema::Type *ty, size_t i, Expr *P) {
+        UnionLayout &L = layout(ty);
+        Value *val = ::llvm::Constant::getNullValue(L.type);
+        switch (L.kind) {
+            case UnionLayout::ENUM:
+                val = builder->CreateInsertValue(val, L.cases[i], 0);
+                break;
+            case UnionLayout::POINTER:
+                if (P) {
+                    val = builder->CreateInsertValue(val, P->value, 0);
+                } else {
+                    ::llvm::Type *field = L.type->getElementType(0);
+                    ::llvm::Type *ptr = field->isPointerTy() ? field : field->getStructElementType(0);
+                    unsigned path[] = { 0, 0 };
+                    val = builder->CreateInsertValue(val, ::llvm::ConstantExpr::getIntToPtr(L.cases[i], ptr), ::llvm::ArrayRef<unsigned>(path, field->isPointerTy() ? 1 : 2));
+                }
+                break;
+            case UnionLayout::BOOL:
+                val = builder->CreateInsertValue(val, P ? builder->CreateZExt(P->value, builder->getInt8Ty()) : L.cases[i], 0);
+                break;
+            case UnionLayout::TAGGED:
+                if (P)
+                    val = builder->CreateInsertValue(val, P->value, 0);
+                val = builder->CreateInsertValue(val, L.cases[i], 1);
+                break;
+            case UnionLayout::SHARED: {
+                ::llvm::AllocaInst *slot = createAlloca(L.type, "union");
+                builder->CreateStore(val, slot);
+                builder->CreateStore(L.cases[i], builder->CreateStructGEP(slot, 1));
+                if (P)
+                    builder->CreateStore(P->value, builder->CreateBitCast(builder->CreateStructGEP(slot, 0), P->type->getPointerTo()));
+                val = builder->CreateLoad(slot);
+                break;
+            }
+        }
+        return new Expr(ty, L.type, val, P && P->owned);
+    }
+
+    ast::RecordDef *recordOf(const sema::Type *t) {
+        if (t->kind != sema::Type::NAMED || t->name >= records.size())
+            return nullptr;
+        return records[t->name];
+    }
+
+    RecordLayout &recordLayout(const sema::Type *t) {
+        auto it = record_layouts.find(t);
+        if (it != record_layouts.end())
+            return it->second;
+
+        ast::RecordDef *r = recordOf(t);
+        RecordLayout &L = record_layouts[t];
+        L.type = ::llvm::StructType::create(module->getContext(), "record." + t->str());
+        L.soa = ast::Symbols::name(r->layout) == "soa";
+
+        ast::TypeList *fields = static_cast<ast::TypeList*>(r->decl_list);
+        std::vector< ::llvm::Type*> types;
+        std::vector<uint64_t> aligns;
+        std::vector<unsigned> order;
+        for (size_t i = 0; i < fields->names.size(); i++) {
+            uint64_t align;
+            types.push_back(lltype(fields->types[i]->ty));
+            naturalSize(types.back(), align);
+            aligns.push_back(align);
+            order.push_back(i);
+        }
+        if (ast::Symbols::name(r->layout) != "fixed")
+            std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) { return aligns[a] > aligns[b]; });
+
+        std::vector< ::llvm::Type*> body;
+        L.slots.resize(order.size());
+        for (size_t s = 0; s < order.size(); s++) {
+            L.slots[order[s]] = s;
+            body.push_back(types[order[s]]);
+        }
+        L.type->setBody(body);
+        return L;
+    }
+
+    // Whether arrays of elem store one array per field.
+    bool soa(const sema::Type *elem) {
+        return recordOf(elem) && recordLayout(elem).soa;
+    }
+
+    // Address of field slot s of element idx of an soa array A, in the
+    // array of that field. It starts after the arrays of the fields
+    // before it, each length times the size of its field.
+    Value *column(Expr *A, Value *idx, unsigned s) {
+        ::llvm::StructType *type = recordLayout(A->ty->base).type;
+        ::llvm::Constant *offset = builder->getInt64(0);
+        for (unsigned f = 0; f < s; f++)
+            offset = ::llvm::ConstantExpr::getAdd(offset, ::llvm::ConstantExpr::getSizeOf(type->getElementType(f)));
+        Value *data = builder->CreateBitCast(builder->CreateExtractValue(A->value, 0, "data"), builder->getInt8PtrTy());
+        Value *len = builder->CreateExtractValue(A->value, 1, "len");
+        Value *col = builder->CreateGEP(data, builder->CreateMul(len, offset));
+        col = builder->CreateBitCast(col, type->getElementType(s)->getPointerTo(), "column");
+        return builder->CreateGEP(col, idx);
+    }
+
+    // Element idx of A, idx already checked and scaled by the stride.
+    Value *loadElement(Expr *A, Value *idx) {
+        if (!soa(A->ty->base))
+            return builder->CreateLoad(builder->CreateGEP(builder->CreateExtractValue(A->value, 0, "data"), idx));
+        ::llvm::StructType *type = recordLayout(A->ty->base).type;
+        Value *val = ::llvm::UndefValue::get(type);
+        for (unsigned s = 0; s < type->getNumElements(); s++)
+            val = builder->CreateInsertValue(val, builder->CreateLoad(column(A, idx, s)), s);
+        return val;
+    }
+
+    void storeElement(Expr *A, Value *idx, Value *val) {
+        if (!soa(A->ty->base)) {
+            builder->CreateStore(val, builder->CreateGEP(builder->CreateExtractValue(A->value, 0, "data"), idx));
+            return;
+        }
+        ::llvm::StructType *type = recordLayout(A->ty->base).type;
+        for (unsigned s = 0; s < type->getNumElements(); s++)
+            builder->CreateStore(builder->CreateExtractValue(val, s), column(A, idx, s));
+    }
+
+    // A record from the arguments of a call to its name, in order or
+    // named. It takes a reference to every field.
+    Expr *construct(ast::Call *v, ast::RecordDef *r) {
+        const sema::Type *ty = v->ty;
+        RecordLayout &L = recordLayout(ty);
+        ast::TypeList *fields = static_cast<ast::TypeList*>(r->decl_list);
+        Value *val = ::llvm::UndefValue::get(L.type);
+        for (size_t i = 0; i < v->params->items.size(); i++) {
+            ast::Node *n = v->params->items[i];
+            size_t f = i;
+            if (ast::NamedArg *arg = dynamic_cast<ast::NamedArg*>(n))
+                f = std::find(fields->names.begin(), fields->names.end(), arg->name) - fields->names.begin();
+            n->accept(this);
+            assert(stack.size() >= 1);
+
+            Expr *F = stack.top();
+            stack.pop();
+            val = builder->CreateInsertValue(val, own(F), L.slots[f]);
+        }
+        return new Expr(ty, L.type, val, counted(ty));
+    }
+
+    /*
+     * Address of what an assignment target n names: a variable, an
+     * element or a field. Arrays it goes through are added to temps,
+     * to drop once the store is done. A field of a value that is not
+     * stored anywhere, like f().x, is set in a copy.
+     */
+    Value *address(ast::Node *n, std::vector<Expr*> &temps) {
+        if (ast::Variable *var = dynamic_cast<ast::Variable*>(n))
+            return getvar(var->val)->value;
+
+        ast::Member *m = dynamic_cast<ast::Member*>(n);
+        ast::Subscript *s = dynamic_cast<ast::Subscript*>(m ? m->obj : n);
+        if (s && (m == nullptr || m->obj->ty->kind != sema::Type::POINTER)) {
+            s->var->accept(this);
+            s->idx->accept(this);
+            assert(stack.size() >= 2);
+
+            Expr *I = stack.top();
+            stack.pop();
+            Expr *A = stack.top();
+            stack.pop();
+            temps.push_back(A);
+            Value *idx = index(A, I);
+            if (soa(A->ty->base))
+                return column(A, idx, recordLayout(A->ty->base).slots[m->field]);
+            Value *elem = builder->CreateGEP(builder->CreateExtractValue(A->value, 0, "data"), idx);
+            return m ? builder->CreateStructGEP(elem, recordLayout(A->ty->base).slots[m->field]) : elem;
+        }
+
+        Value *obj;
+        const sema::Type *rec = m->obj->ty;
+        if (rec->kind == sema::Type::POINTER || (!dynamic_cast<ast::Variable*>(m->obj) && !dynamic_cast<ast::Member*>(m->obj))) {
+            m->obj->accept(this);
+            assert(stack.size() >= 1);
+
+            Expr *O = stack.top();
+            stack.pop();
+            temps.push_back(O);
+            if (rec->kind == sema::Type::POINTER) {
+                obj = O->value;
+                rec = rec->base;
+            } else {
+                obj = createAlloca(O->type, "tmp");
+                builder->CreateStore(O->value, obj);
+            }
+        } else {
+            obj = address(m->obj, temps);
+        }
+        return builder->CreateStructGEP(obj, recordLayout(rec).slots[m->field]);
+    }
+
+    /*
+     * An interface value is a fat pointer {i8 *obj, vtable *}. The vtable
+     * of an interface is a struct with a function per method, which
+     * takes the object pointer in place of Self. Vtables are constant,
+     * so once a fat pointer is visible to the optimizer a load from its
+     * vtable folds into a direct call.
+     */
+    ::llvm::StructType *ifaceType(const sema::Type *t) {
+        auto it = iface_types.find(t->name);
+        if (it != iface_types.end())
+            return it->second;
+
+        LLVMContext &ctx = module->getContext();
+        std::vector< ::llvm::Type*> slots;
+        for (auto m: ifaces[t->name]->methods->types) {
+            std::vector< ::llvm::Type*> params(1, builder->getInt8PtrTy());
+            for (size_t i = 1; i < m->ty->elems.size(); i++)
+                params.push_back(lltype(m->ty->elems[i]));
+            slots.push_back(::llvm::FunctionType::get(lltype(m->ty->base), params, false)->getPointerTo());
+        }
+        const std::string &name = ast::Symbols::name(t->name);
+        ::llvm::StructType *vtable = ::llvm::StructType::create(ctx, slots, "vtable." + name);
+        ::llvm::Type *fields[] = { builder->getInt8PtrTy(), vtable->getPointerTo() };
+        ::llvm::StructType *fat = ::llvm::StructType::create(ctx, fields, "iface." + name);
+        iface_types[t->name] = fat;
+        return fat;
+    }
+
+    // The function T.name, declared if it is defined further on or in
+    // another unit; emitFunction then fills in the declaration.
+    Function *method(const sema::Type *type, ast::symbol_t name, const sema::Type *sig) {
+        std::vector<const sema::Type*> params = sig->elems;
+        params[0] = type;
+        return declare(type->str() + "." + ast::Symbols::name(name), sema::Types::function(params, sig->base));
+    }
+
+    // A function named fname of type sig, declared if it is missing.
+    Function *declare(const std::string &fname, const sema::Type *sig) {
+        if (Function *func = module->getFunction(fname))
+            return func;
+        return Function::Create(llfunctype(sig), Function::ExternalLinkage, fname, module.get());
+    }
+
+    // T.name for an object behind an i8 pointer, the vtable slot of T.
+    Function *thunk(const sema::Type *type, ast::symbol_t name, const sema::Type *sig, ::llvm::FunctionType *fty) {
+        std::string fname = type->str() + "." + ast::Symbols::name(name) + ".thunk";
+        if (Function *func = module->getFunction(fname))
+            return func;
+        Function *target = method(type, name, sig);
+        Function *func = Function::Create(fty, Function::InternalLinkage, fname, module.get());
+
+        IRBuilder<> b(BasicBlock::Create(module->getContext(), "entry", func));
+        auto arg = func->arg_begin();
+        // the sret slot goes on to the target
+        std::vector<Value*> args;
+        if (sret(sig->base))
+            args.push_back(arg++);
+        args.push_back(b.CreateLoad(b.CreateBitCast(arg, lltype(type)->getPointerTo())));
+        for (++arg; arg != func->arg_end(); ++arg)
+            args.push_back(arg);
+        Value *ret = b.CreateCall(target, args);
+        if (fty->getReturnType()->isVoidTy())
+            b.CreateRetVoid();
+        else
+            b.CreateRet(ret);
+        pass_manager->run(*func);
+        return func;
+    }
+
+    ::llvm::GlobalVariable *vtable(const sema::Type *type, const sema::Type *iface) {
+        std::string name = "vtable." + iface->str() + "." + type->str();
+        if (::llvm::GlobalVariable *vt = module->getNamedGlobal(name))
+            return vt;
+
+        ::llvm::StructType *vt_type = static_cast< ::llvm::StructType*>(ifaceType(iface)->getElementType(1)->getPointerElementType());
+        ast::TypeList *methods = ifaces[iface->name]->methods;
+        std::vector< ::llvm::Constant*> slots;
+        for (size_t i = 0; i < methods->names.size(); i++) {
+            ::llvm::FunctionType *fty = static_cast< ::llvm::FunctionType*>(vt_type->getElementType(i)->getPointerElementType());
+            slots.push_back(thunk(type, methods->names[i], methods->types[i]->ty, fty));
+        }
+        return new ::llvm::GlobalVariable(*module, vt_type, true, Function::InternalLinkage, ::llvm::ConstantStruct::get(vt_type, slots), name);
+    }
+
+    // Box a value as an interface. Every cast copies the object to a heap
+    // object of its own, counted like any other, which the result owns.
+    Expr *box(Expr *V, const sema::Type *iface) {
+        Value *obj = builder->CreateCall(module->getFunction("mamba_alloc"), ::llvm::ConstantExpr::getSizeOf(V->type), "obj");
+        builder->CreateStore(own(V), builder->CreateBitCast(obj, V->type->getPointerTo()));
+        ::llvm::StructType *fat = ifaceType(iface);
+        Value *val = ::llvm::UndefValue::get(fat);
+        val = builder->CreateInsertValue(val, obj, 0);
+        val = builder->CreateInsertValue(val, vtable(V->ty, iface), 1);
+        return new Expr(iface, fat, val, true);
+    }
+
+    // Declare a function of the runtime library. The JIT binds it to
+    // the copy linked into this process.
+    Function *runtime(const std::string &name, ::llvm::Type *ret, ::llvm::ArrayRef< ::llvm::Type*> params, void *addr) {
+        Function *func = module->getFunction(name);
+        if (func == nullptr) {
+            func = Function::Create(::llvm::FunctionType::get(ret, params, false), Function::ExternalLinkage, name, module.get());
+            if (engine)
+                engine->addGlobalMapping(func, addr);
+        }
+        return func;
+    }
+
+    /*
+     * Heap objects are reference counted. Every variable holding one owns
+     * a reference, released when its scope closes; other values are
+     * borrowed unless marked owned. Counting is atomic here, the refcount
+     * pass removes what it can prove redundant. The object of an array
+     * or a slice is its buffer, that of an interface value its box.
+     */
+    bool counted(const sema::Type *t) {
+        if (t->kind == sema::Type::POINTER || t->kind == sema::Type::ARRAY || t->kind == sema::Type::SLICE || t->kind == sema::Type::IFACE)
+            return true;
+        if (ast::RecordDef *r = recordOf(t)) {
+            for (auto f: static_cast<ast::TypeList*>(r->decl_list)->types)
+                if (counted(f->ty))
+                    return true;
+            return false;
+        }
+        if (t->kind == sema::Type::TUPLE) {
+            for (auto e: t->elems)
+                if (counted(e))
+                    return true;
+            return false;
+        }
+        if (unionOf(t) == nullptr)
+            return false;
+        for (auto p: layout(t).payloads)
+            if (p && counted(p))
+                return true;
+        return false;
+    }
+
+    Value *object(const sema::Type *ty, Value *val) {
+        if (ty->kind == sema::Type::ARRAY)
+            val = builder->CreateExtractValue(val, 0);
+        else if (ty->kind == sema::Type::SLICE)
+            val = builder->CreateExtractValue(val, 3);
+        else if (ty->kind == sema::Type::IFACE)
+            val = builder->CreateExtractValue(val, 0);
+        return builder->CreateBitCast(val, builder->getInt8PtrTy());
+    }
+
+    // Call func on the object of val, for a union on the object of the
+    // variant it holds and for a record or a tuple on those of its
+    // fields.
+    void count(const char *func, const sema::Type *ty, Value *val) {
+        if (ty->kind == sema::Type::TUPLE) {
+            for (size_t i = 0; i < ty->elems.size(); i++)
+                if (counted(ty->elems[i]))
+                    count(func, ty->elems[i], builder->CreateExtractValue(val, i));
+            return;
+        }
+        if (ast::RecordDef *r = recordOf(ty)) {
+            ast::TypeList *fields = static_cast<ast::TypeList*>(r->decl_list);
+            for (size_t i = 0; i < fields->types.size(); i++)
+                if (counted(fields->types[i]->ty))
+                    count(func, fields->types[i]->ty, builder->CreateExtractValue(val, recordLayout(ty).slots[i]));
+            return;
+        }
+        if (ty->kind == sema::Type::ARRAY && counted(ty->base) && std::string(func) == "mamba_release") {
+            releaseArray(ty, val);
+            return;
+        }
+        if (unionOf(ty) == nullptr) {
+            builder->CreateCall(module->getFunction(func), object(ty, val));
+            return;
+        }
+        UnionLayout &L = layout(ty);
+        LLVMContext &ctx = builder->getContext();
+        Function *parent = builder->GetInsertBlock()->getParent();
+        for (size_t i = 0; i < L.payloads.size(); i++) {
+            if (L.payloads[i] == nullptr || !counted(L.payloads[i]))
+                continue;
+            BasicBlock *some = BasicBlock::Create(ctx, "count.some", parent);
+            BasicBlock *done = BasicBlock::Create(ctx, "count.done", parent);
+            builder->CreateCondBr(holds(ty, val, i), some, done);
+            builder->SetInsertPoint(some);
+            count(func, L.payloads[i], payload(ty, val, i));
+            builder->CreateBr(done);
+            builder->SetInsertPoint(done);
+        }
+    }
+
+    /*
+     * The elements of an array that hold references are released with
+     * the last reference to its buffer.
+     *
+     *     br (mamba_release_last(buf) != 0), %release.last, %release.done
+     * release.last:
+     *     br (len != 0), %release.elem, %release.free
+     * release.elem:
+     *     release a[i]
+     *     br (i + 1 u< len), %release.elem, %release.free
+     * release.free:
+     *     call @mamba_free(buf)
+     */
+    void releaseArray(const sema::Type *ty, Value *val) {
+        LLVMContext &ctx = builder->getContext();
+        Function *parent = builder->GetInsertBlock()->getParent();
+        BasicBlock *last = BasicBlock::Create(ctx, "release.last", parent);
+        BasicBlock *elem = BasicBlock::Create(ctx, "release.elem", parent);
+        BasicBlock *freed = BasicBlock::Create(ctx, "release.free", parent);
+        BasicBlock *done = BasicBlock::Create(ctx, "release.done", parent);
+
+        Value *obj = object(ty, val);
+        Value *is_last = builder->CreateCall(module->getFunction("mamba_release_last"), obj);
+        builder->CreateCondBr(builder->CreateICmpNE(is_last, builder->getInt32(0)), last, done);
+
+        builder->SetInsertPoint(last);
+        Value *len = builder->CreateExtractValue(val, 1, "len");
+        builder->CreateCondBr(builder->CreateICmpNE(len, builder->getInt64(0)), elem, freed);
+
+        builder->SetInsertPoint(elem);
+        PHINode *i = builder->CreatePHI(builder->getInt64Ty(), 2, "i");
+        i->addIncoming(builder->getInt64(0), last);
+        Expr A(ty, val->getType(), val);
+        release(ty->base, loadElement(&A, i));
+        Value *next = builder->CreateAdd(i, builder->getInt64(1), "i.next", true, true);
+        i->addIncoming(next, builder->GetInsertBlock());
+        builder->CreateCondBr(builder->CreateICmpULT(next, len), elem, freed);
+
+        builder->SetInsertPoint(freed);
+        builder->CreateCall(module->getFunction("mamba_free"), obj);
+        builder->CreateBr(done);
+        builder->SetInsertPoint(done);
+    }
+
+    void retain(const sema::Type *ty, Value *val) {
+        count("mamba_retain", ty, val);
+    }
+
+    void release(const sema::Type *ty, Value *val) {
+        count("mamba_release", ty, val);
+    }
+
+    // A reference to V the caller keeps.
+    Value *own(Expr *V) {
+        if (counted(V->ty) && !V->owned)
+            retain(V->ty, V->value);
+        return V->value;
+    }
+
+    // Done with V.
+    void drop(Expr *V) {
+        if (counted(V->ty) && V->owned)
+            release(V->ty, V->value);
+    }
+
+    // Copy V to a new heap object, which the result owns.
+    Expr *allocate(Expr *V) {
+        Function *func = module->getFunction("mamba_alloc");
+        Value *obj = builder->CreateCall(func, ::llvm::ConstantExpr::getSizeOf(V->type), "obj");
+        obj = builder->CreateBitCast(obj, V->type->getPointerTo());
+        builder->CreateStore(V->value, obj);
+        return new Expr(sema::Types::pointer(V->ty), obj->getType(), obj, true);
+    }
+
+    /*
+     * Offset of A[I] in the data of A, once I is checked against the
+     * length. A negative index wraps to a large unsigned one.
+     *
+     *     br (idx u< len), %bounds.ok, %bounds.fail
+     * bounds.fail:
+     *     call @mamba_bounds_fail(idx, len)      ; noreturn
+     *
+     * The bounds pass removes the checks it proves always pass.
+     */
+    Value *index(Expr *A, Expr *I) {
+        Value *idx = builder->CreateIntCast(I->value, builder->getInt64Ty(), typeIdSigned(I->id()), "idx");
+        Value *len = builder->CreateExtractValue(A->value, 1, "len");
+
+        LLVMContext &ctx = builder->getContext();
+        Function *func = builder->GetInsertBlock()->getParent();
+        BasicBlock *ok = BasicBlock::Create(ctx, "bounds.ok", func);
+        BasicBlock *fail = BasicBlock::Create(ctx, "bounds.fail", func);
+        builder->CreateCondBr(builder->CreateICmpULT(idx, len), ok, fail, ::llvm::MDBuilder(ctx).createBranchWeights(2000, 1));
+
+        builder->SetInsertPoint(fail);
+        builder->CreateCall2(module->getFunction("mamba_bounds_fail"), idx, len);
+        builder->CreateUnreachable();
+
+        builder->SetInsertPoint(ok);
+        if (A->ty->kind == sema::Type::SLICE)
+            idx = builder->CreateMul(idx, builder->CreateExtractValue(A->value, 2, "stride"));
+        return idx;
+    }
+
+    // V as a slice, an array is viewed whole. The view holds the
+    // reference V holds.
+    Expr *view(Expr *V) {
+        if (V->ty->kind == sema::Type::SLICE)
+            return V;
+        Value *data = builder->CreateExtractValue(V->value, 0, "data");
+        ::llvm::StructType *type = sliceType(data->getType()->getPointerElementType());
+        Value *val = ::llvm::UndefValue::get(type);
+        val = builder->CreateInsertValue(val, data, 0);
+        val = builder->CreateInsertValue(val, builder->CreateExtractValue(V->value, 1), 1);
+        val = builder->CreateInsertValue(val, builder->getInt64(1), 2);
+        val = builder->CreateInsertValue(val, builder->CreateBitCast(data, builder->getInt8PtrTy()), 3);
+        return new Expr(sema::Types::slice(V->ty->base), type, val, V->owned);
+    }
+
+    // A field or an element val of A, which outlives A.
+    Expr *part(Expr *A, const sema::Type *ty, Value *val) {
+        Expr *F = new Expr(ty, val->getType(), val);
+        if (A->owned && counted(ty)) {
+            retain(ty, val);
+            F->owned = true;
+        }
+        drop(A);
+        return F;
+    }
+
+    // Result of a call, which hands over a reference of its own.
+    void pushResult(const sema::Type *ty, Value *ret) {
+        if (!ret->getType()->isVoidTy())
+            stack.push(new Expr(ty, ret->getType(), ret, counted(ty)));
+    }
+
+    // Release the variables of every scope from depth up, innermost
+    // first, on a path leaving them.
+    void releaseScopes(size_t depth) {
+        for (size_t s = owners.size(); s-- > depth; )
+            for (auto it = owners[s].rbegin(); it != owners[s].rend(); ++it)
+                release((*it)->ty, builder->CreateLoad((*it)->value));
+    }
+
+    void emitBlock(ast::Node *body) {
+        pushScope();
+        body->accept(this);
+        if (!builder->GetInsertBlock()->getTerminator())
+            releaseScopes(env.size() - 1);
+        popScope();
+    }
+
+    void emitPrint(Expr *V) {
+        ::llvm::Type *void_ty = builder->getVoidTy();
+        Value *val = V->value;
+        Function *func;
+        switch (V->id()) {
+            case TY_BOOL:
+                func = runtime("mamba_print_bool", void_ty, builder->getInt32Ty(), (void *)&mamba_print_bool);
+                val = builder->CreateZExt(val, builder->getInt32Ty());
+                break;
+            case TY_INT32:
+                func = runtime("mamba_print_int", void_ty, builder->getInt32Ty(), (void *)&mamba_print_int);
+                break;
+            case TY_INT64:
+                func = runtime("mamba_print_int64", void_ty, builder->getInt64Ty(), (void *)&mamba_print_int64);
+                break;
+            case TY_FLOAT32:
+                func = runtime("mamba_print_float", void_ty, builder->getFloatTy(), (void *)&mamba_print_float);
+                break;
+            case TY_FLOAT64:
+                func = runtime("mamba_print_float64", void_ty, builder->getDoubleTy(), (void *)&mamba_print_float64);
+                break;
+            case TY_STR:
+                func = runtime("mamba_print_str", void_ty, builder->getInt8PtrTy(), (void *)&mamba_print_str);
+                break;
+            default:
+                error("cannot print " + V->ty->str());
+                return;
+        }
+        builder->CreateCall(func, val);
+    }
+
+    // The body runs between the push and pop of an arena scope, the
+    // checker made sure it takes and returns nothing.
+    void emitArena(ast::Variable *body) {
+        Function *func = module->getFunction(ast::Symbols::name(body->val));
+        if (func == nullptr) {
+            error("function not found!");
+            return;
+        }
+        builder->CreateCall(module->getFunction("mamba_arena_push"));
+        builder->CreateCall(func);
+        builder->CreateCall(module->getFunction("mamba_arena_pop"));
+    }
+
+    // Build a function into the module. The insertion point of the
+    // enclosing code is left untouched. Only the entry generate() builds
+    // is called from outside a module, other functions are internal, so
+    // units defining the same names, or lambdas, link together. Instances
+    // of generic functions are linkonce_odr instead, see emitInstance.
+    Function *emitFunction(const std::string &name, ast::Function *v, ::llvm::GlobalValue::LinkageTypes linkage = Function::InternalLinkage) {
+        ::llvm::FunctionType *fty = llfunctype(v->ty);
+        if (fty == nullptr)
+            return nullptr;
+
+        // a call or vtable further up may have declared it
+        Function *func = module->getFunction(name);
+        if (func && func->isDeclaration() && func->getFunctionType() == fty)
+            func->setLinkage(linkage);
+        else
+            func = Function::Create(fty, linkage, name, module.get());
+
+        IRBuilder<>::InsertPoint ip = builder->saveIP();
+        builder->SetInsertPoint(BasicBlock::Create(module->getContext(), "entry", func));
+        pushScope();
+        function_depths.push(env.size() - 1);
+
+        ast::TypeList *params = v->proto->params;
+        size_t i = 0;
+        auto arg = func->arg_begin();
+        if (sret(v->ty->base)) {
+            arg->setName("sret");
+            func->addAttribute(1, ::llvm::Attribute::StructRet);
+            func->addAttribute(1, ::llvm::Attribute::NoAlias);
+            sret_slots.push(arg++);
+        } else {
+            sret_slots.push(nullptr);
+        }
+        for (; arg != func->arg_end(); ++arg, ++i) {
+            const std::string &pname = ast::Symbols::name(params->names[i]);
+            arg->setName(pname);
+            ::llvm::AllocaInst *alloca = createAlloca(arg->getType(), pname);
+            Expr *var = new Expr(v->ty->elems[i], arg->getType(), alloca);
+            // arguments are borrowed, the parameter takes its own reference
+            builder->CreateStore(own(new Expr(var->ty, var->type, arg)), alloca);
+            addvar(params->names[i], var);
+            if (counted(var->ty))
+                owners.back().push_back(var);
+        }
+
+        v->body->accept(this);
+
+        if (!builder->GetInsertBlock()->getTerminator()) {
+            if (v->ty->base->kind == sema::Type::VOID) {
+                releaseScopes(function_depths.top());
+                builder->CreateRetVoid();
+            } else
+                builder->CreateUnreachable();
+        }
+
+        sret_slots.pop();
+        function_depths.pop();
+        popScope();
+        builder->restoreIP(ip);
+
+        ::llvm::verifyFunction(*func);
+        pass_manager->run(*func);
+        return func;
+    }
+
+    void pushScope() {
+        env.push_back(scope_t());
+        owners.push_back(std::vector<Expr*>());
+    }
+
+    void popScope() {
+        scope_t &scope = env.back();
+        for (auto it = scope.rbegin(); it != scope.rend(); ++it)
+            bindings[it->first] = it->second;
+        env.pop_back();
+        owners.pop_back();
     }
 
     virtual void visit(ast::True *v) {
-        stack.push(new Expr("Bool", builder->getInt1Ty(), builder->getTrue()));
+        stack.push(new Expr(v->ty, builder->getInt1Ty(), builder->getTrue()));
     }
 
     virtual void visit(ast::False *v) {
-        stack.push(new Expr("Bool", builder->getInt1Ty(), builder->getFalse()));
+        stack.push(new Expr(v->ty, builder->getInt1Ty(), builder->getFalse()));
 	}
 
+    // literals are emitted at the width the checker gave them
     virtual void visit(ast::Integer *v) {
-        stack.push(new Expr("Int", builder->getInt32Ty(), builder->getInt32(v->val)));
+        ::llvm::Type *type = lltype(v->ty);
+        stack.push(new Expr(v->ty, type, ::llvm::ConstantInt::get(type, v->val, true)));
 	}
 
     virtual void visit(ast::Real *v) {
-        stack.push(new Expr("Float", builder->getFloatTy(), ConstantFP::get(builder->getContext(), v->val)));
+        ::llvm::Type *type = lltype(v->ty);
+        stack.push(new Expr(v->ty, type, ConstantFP::get(type, v->val)));
 	}
 
     virtual void visit(ast::String *v) {
-        Value *gs = builder->CreateGlobalString(v->val.c_str(), "globalstring");
-        stack.push(new Expr("String", builder->getInt8PtrTy(), builder->CreateConstGEP2_32(gs, 0, 0, "cast")));
+        Value *gs = builder->CreateGlobalString(::llvm::StringRef(v->val.ptr, v->val.len), "globalstring");
+        stack.push(new Expr(v->ty, builder->getInt8PtrTy(), builder->CreateConstGEP2_32(gs, 0, 0, "cast")));
 	}
 
     virtual void visit(ast::Variable *v) {
-        Expr *L = getvar(*(v->val));
+        Expr *L = getvar(v->val);
         if (L != nullptr) {
-            Value *val = builder->CreateLoad(L->value, *(v->val));
-            stack.push(new Expr(L->type_name, L->type, val));
+            Value *val = builder->CreateLoad(L->value, ast::Symbols::name(v->val));
+            stack.push(new Expr(v->ty, L->type, val));
+        } else if (v->val < variants.size() && variants[v->val].first) {
+            stack.push(variant(v->ty, variants[v->val].second, nullptr));
         } else
-            error("variable " + *v->val + " not found!");
+            error("variable " + ast::Symbols::name(v->val) + " not found!");
 	}
 
     virtual void visit(ast::Declaration *v) {
@@ -122,10 +1247,13 @@ public:
         Expr *V = stack.top();
         stack.pop();
 
-        ::llvm::AllocaInst *alloca = builder->CreateAlloca(V->value->getType(), 0, v->name->c_str());
-        builder->CreateStore(V->value, alloca);
+        ::llvm::AllocaInst *alloca = createAlloca(V->value->getType(), ast::Symbols::name(v->name));
+        builder->CreateStore(own(V), alloca);
 
-        addvar(*(v->name), new Expr(V->type_name, V->type, alloca));
+        Expr *var = new Expr(V->ty, V->type, alloca);
+        addvar(v->name, var);
+        if (counted(var->ty))
+            owners.back().push_back(var);
 	}
 
     virtual void visit(ast::Assign *v) {
@@ -136,15 +1264,37 @@ public:
         stack.pop();
 
         for (auto &n : v->vars) {
-            n->accept(this);
-            assert(stack.size() >= 1);
-
-            Expr *L = stack.top();
-            stack.pop();
-
-            assert(L->type_name == R->type_name);
-            builder->CreateStore(R->value, L->value);
+            std::vector<Expr*> temps;
+            ast::Subscript *s = dynamic_cast<ast::Subscript*>(n);
+            if (s && soa(R->ty)) {
+                // no references in the elements of an array
+                s->var->accept(this);
+                s->idx->accept(this);
+                assert(stack.size() >= 2);
+
+                Expr *I = stack.top();
+                stack.pop();
+                Expr *A = stack.top();
+                stack.pop();
+                storeElement(A, index(A, I), R->value);
+                drop(A);
+                continue;
+            }
+            Value *slot = address(n, temps);
+
+            // every target takes a reference, the old value loses one
+            if (counted(R->ty)) {
+                retain(R->ty, R->value);
+                Value *old = builder->CreateLoad(slot);
+                builder->CreateStore(R->value, slot);
+                release(R->ty, old);
+            } else {
+                builder->CreateStore(R->value, slot);
+            }
+            for (auto T: temps)
+                drop(T);
         }
+        drop(R);
 	}
 
     virtual void visit(ast::Unary *v) {
@@ -154,12 +1304,9 @@ public:
         Expr *V = stack.top();
         stack.pop();
 
-        Env *env = Env::byname(V->type_name);
-        assert(env != nullptr);
-        assert(env->has_function(v->op, {V->type_name}));
-        Expr *result = env->apply_function(v->op, {V});
-        assert(result != nullptr);
-        stack.push(result);
+        OpTable::unary_t op = OpTable::unary(v->op, V->id());
+        assert(op != nullptr);
+        stack.push(op(*builder, V));
 	}
 
     virtual void visit(ast::Binary *v) {
@@ -172,159 +1319,431 @@ public:
         Expr *L = stack.top();
         stack.pop();
 
-        Env *env = Env::byname(R->type_name);
-        assert(env != NULL);
-        assert(env->has_function(v->op, {R->type_name, L->type_name}));
-        Expr *result = env->apply_function(v->op, {R, L});
-        assert(result != NULL);
-        stack.push(result);
+        OpTable::binary_t op = OpTable::binary(v->op, L->id(), R->id());
+        assert(op != nullptr);
+        stack.push(op(*builder, L, R));
 	}
 
+    /*
+     * The right side is only evaluated when the left one does not decide
+     * the result.
+     *
+     *         br l, %and.rhs, %and.end
+     * and.rhs:
+     *         br %and.end
+     * and.end:
+     *         phi [false, %entry], [r, %and.rhs]
+     */
     virtual void visit(ast::And *v) {
-        v->left->accept(this);
-        v->right->accept(this);
-        assert(stack.size() >= 2);
-
-        Expr *L = stack.top();
-        assert(L->type_name == "Bool");
-        stack.pop();
-
-        Expr *R = stack.top();
-        assert(R->type_name == "Bool");
-        stack.pop();
-
-        LLVMContext &ctx = builder->getContext();
-        Function *func = builder->GetInsertBlock()->getParent();
-        BasicBlock *and_lhs = builder->GetInsertBlock();
-        BasicBlock *and_rhs = BasicBlock::Create(ctx, "and_rhs", func);
-        BasicBlock *and_end = BasicBlock::Create(ctx, "and_end");
-
-        builder->SetInsertPoint(and_lhs);
-        builder->CreateCondBr(L->value, and_rhs, and_end);
-
-        builder->SetInsertPoint(and_rhs);
-        builder->CreateBr(and_end);
-
-        builder->SetInsertPoint(and_end);
-        PHINode *node = builder->CreatePHI(builder->getInt1Ty(), 2, "and_tmp");
-        node->addIncoming(L->value, and_lhs);
-        node->addIncoming(R->value, and_rhs);
-        stack.push(new Expr("Bool", node));
+        emitLogic(v->left, v->right, true);
 	}
 
     virtual void visit(ast::Or *v) {
-        v->left->accept(this);
-        v->right->accept(this);
-        assert(stack.size() >= 2);
+        emitLogic(v->left, v->right, false);
+	}
 
-        Expr *L = stack.top();
-        assert(L->type_name == "Bool");
-        stack.pop();
+    void emitLogic(ast::Node *left, ast::Node *right, bool is_and) {
+        left->accept(this);
+        assert(stack.size() >= 1);
 
-        Expr *R = stack.top();
-        assert(R->type_name == "Bool");
+        Expr *L = stack.top();
+        assert(L->ty->is(TY_BOOL));
         stack.pop();
 
         LLVMContext &ctx = builder->getContext();
         Function *func = builder->GetInsertBlock()->getParent();
-        BasicBlock *or_lhs = builder->GetInsertBlock();
-        BasicBlock *or_rhs = BasicBlock::Create(ctx, "or_rhs", func);
-        BasicBlock *or_end = BasicBlock::Create(ctx, "or_end", func);
-
-        builder->SetInsertPoint(or_lhs);
-        builder->CreateCondBr(L->value, or_end, or_rhs);
-
-        builder->SetInsertPoint(or_rhs);
-        builder->CreateBr(or_end);
+        const char *name = is_and ? "and" : "or";
+        BasicBlock *lhs = builder->GetInsertBlock();
+        BasicBlock *rhs = BasicBlock::Create(ctx, std::string(name) + ".rhs", func);
+        BasicBlock *end = BasicBlock::Create(ctx, std::string(name) + ".end", func);
+        if (is_and)
+            builder->CreateCondBr(L->value, rhs, end);
+        else
+            builder->CreateCondBr(L->value, end, rhs);
+
+        builder->SetInsertPoint(rhs);
+        right->accept(this);
+        assert(stack.size() >= 1);
 
-        builder->SetInsertPoint(or_end);
-        PHINode *node = builder->CreatePHI(builder->getInt1Ty(), 2, "or_tmp");
-        node->addIncoming(L->value, or_lhs);
-        node->addIncoming(R->value, or_rhs);
-        stack.push(new Expr("Bool", node));
-	}
+        Expr *R = stack.top();
+        assert(R->ty->is(TY_BOOL));
+        stack.pop();
+        // the right side may have ended in another block
+        rhs = builder->GetInsertBlock();
+        builder->CreateBr(end);
+
+        builder->SetInsertPoint(end);
+        PHINode *node = builder->CreatePHI(builder->getInt1Ty(), 2, name);
+        node->addIncoming(is_and ? builder->getFalse() : builder->getTrue(), lhs);
+        node->addIncoming(R->value, rhs);
+        stack.push(new Expr(L->ty, builder->getInt1Ty(), node));
+    }
 
+    // A branch that returns, breaks or continues does not fall through
+    // to if.end.
     virtual void visit(ast::IfElse *v) {
         v->expr->accept(this);
         assert(stack.size() >= 1);
 
         Expr *cond = stack.top();
-        assert(cond->type_name == "Bool");
+        assert(cond->ty->is(TY_BOOL));
         stack.pop();
 
         LLVMContext &ctx = builder->getContext();
         Function *func = builder->GetInsertBlock()->getParent();
-        if (v->ifelse) {
-            BasicBlock *if_true = BasicBlock::Create(ctx, "if_true", func);
-            BasicBlock *if_false = BasicBlock::Create(ctx, "if_false", func);
-            BasicBlock *if_end = BasicBlock::Create(ctx, "if_end", func);
-            builder->CreateCondBr(cond->value, if_true, if_false);
-
-            builder->SetInsertPoint(if_true);
-            v->body->accept(this);
+        BasicBlock *if_true = BasicBlock::Create(ctx, "if.true", func);
+        BasicBlock *if_false = v->ifelse ? BasicBlock::Create(ctx, "if.false", func) : nullptr;
+        BasicBlock *if_end = BasicBlock::Create(ctx, "if.end", func);
+        builder->CreateCondBr(cond->value, if_true, if_false ? if_false : if_end);
+
+        builder->SetInsertPoint(if_true);
+        emitBlock(v->body);
+        if (!builder->GetInsertBlock()->getTerminator())
             builder->CreateBr(if_end);
 
+        if (if_false) {
             builder->SetInsertPoint(if_false);
-            v->ifelse->accept(this);
-            builder->CreateBr(if_end);
+            emitBlock(v->ifelse);
+            if (!builder->GetInsertBlock()->getTerminator())
+                builder->CreateBr(if_end);
+        }
 
-            builder->SetInsertPoint(if_end);
-        } else {
-            BasicBlock *if_true = BasicBlock::Create(ctx, "if_true", func);
-            BasicBlock *if_end = BasicBlock::Create(ctx, "if_end", func);
-            builder->CreateCondBr(cond->value, if_true, if_end);
+        builder->SetInsertPoint(if_end);
+	}
 
-            builder->SetInsertPoint(if_true);
-            v->body->accept(this);
-            builder->CreateBr(if_end);
+    // The body of a loop, which continues at next and breaks to end.
+    void emitLoopBody(ast::Node *body, BasicBlock *next, BasicBlock *end) {
+        continue_blocks.push(next);
+        break_blocks.push(end);
+        loop_depths.push(env.size());
+        emitBlock(body);
+        if (!builder->GetInsertBlock()->getTerminator())
+            builder->CreateBr(next);
+        continue_blocks.pop();
+        break_blocks.pop();
+        loop_depths.pop();
+    }
 
-            builder->SetInsertPoint(if_end);
+    // The body of a for loop whose variable x lives for one trip: the
+    // reference it holds is released before the next trip, or by a
+    // break or a return.
+    void emitTrip(ast::Node *body, Expr *x, BasicBlock *next, BasicBlock *end) {
+        continue_blocks.push(next);
+        break_blocks.push(end);
+        loop_depths.push(env.size());
+        pushScope();
+        if (counted(x->ty))
+            owners.back().push_back(x);
+        emitBlock(body);
+        if (!builder->GetInsertBlock()->getTerminator()) {
+            releaseScopes(env.size() - 1);
+            builder->CreateBr(next);
         }
-	}
+        popScope();
+        continue_blocks.pop();
+        break_blocks.pop();
+        loop_depths.pop();
+    }
 
-    virtual void visit(ast::While *v) {
-        v->expr->accept(this);
+    // Branch on the condition of a while loop, emitted at the guard and
+    // at the latch.
+    void emitWhileTest(ast::Node *expr, BasicBlock *body, BasicBlock *end) {
+        expr->accept(this);
         assert(stack.size() >= 1);
 
         Expr *cond = stack.top();
-        assert(cond->type_name == "Bool");
+        assert(cond->ty->is(TY_BOOL));
         stack.pop();
+        builder->CreateCondBr(cond->value, body, end);
+    }
 
+    /*
+     * Loops are rotated: a guard before the loop and the test at its
+     * single latch, the only edge back to the header. This is the form
+     * the LLVM loop passes expect.
+     *
+     *              br cond, %while.body, %while.end
+     * while.body:  ...
+     * while.next:  br cond, %while.body, %while.end
+     */
+    virtual void visit(ast::While *v) {
         LLVMContext &ctx = builder->getContext();
         Function *func = builder->GetInsertBlock()->getParent();
-        BasicBlock *while_start = BasicBlock::Create(ctx, "while_start", func);
-        BasicBlock *while_body = BasicBlock::Create(ctx, "while_body", func);
-        BasicBlock *while_end = BasicBlock::Create(ctx, "while_end", func);
-
-        continue_blocks.push(while_start);
-        break_blocks.push(while_end);
-
-        builder->SetInsertPoint(while_start);
-        builder->CreateCondBr(cond->value, while_body, while_end);
+        BasicBlock *while_body = BasicBlock::Create(ctx, "while.body", func);
+        BasicBlock *while_next = BasicBlock::Create(ctx, "while.next", func);
+        BasicBlock *while_end = BasicBlock::Create(ctx, "while.end", func);
+        emitWhileTest(v->expr, while_body, while_end);
 
         builder->SetInsertPoint(while_body);
-        v->body->accept(this);
-        builder->CreateBr(while_start);
+        emitLoopBody(v->body, while_next, while_end);
+
+        builder->SetInsertPoint(while_next);
+        emitWhileTest(v->expr, while_body, while_end);
 
         builder->SetInsertPoint(while_end);
-        continue_blocks.pop();
-        break_blocks.pop();
 	}
 
     virtual void visit(ast::Break *v) {
         assert(break_blocks.size() > 0);
-        builder->CreateBr(break_block.top());
+        releaseScopes(loop_depths.top());
+        builder->CreateBr(break_blocks.top());
 	}
 
     virtual void visit(ast::Continue *v) {
         assert(continue_blocks.size() > 0);
-        builder->CreateBr(break_block.top());
+        releaseScopes(loop_depths.top());
+        builder->CreateBr(continue_blocks.top());
 	}
 
+    /*
+     * for x in a walks the buffer of a, which the loop holds a reference
+     * to, with a canonical induction variable: from 0 by 1, tested at
+     * the latch. The index never leaves the bounds, so elements are
+     * loaded without checks.
+     *
+     *            br (len != 0), %for.body, %for.end
+     * for.body:  x = data[i]            ; data[i*stride] for a slice
+     *            ...
+     * for.next:  i = i + 1
+     *            br (i u< len), %for.body, %for.end
+     */
     virtual void visit(ast::For *v) {
+        if (v->walk == ast::For::RANGE) {
+            emitRange(v);
+            return;
+        }
+        if (v->walk != ast::For::SEQUENCE) {
+            emitIteration(v);
+            return;
+        }
+
+        v->iterable->accept(this);
+        assert(stack.size() >= 1);
+
+        Expr *A = stack.top();
+        stack.pop();
+
+        pushScope();
+        ::llvm::AllocaInst *iter = createAlloca(A->type, "iter");
+        builder->CreateStore(own(A), iter);
+        owners.back().push_back(new Expr(A->ty, A->type, iter));
+
+        Value *len = builder->CreateExtractValue(A->value, 1, "len");
+        Value *stride = A->ty->kind == sema::Type::SLICE ? builder->CreateExtractValue(A->value, 2, "stride") : nullptr;
+        ::llvm::AllocaInst *counter = createAlloca(builder->getInt64Ty(), "i");
+        builder->CreateStore(builder->getInt64(0), counter);
+        ::llvm::Type *elem = lltype(A->ty->base);
+        ::llvm::AllocaInst *var = createAlloca(elem, ast::Symbols::name(v->vname));
+        addvar(v->vname, new Expr(A->ty->base, elem, var));
+
+        LLVMContext &ctx = builder->getContext();
+        Function *func = builder->GetInsertBlock()->getParent();
+        BasicBlock *for_body = BasicBlock::Create(ctx, "for.body", func);
+        BasicBlock *for_next = BasicBlock::Create(ctx, "for.next", func);
+        BasicBlock *for_end = BasicBlock::Create(ctx, "for.end", func);
+        builder->CreateCondBr(builder->CreateICmpNE(len, builder->getInt64(0)), for_body, for_end);
+
+        builder->SetInsertPoint(for_body);
+        Value *i = builder->CreateLoad(counter, "i");
+        Value *offset = stride ? builder->CreateMul(i, stride) : i;
+        Value *val = loadElement(A, offset);
+        builder->CreateStore(val, var);
+        // the body may replace the element, x keeps its own reference
+        if (counted(A->ty->base)) {
+            retain(A->ty->base, val);
+            emitTrip(v->body, getvar(v->vname), for_next, for_end);
+        } else {
+            emitLoopBody(v->body, for_next, for_end);
+        }
+
+        builder->SetInsertPoint(for_next);
+        Value *next = builder->CreateNUWAdd(builder->CreateLoad(counter), builder->getInt64(1), "i.next");
+        builder->CreateStore(next, counter);
+        builder->CreateCondBr(builder->CreateICmpULT(next, len), for_body, for_end);
+
+        builder->SetInsertPoint(for_end);
+        releaseScopes(env.size() - 1);
+        popScope();
 	}
 
+    /*
+     * for x in range(a, b, step) builds no range, x counts from a to b.
+     * A step of one, the common case, makes x the induction variable of
+     * the loop, which never wraps as it stays below b:
+     *
+     *            br (a < b), %for.body, %for.end
+     * for.body:  ...
+     * for.next:  x = x + 1
+     *            br (x < b), %for.body, %for.end
+     *
+     * Any other step, known or not, counts the trips instead, so that
+     * x + step overflowing past b cannot run the loop again:
+     *
+     *            n = (|b - a| - 1)/|step| + 1
+     *            br (a < b going up, a > b down), %for.body, %for.end
+     * for.body:  ...
+     * for.next:  x = x + step
+     *            k = k + 1
+     *            br (k u< n), %for.body, %for.end
+     */
+    void emitRange(ast::For *v) {
+        ast::Call *call = static_cast<ast::Call*>(v->iterable);
+        ::llvm::Type *type = lltype(v->elem);
+        bool sign = typeIdSigned(v->elem->id);
+        std::vector<Value*> args;
+        for (auto &n: call->params->items) {
+            n->accept(this);
+            assert(stack.size() >= 1);
+
+            Expr *B = stack.top();
+            stack.pop();
+            args.push_back(B->value);
+        }
+        Value *lo = args.size() > 1 ? args[0] : ::llvm::ConstantInt::get(type, 0);
+        Value *hi = args.size() > 1 ? args[1] : args[0];
+        Value *step = args.size() > 2 ? args[2] : ::llvm::ConstantInt::get(type, 1);
+
+        pushScope();
+        ::llvm::AllocaInst *var = createAlloca(type, ast::Symbols::name(v->vname));
+        builder->CreateStore(lo, var);
+        addvar(v->vname, new Expr(v->elem, type, var));
+
+        LLVMContext &ctx = builder->getContext();
+        Function *func = builder->GetInsertBlock()->getParent();
+        BasicBlock *for_body = BasicBlock::Create(ctx, "for.body", func);
+        BasicBlock *for_next = BasicBlock::Create(ctx, "for.next", func);
+        BasicBlock *for_end = BasicBlock::Create(ctx, "for.end", func);
+
+        ::llvm::ConstantInt *unit = ::llvm::dyn_cast< ::llvm::ConstantInt>(step);
+        if (unit && unit->isOne()) {
+            builder->CreateCondBr(sign ? builder->CreateICmpSLT(lo, hi) : builder->CreateICmpULT(lo, hi), for_body, for_end);
+
+            builder->SetInsertPoint(for_body);
+            emitLoopBody(v->body, for_next, for_end);
+
+            builder->SetInsertPoint(for_next);
+            Value *x = builder->CreateLoad(var);
+            Value *next = sign ? builder->CreateNSWAdd(x, unit, "x.next") : builder->CreateNUWAdd(x, unit, "x.next");
+            builder->CreateStore(next, var);
+            builder->CreateCondBr(sign ? builder->CreateICmpSLT(next, hi) : builder->CreateICmpULT(next, hi), for_body, for_end);
+        } else {
+            Value *zero = ::llvm::ConstantInt::get(type, 0), *one = ::llvm::ConstantInt::get(type, 1);
+            // a constant step may still fold to zero, the checker only
+            // rejects a literal one
+            if (unit == nullptr || unit->isZero()) {
+                BasicBlock *ok = BasicBlock::Create(ctx, "range.ok", func, for_body);
+                BasicBlock *fail = BasicBlock::Create(ctx, "range.fail", func, for_body);
+                builder->CreateCondBr(builder->CreateICmpNE(step, zero), ok, fail, ::llvm::MDBuilder(ctx).createBranchWeights(2000, 1));
+
+                builder->SetInsertPoint(fail);
+                builder->CreateCall(module->getFunction("mamba_panic"), builder->CreateGlobalStringPtr("range step is zero"));
+                builder->CreateUnreachable();
+                builder->SetInsertPoint(ok);
+            }
+
+            Value *up = sign ? builder->CreateICmpSGT(step, zero) : builder->getTrue();
+            Value *dist = builder->CreateSelect(up, builder->CreateSub(hi, lo), builder->CreateSub(lo, hi));
+            Value *stride = builder->CreateSelect(up, step, builder->CreateNeg(step));
+            Value *count = builder->CreateAdd(builder->CreateUDiv(builder->CreateSub(dist, one), stride), one, "count");
+            Value *lt = sign ? builder->CreateICmpSLT(lo, hi) : builder->CreateICmpULT(lo, hi);
+            Value *gt = sign ? builder->CreateICmpSGT(lo, hi) : builder->CreateICmpUGT(lo, hi);
+            ::llvm::AllocaInst *counter = createAlloca(type, "k");
+            builder->CreateStore(zero, counter);
+            builder->CreateCondBr(builder->CreateSelect(up, lt, gt), for_body, for_end);
+
+            builder->SetInsertPoint(for_body);
+            emitLoopBody(v->body, for_next, for_end);
+
+            builder->SetInsertPoint(for_next);
+            builder->CreateStore(builder->CreateAdd(builder->CreateLoad(var), step, "x.next"), var);
+            Value *k = builder->CreateNUWAdd(builder->CreateLoad(counter), one, "k.next");
+            builder->CreateStore(k, counter);
+            builder->CreateCondBr(builder->CreateICmpULT(k, count), for_body, for_end);
+        }
+
+        builder->SetInsertPoint(for_end);
+        popScope();
+    }
+
+    // The payload of r, the union an iterator returns, in slot, or
+    // false when r is the variant without one.
+    Value *emitNext(ast::For *v, Function *next, Value *it, Value *slot, size_t some) {
+        std::vector<Value*> args(1, it);
+        Value *r = emitCall(next, v->next->base, args);
+        builder->CreateStore(r, slot);
+        return holds(v->next->base, r, some);
+    }
+
+    /*
+     * for x in it calls I.next on the iterator *I until it returns the
+     * variant without a payload, after T.iter turns an iterable T into
+     * one. The type of the iterator is known, so next is called directly
+     * and hinted for inlining, which folds it into the loop. x takes the
+     * reference in the payload.
+     *
+     *            it = T.iter(v)                 ; for an iterable
+     *            br (I.next(it) holds Some), %for.body, %for.end
+     * for.body:  x = payload
+     *            ...
+     * for.next:  br (I.next(it) holds Some), %for.body, %for.end
+     */
+    void emitIteration(ast::For *v) {
+        v->iterable->accept(this);
+        assert(stack.size() >= 1);
+
+        Expr *A = stack.top();
+        stack.pop();
+
+        const sema::Type *it_ty = v->iter ? v->iter->base : v->iterable->ty;
+        // the iterator may come from another unit, its signature is known
+        Function *iter = v->iter ? declare(v->iterable->ty->str() + ".iter", v->iter) : nullptr;
+        Function *next = declare(it_ty->base->str() + ".next", v->next);
+        next->addFnAttr(::llvm::Attribute::InlineHint);
+
+        Expr *I = A;
+        if (iter) {
+            std::vector<Value*> args(1, A->value);
+            I = new Expr(it_ty, lltype(it_ty), emitCall(iter, it_ty, args), true);
+            drop(A);
+        }
+
+        pushScope();
+        ::llvm::AllocaInst *it = createAlloca(I->type, "it");
+        builder->CreateStore(own(I), it);
+        owners.back().push_back(new Expr(I->ty, I->type, it));
+
+        const sema::Type *u_ty = v->next->base;
+        UnionLayout &L = layout(u_ty);
+        size_t some = L.payloads[0] ? 0 : 1;
+        ::llvm::AllocaInst *slot = createAlloca(lltype(u_ty), "next");
+
+        LLVMContext &ctx = builder->getContext();
+        Function *func = builder->GetInsertBlock()->getParent();
+        BasicBlock *for_body = BasicBlock::Create(ctx, "for.body", func);
+        BasicBlock *for_next = BasicBlock::Create(ctx, "for.next", func);
+        BasicBlock *for_end = BasicBlock::Create(ctx, "for.end", func);
+        builder->CreateCondBr(emitNext(v, next, builder->CreateLoad(it), slot, some), for_body, for_end);
+
+        builder->SetInsertPoint(for_body);
+        Value *val = payload(u_ty, builder->CreateLoad(slot), some);
+        ::llvm::AllocaInst *var = createAlloca(val->getType(), ast::Symbols::name(v->vname));
+        builder->CreateStore(val, var);
+        Expr *x = new Expr(v->elem, val->getType(), var);
+        addvar(v->vname, x);
+        emitTrip(v->body, x, for_next, for_end);
+
+        builder->SetInsertPoint(for_next);
+        builder->CreateCondBr(emitNext(v, next, builder->CreateLoad(it), slot, some), for_body, for_end);
+
+        builder->SetInsertPoint(for_end);
+        releaseScopes(env.size() - 1);
+        popScope();
+    }
+
     virtual void visit(ast::Function *v) {
+        Function *func = emitFunction("lambda", v);
+        if (func)
+            stack.push(new Expr(v->ty, func->getType(), func));
 	}
 
     virtual void visit(ast::Return *v) {
@@ -335,49 +1754,243 @@ public:
             Expr *V = stack.top();
             stack.pop();
 
-            builder->CreateRet(V->value);
+            // the caller gets a reference of its own
+            Value *val = own(V);
+            releaseScopes(function_depths.top());
+            if (sret_slots.top()) {
+                builder->CreateStore(val, sret_slots.top());
+                builder->CreateRetVoid();
+            } else
+                builder->CreateRet(val);
         } else {
+            releaseScopes(function_depths.top());
             builder->CreateRetVoid();
         }
 	}
 
-    virtual void visit(ast::Call *v) {
-        // TODO: get function
-        // TODO: match arguments against function
+    // An instance of a generic function, declared if the call comes
+    // before the generic; visit(FuncDecl) then fills in the declaration.
+    // The mangled name of an instance stands for its body, linkonce_odr
+    // lets the linker keep one copy across units.
+    Function *emitInstance(ast::FuncDecl *v) {
+        const std::string &name = ast::Symbols::name(v->name);
+        if (Function *func = module->getFunction(name))
+            return func;
+        ::llvm::FunctionType *fty = llfunctype(v->func->ty);
+        return fty ? Function::Create(fty, Function::ExternalLinkage, name, module.get()) : nullptr;
+    }
+
+    // A call through an interface loads the method from the vtable,
+    // unless the Devirtualizer found the type behind the value. Methods
+    // of T are called on a *T with the value it points to.
+    void emitMethodCall(ast::Call *v, ast::Member *m) {
+        m->obj->accept(this);
+        assert(stack.size() >= 1);
+
+        Expr *O = stack.top();
+        stack.pop();
+
+        const std::string &name = ast::Symbols::name(m->name);
+        Expr *V = O;
+        if (O->ty->kind == sema::Type::POINTER)
+            V = new Expr(O->ty->base, O->type->getPointerElementType(), builder->CreateLoad(O->value));
+        if (name == "copyToHeap" || (name == "copyToStack" && V != O)) {
+            stack.push(name == "copyToHeap" ? allocate(V) : V);
+            drop(O);
+            return;
+        }
+
+        Value *callee;
         std::vector<Value*> arg_values;
+        if (V->ty->kind == sema::Type::IFACE) {
+            Value *obj = builder->CreateExtractValue(V->value, 0, "obj");
+            if (m->concrete) {
+                callee = method(m->concrete, m->name, m->ty);
+                obj = builder->CreateBitCast(obj, lltype(m->concrete)->getPointerTo());
+                arg_values.push_back(builder->CreateLoad(obj));
+            } else {
+                Value *vt = builder->CreateExtractValue(V->value, 1, "vtable");
+                callee = builder->CreateLoad(builder->CreateStructGEP(vt, m->slot), ast::Symbols::name(m->name));
+                arg_values.push_back(obj);
+            }
+        } else {
+            callee = method(V->ty, m->name, m->ty);
+            arg_values.push_back(V->value);
+        }
 
-        for (auto &n: v->params.childNodes) {
+        std::vector<Expr*> args;
+        emitArgs(v, arg_values, args);
+        Value *ret = emitCall(callee, v->ty, arg_values);
+        for (auto A: args)
+            drop(A);
+        drop(O);
+        pushResult(v->ty, ret);
+    }
+
+    // Arguments are borrowed by the callee, temporaries are released once
+    // it returns.
+    void emitArgs(ast::Call *v, std::vector<Value*> &arg_values, std::vector<Expr*> &args) {
+        for (auto &n: v->params->items) {
             n->accept(this);
             assert(stack.size() >= 1);
 
             Expr *V = stack.top();
             stack.pop();
-            arg_values.push_back(V->values);
+            arg_values.push_back(V->value);
+            args.push_back(V);
+        }
+    }
+
+    virtual void visit(ast::Call *v) {
+        if (ast::Member *m = dynamic_cast<ast::Member*>(v->parent)) {
+            emitMethodCall(v, m);
+            return;
+        }
+
+        ast::Variable *callee = dynamic_cast<ast::Variable*>(v->parent);
+        Function *callee_func;
+        if (v->instance)
+            callee_func = emitInstance(v->instance);
+        else
+            callee_func = callee ? module->getFunction(ast::Symbols::name(callee->val)) : nullptr;
+        if (callee_func == nullptr && callee && callee->val < records.size() && records[callee->val]) {
+            stack.push(construct(v, records[callee->val]));
+            return;
+        }
+        if (callee_func == nullptr && callee && callee->val < variants.size() && variants[callee->val].first) {
+            v->params->items[0]->accept(this);
+            assert(stack.size() >= 1);
+
+            Expr *P = stack.top();
+            stack.pop();
+            stack.push(variant(v->ty, variants[callee->val].second, P));
+            return;
+        }
+        if (callee_func == nullptr && callee && ast::Symbols::name(callee->val) == "print" && v->params->items.size() == 1) {
+            v->params->items[0]->accept(this);
+            assert(stack.size() >= 1);
+
+            Expr *V = stack.top();
+            stack.pop();
+            emitPrint(V);
+            return;
+        }
+        if (callee_func == nullptr && callee && ast::Symbols::name(callee->val) == "arena" && v->params->items.size() == 1) {
+            emitArena(static_cast<ast::Variable*>(v->params->items[0]));
+            return;
+        }
+        if (callee_func == nullptr) {
+            error("function not found!");
+            return;
         }
 
-        builder->CreateCall(callee_func, arg_values, "calltmp");
+        std::vector<Value*> arg_values;
+        std::vector<Expr*> args;
+        emitArgs(v, arg_values, args);
+        Value *ret = emitCall(callee_func, v->ty, arg_values);
+        for (auto A: args)
+            drop(A);
+        pushResult(v->ty, ret);
 	}
 
+    // An array literal gets a buffer of its own, aligned like every
+    // heap object.
     virtual void visit(ast::Array *v) {
+        std::vector<Expr*> elems;
+        for (auto &n: v->elems->items) {
+            n->accept(this);
+            assert(stack.size() >= 1);
+
+            elems.push_back(stack.top());
+            stack.pop();
+        }
+
+        ::llvm::Type *elem = elems[0]->type;
+        ::llvm::Constant *size = ::llvm::ConstantExpr::getMul(::llvm::ConstantExpr::getSizeOf(elem), builder->getInt64(elems.size()));
+        Value *data = builder->CreateCall(module->getFunction("mamba_alloc"), size, "array");
+        data = builder->CreateBitCast(data, elem->getPointerTo());
+
+        ::llvm::StructType *type = arrayType(elem);
+        Value *val = ::llvm::UndefValue::get(type);
+        val = builder->CreateInsertValue(val, data, 0);
+        val = builder->CreateInsertValue(val, builder->getInt64(elems.size()), 1);
+        Expr *A = new Expr(v->ty, type, val, true);
+        for (size_t i = 0; i < elems.size(); i++)
+            storeElement(A, builder->getInt64(i), own(elems[i]));
+        stack.push(A);
 	}
 
     virtual void visit(ast::Subscript *v) {
+        if (v->var->ty->kind == sema::Type::TUPLE) {
+            v->var->accept(this);
+            assert(stack.size() >= 1);
+
+            Expr *T = stack.top();
+            stack.pop();
+            unsigned i = static_cast<ast::Integer*>(v->idx)->val;
+            stack.push(part(T, v->ty, builder->CreateExtractValue(T->value, i)));
+            return;
+        }
+
+        v->var->accept(this);
+        v->idx->accept(this);
+        assert(stack.size() >= 2);
+
+        Expr *I = stack.top();
+        stack.pop();
+        Expr *A = stack.top();
+        stack.pop();
+
+        Value *val = loadElement(A, index(A, I));
+        stack.push(part(A, v->ty, val));
 	}
     virtual void visit(ast::Expr *v) {
+        size_t depth = stack.size();
+        v->e->accept(this);
+        while (stack.size() > depth) {
+            drop(stack.top());
+            stack.pop();
+        }
 	}
     virtual void visit(ast::FuncDecl *v) {
+        // instances are emitted where their generic function is declared,
+        // in its scope rather than that of a call
+        if (!v->generics)
+            emitFunction(ast::Symbols::name(v->name), static_cast<ast::Function*>(v->func));
+        for (auto inst: v->instances)
+            emitFunction(ast::Symbols::name(inst->name), static_cast<ast::Function*>(inst->func), Function::LinkOnceODRLinkage);
 	}
     virtual void visit(ast::UnionItem *v) {
 	}
     virtual void visit(ast::UnionList *v) {
 	}
     virtual void visit(ast::RecordDef *v) {
+        if (v->name >= records.size())
+            records.resize(ast::Symbols::size(), nullptr);
+        records[v->name] = v;
 	}
     virtual void visit(ast::UnionDef *v) {
+        if (v->name >= unions.size())
+            unions.resize(ast::Symbols::size(), nullptr);
+        unions[v->name] = v;
+        ast::UnionList *items = static_cast<ast::UnionList*>(v->type_list);
+        for (size_t i = 0; i < items->items.size(); i++) {
+            ast::symbol_t name = static_cast<ast::UnionItem*>(items->items[i])->name;
+            if (name >= variants.size())
+                variants.resize(ast::Symbols::size(), std::make_pair(nullptr, 0));
+            variants[name] = std::make_pair(v, i);
+        }
 	}
     virtual void visit(ast::ExprList *v) {
 	}
+    // Statements after a return, break or continue are never reached and
+    // not emitted.
     virtual void visit(ast::StmtList *v) {
+        for (auto &n: v->items) {
+            if (builder->GetInsertBlock()->getTerminator())
+                break;
+            n->accept(this);
+        }
 	}
     virtual void visit(ast::SimpleType *) { }
     virtual void visit(ast::RefType *) { }
@@ -386,4 +1999,278 @@ public:
     virtual void visit(ast::TupleType *) { }
     virtual void visit(ast::FuncType *) { }
     virtual void visit(ast::TypeList *) { }
+
+    virtual void visit(ast::IfaceDef *v) {
+        if (v->name >= ifaces.size())
+            ifaces.resize(ast::Symbols::size(), nullptr);
+        ifaces[v->name] = v;
+    }
+
+    virtual void visit(ast::Cast *v) {
+        v->expr->accept(this);
+        assert(stack.size() >= 1);
+
+        Expr *V = stack.top();
+        stack.pop();
+
+        if (V->ty == v->ty) {
+            stack.push(V);
+        } else if (v->ty->kind == sema::Type::IFACE) {
+            stack.push(box(V, v->ty));
+        } else if (v->ty->kind == sema::Type::SLICE) {
+            stack.push(view(V));
+        } else if (v->ty->is(TY_BOOL)) {
+            Value *zero = ::llvm::Constant::getNullValue(V->type);
+            Value *val = V->type->isFloatingPointTy() ? builder->CreateFCmpUNE(V->value, zero) : builder->CreateICmpNE(V->value, zero);
+            stack.push(new Expr(v->ty, builder->getInt1Ty(), val));
+        } else {
+            ::llvm::Type *to = lltype(v->ty);
+            ::llvm::Instruction::CastOps op = ::llvm::CastInst::getCastOpcode(V->value, typeIdSigned(V->id()), to, typeIdSigned(v->ty->id));
+            stack.push(new Expr(v->ty, to, builder->CreateCast(op, V->value, to)));
+        }
+    }
+
+    // A field, read through the pointer for a *Record, or a.length of
+    // an array or a slice. Methods are emitted by emitMethodCall.
+    virtual void visit(ast::Member *v) {
+        ast::Subscript *s = dynamic_cast<ast::Subscript*>(v->obj);
+        if (v->field >= 0 && s && soa(v->obj->ty)) {
+            // only the array of the field is read
+            std::vector<Expr*> temps;
+            Value *val = builder->CreateLoad(address(v, temps), ast::Symbols::name(v->name));
+            for (auto T: temps)
+                drop(T);
+            stack.push(new Expr(v->ty, val->getType(), val));
+            return;
+        }
+
+        v->obj->accept(this);
+        assert(stack.size() >= 1);
+
+        Expr *A = stack.top();
+        stack.pop();
+
+        if (v->field >= 0) {
+            Value *val;
+            if (A->ty->kind == sema::Type::POINTER) {
+                unsigned slot = recordLayout(A->ty->base).slots[v->field];
+                val = builder->CreateLoad(builder->CreateStructGEP(A->value, slot), ast::Symbols::name(v->name));
+            } else {
+                val = builder->CreateExtractValue(A->value, recordLayout(A->ty).slots[v->field], ast::Symbols::name(v->name));
+            }
+            stack.push(part(A, v->ty, val));
+            return;
+        }
+
+        Value *len = builder->CreateTrunc(builder->CreateExtractValue(A->value, 1), builder->getInt32Ty(), "length");
+        drop(A);
+        stack.push(new Expr(v->ty, len->getType(), len));
+    }
+
+    virtual void visit(ast::New *v) {
+        v->expr->accept(this);
+        assert(stack.size() >= 1);
+
+        Expr *V = stack.top();
+        stack.pop();
+        stack.push(allocate(V));
+    }
+
+    /*
+     * A[lo:hi:step], with 0 <= lo <= hi <= length and step > 0. Omitted
+     * bounds are 0, the length and 1.
+     *
+     *     br (lo u<= hi & hi u<= len & step s> 0), %slice.ok, %slice.fail
+     * slice.fail:
+     *     call @mamba_slice_fail(lo, hi, step, len)     ; noreturn
+     * slice.ok:
+     *     {ptr + lo*stride, (hi - lo + step - 1) u/ step, stride*step, buf}
+     */
+    virtual void visit(ast::Slice *v) {
+        v->var->accept(this);
+        assert(stack.size() >= 1);
+
+        Expr *A = view(stack.top());
+        stack.pop();
+
+        Value *len = builder->CreateExtractValue(A->value, 1, "len");
+        Value *bounds[3] = { builder->getInt64(0), len, builder->getInt64(1) };
+        ast::Node *nodes[3] = { v->lo, v->hi, v->step };
+        for (int i = 0; i < 3; i++) {
+            if (nodes[i] == nullptr)
+                continue;
+            nodes[i]->accept(this);
+            assert(stack.size() >= 1);
+
+            Expr *B = stack.top();
+            stack.pop();
+            bounds[i] = builder->CreateIntCast(B->value, builder->getInt64Ty(), typeIdSigned(B->id()));
+        }
+        Value *lo = bounds[0], *hi = bounds[1], *step = bounds[2];
+
+        LLVMContext &ctx = builder->getContext();
+        Function *func = builder->GetInsertBlock()->getParent();
+        BasicBlock *ok = BasicBlock::Create(ctx, "slice.ok", func);
+        BasicBlock *fail = BasicBlock::Create(ctx, "slice.fail", func);
+        Value *valid = builder->CreateAnd(builder->CreateICmpULE(lo, hi), builder->CreateICmpULE(hi, len));
+        valid = builder->CreateAnd(valid, builder->CreateICmpSGT(step, builder->getInt64(0)));
+        builder->CreateCondBr(valid, ok, fail, ::llvm::MDBuilder(ctx).createBranchWeights(2000, 1));
+
+        builder->SetInsertPoint(fail);
+        Value *args[] = { lo, hi, step, len };
+        builder->CreateCall(module->getFunction("mamba_slice_fail"), args);
+        builder->CreateUnreachable();
+
+        builder->SetInsertPoint(ok);
+        Value *stride = builder->CreateExtractValue(A->value, 2, "stride");
+        Value *data = builder->CreateGEP(builder->CreateExtractValue(A->value, 0), builder->CreateMul(lo, stride), "data");
+        Value *count = builder->CreateUDiv(builder->CreateAdd(builder->CreateSub(hi, lo), builder->CreateSub(step, builder->getInt64(1))), step, "count");
+        Value *val = builder->CreateInsertValue(A->value, data, 0);
+        val = builder->CreateInsertValue(val, count, 1);
+        val = builder->CreateInsertValue(val, builder->CreateMul(stride, step), 2);
+        // the view takes over the reference A holds, if any
+        stack.push(new Expr(v->ty, A->type, val, A->owned));
+    }
+
+    virtual void visit(ast::SliceType *) { }
+    virtual void visit(ast::GenericType *) { }
+
+    /*
+     * A switch on the discriminant of the union, so matching a
+     * Maybe{*T} is a null check. The payload of POINTER and BOOL unions
+     * takes the default, with every other variant as a case.
+     *
+     *     switch tag, %match.<default> [ case(i), %match.<variant i> ... ]
+     * match.Some:
+     *     x = payload
+     *     ...
+     *     br %match.end
+     */
+    virtual void visit(ast::Match *v) {
+        v->expr->accept(this);
+        assert(stack.size() >= 1);
+
+        Expr *U = stack.top();
+        stack.pop();
+
+        // a temporary lives until the match ends
+        pushScope();
+        if (counted(U->ty) && U->owned) {
+            ::llvm::AllocaInst *subject = createAlloca(U->type, "match");
+            builder->CreateStore(U->value, subject);
+            owners.back().push_back(new Expr(U->ty, U->type, subject));
+        }
+
+        UnionLayout &L = layout(U->ty);
+        LLVMContext &ctx = builder->getContext();
+        Function *func = builder->GetInsertBlock()->getParent();
+        BasicBlock *match_end = BasicBlock::Create(ctx, "match.end", func);
+        std::vector<BasicBlock*> blocks(L.cases.size(), nullptr);
+        BasicBlock *other = match_end;
+        std::vector<BasicBlock*> arm_blocks;
+        for (auto n: v->arms->items) {
+            ast::MatchArm *arm = static_cast<ast::MatchArm*>(n);
+            std::string name = arm->name == ast::Symbols::EMPTY ? "else" : ast::Symbols::name(arm->name);
+            arm_blocks.push_back(BasicBlock::Create(ctx, "match." + name, func, match_end));
+            if (arm->name == ast::Symbols::EMPTY)
+                other = arm_blocks.back();
+            else
+                blocks[variants[arm->name].second] = arm_blocks.back();
+        }
+
+        BasicBlock *fallback = other;
+        for (size_t i = 0; i < L.cases.size(); i++)
+            if (L.cases[i] == nullptr)
+                fallback = blocks[i] ? blocks[i] : other;
+        ::llvm::SwitchInst *sw = builder->CreateSwitch(discriminant(U->ty, U->value), fallback, L.cases.size());
+        for (size_t i = 0; i < L.cases.size(); i++) {
+            BasicBlock *target = blocks[i] ? blocks[i] : other;
+            if (L.cases[i] && target != fallback)
+                sw->addCase(L.cases[i], target);
+        }
+
+        for (size_t a = 0; a < arm_blocks.size(); a++) {
+            ast::MatchArm *arm = static_cast<ast::MatchArm*>(v->arms->items[a]);
+            builder->SetInsertPoint(arm_blocks[a]);
+            pushScope();
+            if (arm->var != ast::Symbols::EMPTY) {
+                size_t i = variants[arm->name].second;
+                Value *val = payload(U->ty, U->value, i);
+                ::llvm::AllocaInst *alloca = createAlloca(val->getType(), ast::Symbols::name(arm->var));
+                Expr *var = new Expr(L.payloads[i], val->getType(), alloca);
+                builder->CreateStore(own(new Expr(var->ty, var->type, val)), alloca);
+                addvar(arm->var, var);
+                if (counted(var->ty))
+                    owners.back().push_back(var);
+            }
+            emitBlock(arm->body);
+            if (!builder->GetInsertBlock()->getTerminator()) {
+                releaseScopes(env.size() - 1);
+                builder->CreateBr(match_end);
+            }
+            popScope();
+        }
+
+        builder->SetInsertPoint(match_end);
+        releaseScopes(env.size() - 1);
+        popScope();
+    }
+
+    // emitted by visit(ast::Match)
+    virtual void visit(ast::MatchArm *) { }
+
+    // the constructor places the value by name
+    virtual void visit(ast::NamedArg *v) {
+        v->expr->accept(this);
+    }
+
+    // A first class aggregate, which takes a reference to every element.
+    virtual void visit(ast::Tuple *v) {
+        ::llvm::Type *type = lltype(v->ty);
+        Value *val = ::llvm::UndefValue::get(type);
+        for (size_t i = 0; i < v->elems->items.size(); i++) {
+            v->elems->items[i]->accept(this);
+            assert(stack.size() >= 1);
+
+            Expr *E = stack.top();
+            stack.pop();
+            val = builder->CreateInsertValue(val, own(E), i);
+        }
+        stack.push(new Expr(v->ty, type, val, counted(v->ty)));
+    }
+
+    /*
+     * Every variable gets an element of the value straight from the
+     * aggregate, a call returning in registers is never stored whole.
+     * The references an owned value holds move to the variables.
+     */
+    virtual void visit(ast::Unpack *v) {
+        v->expr->accept(this);
+        assert(stack.size() >= 1);
+
+        Expr *V = stack.top();
+        stack.pop();
+
+        for (size_t i = 0; i < v->vars->names.size(); i++) {
+            const sema::Type *ty;
+            unsigned slot = i;
+            if (V->ty->kind == sema::Type::TUPLE) {
+                ty = V->ty->elems[i];
+            } else {
+                ty = static_cast<ast::TypeList*>(recordOf(V->ty)->decl_list)->types[i]->ty;
+                slot = recordLayout(V->ty).slots[i];
+            }
+            Value *val = builder->CreateExtractValue(V->value, slot);
+            const std::string &name = ast::Symbols::name(v->vars->names[i]);
+            ::llvm::AllocaInst *alloca = createAlloca(val->getType(), name);
+            builder->CreateStore(own(new Expr(ty, val->getType(), val, V->owned)), alloca);
+
+            Expr *var = new Expr(ty, val->getType(), alloca);
+            addvar(v->vars->names[i], var);
+            if (counted(ty))
+                owners.back().push_back(var);
+        }
+    }
 };
+
+#endif//__CODEGEN_H__
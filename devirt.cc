@@ -0,0 +1,326 @@
+#include "devirt.h"
+
+using sema::Type;
+using sema::Types;
+
+// Values of more than one type. Nothing can be cast to void, so it never
+// stands for a real type.
+static const Type *UNKNOWN() { return Types::voidType(); }
+
+// Whether copying a value of type t can share the buffer of an array.
+// Records and unions are not looked into.
+static bool shares(const Type *t) {
+    return t && (t->kind == Type::ARRAY || t->kind == Type::SLICE || t->kind == Type::TUPLE || t->kind == Type::NAMED);
+}
+
+static const Type *join(const Type *a, const Type *b) {
+    if (a == nullptr)
+        return b;
+    if (b == nullptr || a == b)
+        return a;
+    return UNKNOWN();
+}
+
+Devirtualizer::Devirtualizer(): changed(false), annotate(false), num_direct(0) { }
+
+ast::Node *Devirtualizer::lookup(ast::symbol_t name) {
+    return name < bindings.size() ? bindings[name] : nullptr;
+}
+
+void Devirtualizer::bind(ast::symbol_t name, ast::Node *def) {
+    if (name >= bindings.size())
+        bindings.resize(ast::Symbols::size(), nullptr);
+    env.back().push_back(std::make_pair(name, bindings[name]));
+    bindings[name] = def;
+}
+
+void Devirtualizer::pushScope() {
+    env.push_back(scope_t());
+}
+
+void Devirtualizer::popScope() {
+    scope_t &scope = env.back();
+    for (auto it = scope.rbegin(); it != scope.rend(); ++it)
+        bindings[it->first] = it->second;
+    env.pop_back();
+}
+
+void Devirtualizer::body(ast::Node *n) {
+    pushScope();
+    n->accept(this);
+    popScope();
+}
+
+// Type behind the interface values of an expression, nullptr when there
+// is none yet.
+const Type *Devirtualizer::concrete(ast::Node *e) {
+    if (ast::Cast *c = dynamic_cast<ast::Cast *>(e)) {
+        const Type *from = c->expr->ty;
+        if (c->ty && c->ty->kind == Type::IFACE && from && from->kind != Type::IFACE)
+            return from;
+        return concrete(c->expr);
+    }
+    if (ast::Variable *v = dynamic_cast<ast::Variable *>(e)) {
+        ast::Node *def = lookup(v->val);
+        if (def == nullptr)
+            return UNKNOWN();
+        auto it = facts.find(def);
+        return it != facts.end() ? it->second : nullptr;
+    }
+    if (ast::Array *a = dynamic_cast<ast::Array *>(e)) {
+        const Type *type = nullptr;
+        for (auto n: a->elems->items)
+            type = join(type, concrete(n));
+        return type;
+    }
+    if (ast::Subscript *s = dynamic_cast<ast::Subscript *>(e))
+        return concrete(s->var);
+    return UNKNOWN();
+}
+
+void Devirtualizer::store(ast::Node *def, const Type *type) {
+    if (def == nullptr || type == nullptr)
+        return;
+    auto it = facts.find(def);
+    const Type *old = it != facts.end() ? it->second : nullptr;
+    const Type *joined = join(old, type);
+    if (joined != old) {
+        facts[def] = joined;
+        changed = true;
+    }
+}
+
+// The elements of the array under e are shared with a view of it, or
+// with another variable, a callee or a field it is copied to.
+void Devirtualizer::alias(ast::Node *e) {
+    for (;;) {
+        if (ast::Subscript *s = dynamic_cast<ast::Subscript *>(e))
+            e = s->var;
+        else if (ast::Slice *s = dynamic_cast<ast::Slice *>(e))
+            e = s->var;
+        else if (ast::Cast *c = dynamic_cast<ast::Cast *>(e))
+            e = c->expr;
+        else if (ast::Member *m = dynamic_cast<ast::Member *>(e))
+            e = m->obj;
+        else if (ast::NamedArg *a = dynamic_cast<ast::NamedArg *>(e))
+            e = a->expr;
+        else
+            break;
+    }
+    if (ast::Variable *var = dynamic_cast<ast::Variable *>(e))
+        store(lookup(var->val), UNKNOWN());
+}
+
+void Devirtualizer::pass(ast::Node *root) {
+    bindings.clear();
+    env.clear();
+    pushScope();
+    root->accept(this);
+    popScope();
+}
+
+// A store can reach a use earlier in the tree through a loop, so facts
+// are propagated until they settle before any call is marked.
+void Devirtualizer::run(ast::Node *root) {
+    do {
+        changed = false;
+        pass(root);
+    } while (changed);
+
+    annotate = true;
+    pass(root);
+    annotate = false;
+}
+
+void Devirtualizer::visit(ast::Declaration *v) {
+    v->expr->accept(this);
+    if (shares(v->expr->ty))
+        alias(v->expr);
+    store(v, concrete(v->expr));
+    bind(v->name, v);
+}
+
+void Devirtualizer::visit(ast::Assign *v) {
+    v->expr->accept(this);
+    if (shares(v->expr->ty))
+        alias(v->expr);
+    const Type *type = concrete(v->expr);
+    for (auto n: v->vars) {
+        n->accept(this);
+        // a store to an element or a field is a store to the whole value
+        for (;;) {
+            if (ast::Subscript *s = dynamic_cast<ast::Subscript *>(n))
+                n = s->var;
+            else if (ast::Member *m = dynamic_cast<ast::Member *>(n))
+                n = m->obj;
+            else
+                break;
+        }
+        if (ast::Variable *var = dynamic_cast<ast::Variable *>(n))
+            store(lookup(var->val), type);
+    }
+}
+
+// A callee can store to the arrays it is passed, and a record or a
+// variant keeps them.
+void Devirtualizer::visit(ast::Call *v) {
+    v->parent->accept(this);
+    v->params->accept(this);
+    if (ast::Member *m = dynamic_cast<ast::Member *>(v->parent))
+        if (shares(m->obj->ty))
+            alias(m->obj);
+    for (auto n: v->params->items)
+        if (shares(n->ty))
+            alias(n);
+}
+
+void Devirtualizer::visit(ast::Return *v) {
+    if (v->e)
+        v->e->accept(this);
+}
+
+void Devirtualizer::visit(ast::Unary *v) {
+    v->down->accept(this);
+}
+
+void Devirtualizer::visit(ast::Binary *v) {
+    v->left->accept(this);
+    v->right->accept(this);
+}
+
+void Devirtualizer::visit(ast::And *v) {
+    v->left->accept(this);
+    v->right->accept(this);
+}
+
+void Devirtualizer::visit(ast::Or *v) {
+    v->left->accept(this);
+    v->right->accept(this);
+}
+
+void Devirtualizer::visit(ast::IfElse *v) {
+    v->expr->accept(this);
+    body(v->body);
+    if (v->ifelse)
+        body(v->ifelse);
+}
+
+void Devirtualizer::visit(ast::While *v) {
+    v->expr->accept(this);
+    body(v->body);
+}
+
+void Devirtualizer::visit(ast::For *v) {
+    v->iterable->accept(this);
+    store(v, concrete(v->iterable));
+    pushScope();
+    bind(v->vname, v);
+    body(v->body);
+    popScope();
+}
+
+void Devirtualizer::visit(ast::Array *v) {
+    v->elems->accept(this);
+}
+
+void Devirtualizer::visit(ast::Subscript *v) {
+    v->var->accept(this);
+    v->idx->accept(this);
+}
+
+void Devirtualizer::visit(ast::Expr *v) {
+    v->e->accept(this);
+}
+
+void Devirtualizer::visit(ast::Function *v) {
+    pushScope();
+    for (auto name: v->proto->params->names)
+        bind(name, nullptr);
+    v->body->accept(this);
+    popScope();
+}
+
+void Devirtualizer::visit(ast::FuncDecl *v) {
+    // instances are visited where their generic function is declared
+    if (!v->generics)
+        v->func->accept(this);
+    for (auto inst: v->instances)
+        inst->func->accept(this);
+}
+
+void Devirtualizer::visit(ast::ExprList *v) {
+    for (auto n: v->items)
+        n->accept(this);
+}
+
+void Devirtualizer::visit(ast::StmtList *v) {
+    for (auto n: v->items)
+        n->accept(this);
+}
+
+void Devirtualizer::visit(ast::Cast *v) {
+    v->expr->accept(this);
+    if (v->ty && v->ty->kind == Type::SLICE)
+        alias(v->expr);
+}
+
+void Devirtualizer::visit(ast::Member *v) {
+    v->obj->accept(this);
+    const Type *obj = v->obj->ty;
+    if (!annotate || obj == nullptr || obj->kind != Type::IFACE)
+        return;
+    const Type *type = concrete(v->obj);
+    if (type && type != UNKNOWN()) {
+        v->concrete = type;
+        num_direct++;
+    }
+}
+
+void Devirtualizer::visit(ast::New *v) {
+    v->expr->accept(this);
+}
+
+void Devirtualizer::visit(ast::Slice *v) {
+    v->var->accept(this);
+    if (v->lo)
+        v->lo->accept(this);
+    if (v->hi)
+        v->hi->accept(this);
+    if (v->step)
+        v->step->accept(this);
+    alias(v->var);
+}
+
+void Devirtualizer::visit(ast::Match *v) {
+    v->expr->accept(this);
+    for (auto n: v->arms->items)
+        n->accept(this);
+}
+
+// the payload a variable is bound to is not tracked
+void Devirtualizer::visit(ast::MatchArm *v) {
+    pushScope();
+    if (v->var != ast::Symbols::EMPTY)
+        bind(v->var, nullptr);
+    body(v->body);
+    popScope();
+}
+
+void Devirtualizer::visit(ast::NamedArg *v) {
+    v->expr->accept(this);
+}
+
+void Devirtualizer::visit(ast::Tuple *v) {
+    v->elems->accept(this);
+    for (auto n: v->elems->items)
+        if (shares(n->ty))
+            alias(n);
+}
+
+// the concrete types of the elements of a tuple are not tracked, the
+// unpacked variables are unknown
+void Devirtualizer::visit(ast::Unpack *v) {
+    v->expr->accept(this);
+    for (auto name: v->vars->names)
+        bind(name, nullptr);
+}
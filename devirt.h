@@ -0,0 +1,108 @@
+#ifndef __DEVIRT_H__
+#define __DEVIRT_H__
+
+#include <map>
+#include <utility>
+#include <vector>
+#include "ast.h"
+#include "types.h"
+
+/*
+ * Finds the type behind interface values where it is known statically
+ * and marks the method calls on them, which codegen then emits as
+ * direct calls. The analysis is flow insensitive: a variable has a known
+ * type when every value stored in it, anywhere in its scope, is a cast
+ * of that same type. Arrays are tracked as a whole, so the elements of a
+ * homogeneous array of interface values are known too, and so is the
+ * variable of a for loop over it. An array that a slice is taken of
+ * can be written through the slice, so its elements become unknown;
+ * so do those of an array copied to another variable, a tuple or a
+ * field, or passed to a function, which share its buffer.
+ *
+ * Runs on trees that passed the TypeChecker.
+ */
+class Devirtualizer: public ast::Visitor {
+    private:
+        typedef std::vector<std::pair<ast::symbol_t, ast::Node *> > scope_t;
+
+        // node that defines the innermost binding of every symbol (a
+        // Declaration or a For), null for function parameters
+        std::vector<ast::Node *> bindings;
+        std::vector<scope_t> env;
+
+        // type behind the values stored in a variable. A variable is
+        // missing until something is stored in it.
+        std::map<ast::Node *, const sema::Type *> facts;
+        bool changed;
+        bool annotate;
+        unsigned num_direct;
+
+        ast::Node *lookup(ast::symbol_t name);
+        void bind(ast::symbol_t name, ast::Node *def);
+        void pushScope();
+        void popScope();
+        void body(ast::Node *n);
+        void pass(ast::Node *root);
+        const sema::Type *concrete(ast::Node *e);
+        void store(ast::Node *def, const sema::Type *type);
+        void alias(ast::Node *e);
+
+    public:
+        Devirtualizer();
+
+        void run(ast::Node *root);
+        // method calls that were made direct
+        unsigned getNumDirect() const { return num_direct; }
+
+        virtual void visit(ast::True *) { }
+        virtual void visit(ast::False *) { }
+        virtual void visit(ast::Integer *) { }
+        virtual void visit(ast::Real *) { }
+        virtual void visit(ast::String *) { }
+        virtual void visit(ast::Variable *) { }
+        virtual void visit(ast::Declaration *v);
+        virtual void visit(ast::Assign *v);
+        virtual void visit(ast::Call *v);
+        virtual void visit(ast::Return *v);
+        virtual void visit(ast::Unary *v);
+        virtual void visit(ast::Binary *v);
+        virtual void visit(ast::And *v);
+        virtual void visit(ast::Or *v);
+        virtual void visit(ast::IfElse *v);
+        virtual void visit(ast::While *v);
+        virtual void visit(ast::Break *) { }
+        virtual void visit(ast::Continue *) { }
+        virtual void visit(ast::For *v);
+        virtual void visit(ast::Array *v);
+        virtual void visit(ast::Subscript *v);
+        virtual void visit(ast::Expr *v);
+        virtual void visit(ast::Function *v);
+        virtual void visit(ast::FuncDecl *v);
+        virtual void visit(ast::UnionItem *) { }
+        virtual void visit(ast::UnionList *) { }
+        virtual void visit(ast::RecordDef *) { }
+        virtual void visit(ast::UnionDef *) { }
+        virtual void visit(ast::ExprList *v);
+        virtual void visit(ast::StmtList *v);
+        virtual void visit(ast::SimpleType *) { }
+        virtual void visit(ast::RefType *) { }
+        virtual void visit(ast::PtrType *) { }
+        virtual void visit(ast::ArrayType *) { }
+        virtual void visit(ast::TupleType *) { }
+        virtual void visit(ast::FuncType *) { }
+        virtual void visit(ast::TypeList *) { }
+        virtual void visit(ast::IfaceDef *) { }
+        virtual void visit(ast::Cast *v);
+        virtual void visit(ast::Member *v);
+        virtual void visit(ast::New *v);
+        virtual void visit(ast::Slice *v);
+        virtual void visit(ast::SliceType *) { }
+        virtual void visit(ast::GenericType *) { }
+        virtual void visit(ast::Match *v);
+        virtual void visit(ast::MatchArm *v);
+        virtual void visit(ast::NamedArg *v);
+        virtual void visit(ast::Tuple *v);
+        virtual void visit(ast::Unpack *v);
+};
+
+#endif//__DEVIRT_H__
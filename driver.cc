@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <iostream>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include "driver.h"
+#include "codegen.h"
+#include "devirt.h"
+#include "fingerprint.h"
+#include "mamba_context.h"
+#include "native.h"
+#include "typecheck.h"
+
+static const std::string SOURCE_EXT = ".mamba";
+
+static bool hasExtension(const std::string &path, const std::string &ext) {
+    return path.size() > ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+static std::string moduleName(const std::string &path) {
+    std::string name = path;
+    if (hasExtension(name, SOURCE_EXT))
+        name.resize(name.size() - SOURCE_EXT.size());
+    while (name.compare(0, 2, "./") == 0)
+        name.erase(0, 2);
+    std::replace(name.begin(), name.end(), '/', '.');
+    return name;
+}
+
+std::string Driver::initName(const std::string &module) {
+    std::string name = "__init_" + module;
+    for (auto &c: name)
+        if (!isalnum(c))
+            c = '_';
+    return name;
+}
+
+void Driver::addInput(const std::string &path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        addDirectory(path);
+        return;
+    }
+
+    Unit unit;
+    unit.path = path;
+    unit.name = moduleName(path);
+    unit.status = 0;
+    units.push_back(unit);
+}
+
+void Driver::addDirectory(const std::string &path) {
+    DIR *dir = opendir(path.c_str());
+    if (dir == NULL)
+        return;
+
+    std::vector<std::string> entries;
+    while (struct dirent *ent = readdir(dir)) {
+        std::string name = ent->d_name;
+        if (name == "." || name == "..")
+            continue;
+        entries.push_back(path + "/" + name);
+    }
+    closedir(dir);
+
+    // keep the module order independent of the file system
+    std::sort(entries.begin(), entries.end());
+    for (auto &entry: entries) {
+        struct stat st;
+        if (stat(entry.c_str(), &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            addDirectory(entry);
+        else if (hasExtension(entry, SOURCE_EXT))
+            addInput(entry);
+    }
+}
+
+void Driver::compile(Unit &unit) {
+    MambaContext ctx;
+    if (!ctx.load(unit.path.c_str())) {
+        unit.status = 1;
+        return;
+    }
+
+    std::string source_key;
+    if (cache) {
+        source_key = cache->key("source", unit.name, ctx.getSource(), ctx.getSourceSize());
+        if (cache->lookup(source_key, unit.bitcode))
+            return;
+    }
+
+    unit.status = ctx.parse(unit.path.c_str());
+    unit.errors = ctx.getErrors();
+    if (unit.status != 0)
+        return;
+
+    TypeChecker checker(ctx.getArena());
+    if (!checker.run(ctx.getOutput())) {
+        unit.status = 1;
+        unit.errors += checker.getErrors();
+        return;
+    }
+    Devirtualizer().run(ctx.getOutput());
+
+    std::string tree_key;
+    if (cache) {
+        Fingerprint fingerprint;
+        ctx.getOutput()->accept(&fingerprint);
+        std::string hex = fingerprint.hex();
+        tree_key = cache->key("tree", unit.name, hex.data(), hex.size());
+        if (cache->lookup(tree_key, unit.bitcode)) {
+            cache->store(source_key, unit.bitcode);
+            return;
+        }
+    }
+
+    LLVMContext llvm_ctx;
+    Codegen codegen(llvm_ctx, unit.name, false, level);
+    codegen.generate(ctx.getOutput(), initName(unit.name));
+    codegen.optimize();
+
+    llvm::raw_string_ostream os(unit.bitcode);
+    llvm::WriteBitcodeToFile(codegen.getModule(), os);
+    os.flush();
+
+    if (cache) {
+        cache->store(source_key, unit.bitcode);
+        cache->store(tree_key, unit.bitcode);
+    }
+}
+
+bool Driver::link(const std::string &output) {
+    LLVMContext &ctx = llvm::getGlobalContext();
+    unique_ptr<Module> program(new Module("program", ctx));
+
+    for (auto &unit: units) {
+        unique_ptr<llvm::MemoryBuffer> buffer(llvm::MemoryBuffer::getMemBuffer(unit.bitcode, unit.name, false));
+        llvm::ErrorOr<Module *> module = llvm::parseBitcodeFile(buffer.get(), ctx);
+        if (!module) {
+            std::cerr << unit.path << ": " << module.getError().message() << std::endl;
+            return false;
+        }
+
+        std::string err;
+        if (llvm::Linker::LinkModules(program.get(), *module, llvm::Linker::DestroySource, &err)) {
+            std::cerr << unit.path << ": " << err << std::endl;
+            delete *module;
+            return false;
+        }
+        delete *module;
+    }
+
+    // a function of the program named main is internal, it makes way
+    if (Function *user = program->getFunction("main"))
+        user->setName("main.mamba");
+
+    IRBuilder<> builder(ctx);
+    ::llvm::FunctionType *fty = ::llvm::FunctionType::get(builder.getInt32Ty(), false);
+    Function *main = Function::Create(fty, Function::ExternalLinkage, "main", program.get());
+    builder.SetInsertPoint(BasicBlock::Create(ctx, "entry", main));
+    for (auto &unit: units)
+        builder.CreateCall(program->getFunction(initName(unit.name)));
+    builder.CreateRet(builder.getInt32(0));
+
+    bool bitcode = hasExtension(output, ".bc");
+    NativeBackend backend(level);
+    if (!bitcode) {
+        if (!backend.ok()) {
+            std::cerr << backend.getError() << std::endl;
+            return false;
+        }
+        backend.prepare(program.get());
+    }
+
+    if (level.enabled()) {
+        llvm::PassManager pm;
+        level.addModulePasses(pm);
+        pm.run(*program);
+    }
+
+    if (bitcode) {
+        std::string err;
+        llvm::raw_fd_ostream out(output.c_str(), err, llvm::sys::fs::F_None);
+        if (!err.empty()) {
+            std::cerr << output << ": " << err << std::endl;
+            return false;
+        }
+        llvm::WriteBitcodeToFile(program.get(), out);
+        return true;
+    }
+
+    if (hasExtension(output, ".o")) {
+        if (!backend.emitObject(program.get(), output)) {
+            std::cerr << output << ": " << backend.getError() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    std::string object = output + ".o";
+    bool ok = backend.emitObject(program.get(), object) && backend.link({object}, output);
+    if (!ok)
+        std::cerr << output << ": " << backend.getError() << std::endl;
+    unlink(object.c_str());
+    return ok;
+}
+
+bool Driver::build(const std::string &output) {
+    for (auto &unit: units) {
+        Unit *u = &unit;
+        scheduler.spawn([this, u]() { compile(*u); });
+    }
+    scheduler.wait();
+
+    bool ok = true;
+    for (auto &unit: units) {
+        if (unit.status != 0) {
+            std::cout << unit.path << ": failed" << std::endl;
+            std::cout << unit.errors;
+            ok = false;
+        }
+    }
+
+    return ok && link(output);
+}
@@ -0,0 +1,55 @@
+#ifndef __DRIVER_H__
+#define __DRIVER_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "cache.h"
+#include "optimizer.h"
+#include "scheduler.h"
+
+/*
+ * Builds a whole project. Every module is parsed and code generated by
+ * its own task on the work-stealing scheduler, with a private
+ * MambaContext, Codegen and LLVMContext. The per module bitcode is then
+ * linked into a single program whose main runs the top level code of
+ * every module in the order the inputs were given. Modules are optimized
+ * on their own, and the linked program again so calls can be inlined
+ * across modules. The output is written as bitcode (.bc), as an object
+ * file (.o) or otherwise as an executable linked with the runtime.
+ *
+ * With a cache, a module whose source, or failing that whose tree, is
+ * unchanged since a previous build reuses its stored bitcode and skips
+ * code generation (and, for an unchanged source, parsing as well).
+ */
+class Driver {
+    private:
+        struct Unit {
+            std::string path;
+            std::string name;
+            int status;
+            std::string errors;
+            std::string bitcode;
+        };
+
+        std::vector<Unit> units;
+        Scheduler scheduler;
+        OptLevel level;
+        std::unique_ptr<BuildCache> cache;
+
+        void addDirectory(const std::string &path);
+        void compile(Unit &unit);
+        bool link(const std::string &output);
+
+    public:
+        Driver(unsigned jobs, const OptLevel &_level = OptLevel()): scheduler(jobs), level(_level) { }
+
+        // entries are only shared between builds at the same level
+        void setCache(const std::string &dir) { cache.reset(new BuildCache(dir, level.str())); }
+        void addInput(const std::string &path);
+        bool build(const std::string &output);
+
+        static std::string initName(const std::string &module);
+};
+
+#endif//__DRIVER_H__
@@ -0,0 +1,130 @@
+#ifndef __FINGERPRINT_H__
+#define __FINGERPRINT_H__
+
+#include <string>
+#include <vector>
+#include <llvm/Support/MD5.h>
+#include "ast.h"
+
+/*
+ * Structural hash of a tree. Whitespace, comments and the layout of the
+ * source do not change the fingerprint, so a module whose edits leave
+ * the tree unchanged can reuse previously generated code.
+ */
+class Fingerprint: public ast::Visitor {
+private:
+    llvm::MD5 md5;
+    std::vector<ast::symbol_t> *names;
+
+    void raw(const void *data, size_t size) {
+        md5.update(llvm::ArrayRef<uint8_t>((const uint8_t *)data, size));
+    }
+
+    void tag(ast::NodeTag t) {
+        uint8_t b = t;
+        raw(&b, 1);
+    }
+
+    void integer(int64_t i) {
+        raw(&i, sizeof(i));
+    }
+
+    void text(const char *str, size_t len) {
+        integer(len);
+        raw(str, len);
+    }
+
+    // symbol ids are process local, hash the names instead
+    void symbol(ast::symbol_t sym) {
+        if (names)
+            names->push_back(sym);
+        const std::string &name = ast::Symbols::name(sym);
+        text(name.data(), name.size());
+    }
+
+    void node(ast::Node *n) {
+        if (n)
+            n->accept(this);
+        else
+            tag(ast::TAG_NIL);
+    }
+
+    template<class T, unsigned N>
+    void list(const ast::SmallList<T, N> &l) {
+        integer(l.size());
+        for (auto &n: l)
+            node(n);
+    }
+
+public:
+    Fingerprint(): names(nullptr) { }
+
+    // append every name hashed from now on to _names
+    void collect(std::vector<ast::symbol_t> *_names) { names = _names; }
+
+    std::string hex() {
+        llvm::MD5::MD5Result result;
+        llvm::SmallString<32> str;
+        md5.final(result);
+        llvm::MD5::stringifyResult(result, str);
+        return str.str();
+    }
+
+    virtual void visit(ast::True *) { tag(ast::TAG_TRUE); }
+    virtual void visit(ast::False *) { tag(ast::TAG_FALSE); }
+    virtual void visit(ast::Integer *v) { tag(ast::TAG_INTEGER); integer(v->val); }
+    virtual void visit(ast::Real *v) { tag(ast::TAG_REAL); raw(&v->val, sizeof(v->val)); }
+    virtual void visit(ast::String *v) { tag(ast::TAG_STRING); text(v->val.ptr, v->val.len); }
+    virtual void visit(ast::Variable *v) { tag(ast::TAG_VARIABLE); symbol(v->val); }
+    virtual void visit(ast::Declaration *v) { tag(ast::TAG_DECLARATION); symbol(v->name); node(v->expr); node(v->type_spec); }
+    virtual void visit(ast::Assign *v) { tag(ast::TAG_ASSIGN); node(v->expr); list(v->vars); }
+    virtual void visit(ast::Call *v) { tag(ast::TAG_CALL); node(v->parent); node(v->params); }
+    virtual void visit(ast::Return *v) { tag(ast::TAG_RETURN); node(v->e); }
+    virtual void visit(ast::Unary *v) { tag(ast::TAG_UNARY); integer(v->op); node(v->down); }
+    virtual void visit(ast::Binary *v) { tag(ast::TAG_BINARY); integer(v->op); node(v->left); node(v->right); }
+    virtual void visit(ast::And *v) { tag(ast::TAG_AND); node(v->left); node(v->right); }
+    virtual void visit(ast::Or *v) { tag(ast::TAG_OR); node(v->left); node(v->right); }
+    virtual void visit(ast::IfElse *v) { tag(ast::TAG_IFELSE); node(v->expr); node(v->body); node(v->ifelse); }
+    virtual void visit(ast::While *v) { tag(ast::TAG_WHILE); node(v->expr); node(v->body); }
+    virtual void visit(ast::Break *) { tag(ast::TAG_BREAK); }
+    virtual void visit(ast::Continue *) { tag(ast::TAG_CONTINUE); }
+    virtual void visit(ast::For *v) { tag(ast::TAG_FOR); symbol(v->vname); node(v->iterable); node(v->body); }
+    virtual void visit(ast::Array *v) { tag(ast::TAG_ARRAY); node(v->elems); }
+    virtual void visit(ast::Subscript *v) { tag(ast::TAG_SUBSCRIPT); node(v->var); node(v->idx); }
+    virtual void visit(ast::Expr *v) { tag(ast::TAG_EXPR); node(v->e); }
+    virtual void visit(ast::Function *v) { tag(ast::TAG_FUNCTION); node(v->proto); node(v->body); }
+    virtual void visit(ast::FuncDecl *v) { tag(ast::TAG_FUNCDECL); symbol(v->name); node(v->func); node(v->generics); }
+    virtual void visit(ast::UnionItem *v) { tag(ast::TAG_UNIONITEM); symbol(v->name); node(v->type_spec); }
+    virtual void visit(ast::UnionList *v) { tag(ast::TAG_UNIONLIST); list(v->items); }
+    virtual void visit(ast::RecordDef *v) { tag(ast::TAG_RECORDDEF); symbol(v->name); node(v->decl_list); symbol(v->layout); }
+    virtual void visit(ast::UnionDef *v) { tag(ast::TAG_UNIONDEF); symbol(v->name); node(v->type_list); node(v->generics); }
+    virtual void visit(ast::ExprList *v) { tag(ast::TAG_EXPRLIST); list(v->items); }
+    virtual void visit(ast::StmtList *v) { tag(ast::TAG_STMTLIST); list(v->items); }
+    virtual void visit(ast::SimpleType *v) { tag(ast::TAG_SIMPLETYPE); symbol(v->tname); }
+    virtual void visit(ast::RefType *v) { tag(ast::TAG_REFTYPE); node(v->base_type); }
+    virtual void visit(ast::PtrType *v) { tag(ast::TAG_PTRTYPE); node(v->base_type); }
+    virtual void visit(ast::ArrayType *v) { tag(ast::TAG_ARRAYTYPE); node(v->base_type); }
+    virtual void visit(ast::TupleType *v) { tag(ast::TAG_TUPLETYPE); node(v->base_type); }
+    virtual void visit(ast::FuncType *v) { tag(ast::TAG_FUNCTYPE); node(v->params); node(v->ret); }
+    virtual void visit(ast::TypeList *v) {
+        tag(ast::TAG_TYPELIST);
+        list(v->types);
+        integer(v->names.size());
+        for (auto &n: v->names)
+            symbol(n);
+    }
+    virtual void visit(ast::IfaceDef *v) { tag(ast::TAG_IFACEDEF); symbol(v->name); node(v->methods); }
+    virtual void visit(ast::Cast *v) { tag(ast::TAG_CAST); node(v->expr); node(v->type); }
+    virtual void visit(ast::Member *v) { tag(ast::TAG_MEMBER); node(v->obj); symbol(v->name); }
+    virtual void visit(ast::New *v) { tag(ast::TAG_NEW); node(v->expr); }
+    virtual void visit(ast::Slice *v) { tag(ast::TAG_SLICE); node(v->var); node(v->lo); node(v->hi); node(v->step); }
+    virtual void visit(ast::SliceType *v) { tag(ast::TAG_SLICETYPE); node(v->base_type); }
+    virtual void visit(ast::GenericType *v) { tag(ast::TAG_GENERICTYPE); symbol(v->tname); node(v->args); }
+    virtual void visit(ast::Match *v) { tag(ast::TAG_MATCH); node(v->expr); node(v->arms); }
+    virtual void visit(ast::MatchArm *v) { tag(ast::TAG_MATCHARM); symbol(v->name); symbol(v->var); node(v->body); }
+    virtual void visit(ast::NamedArg *v) { tag(ast::TAG_NAMEDARG); symbol(v->name); node(v->expr); }
+    virtual void visit(ast::Tuple *v) { tag(ast::TAG_TUPLE); node(v->elems); }
+    virtual void visit(ast::Unpack *v) { tag(ast::TAG_UNPACK); symbol(v->tname); node(v->vars); node(v->expr); }
+};
+
+#endif//__FINGERPRINT_H__
@@ -1,18 +1,142 @@
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include <llvm/Support/ManagedStatic.h>
+#include "codegen.h"
+#include "devirt.h"
+#include "driver.h"
+#include "optimizer.h"
 #include "mamba_context.h"
+#include "scheduler.h"
+#include "serialize.h"
+#include "typecheck.h"
 
 void yyerror(YYLTYPE *yylloc, MambaContext *context, const char *err) {
-    std::cout << err << "\n";
-    std::cout << "line: " << yylloc->last_line << "-" <<yylloc->first_line << "\n";
-    std::cout << "column: " << yylloc->last_column << "-" <<yylloc->first_column<< "\n";
+    std::ostringstream msg;
+    msg << err << "\n";
+    msg << "line: " << yylloc->last_line << "-" <<yylloc->first_line << "\n";
+    msg << "column: " << yylloc->last_column << "-" <<yylloc->first_column<< "\n";
+    context->addError(msg.str());
+}
+
+struct ParseResult {
+    int status;
+    int num_errors;
+    std::string errors;
+};
+
+// Parse every file in its own MambaContext, jobs files at a time.
+static std::vector<ParseResult> parseFiles(const std::vector<const char *> &files, unsigned jobs) {
+    std::vector<ParseResult> results(files.size());
+    Scheduler scheduler(jobs);
+
+    for (size_t i = 0; i < files.size(); i++) {
+        scheduler.spawn([&files, &results, i]() {
+            MambaContext ctx;
+            results[i].status = ctx.parse(files[i]);
+            results[i].num_errors = ctx.getNumErrors();
+            results[i].errors = ctx.getErrors();
+        });
+    }
+    scheduler.wait();
+
+    return results;
 }
 
 int main(int argc, char *argv[]) {
-    MambaContext ctx;
-    if (argc > 1)
-        ctx.parse(argv[1]);
-    else
-        ctx.parse();
-    std::cout << ctx.getOutput() << std::endl;
-    return 0;
+    // releases llvm at exit, printing the pass timings if enabled
+    llvm::llvm_shutdown_obj shutdown;
+    unsigned jobs = std::thread::hardware_concurrency();
+    const char *output = NULL;
+    const char *cache_dir = ".mamba-cache";
+    const char *emit_ast = NULL;
+    bool run = false;
+    int tier_threshold = -1;
+    OptLevel level;
+    std::vector<const char *> files;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i+1 < argc)
+            jobs = atoi(argv[++i]);
+        else if (arg.compare(0, 2, "-j") == 0)
+            jobs = atoi(arg.c_str() + 2);
+        else if (arg == "-o" && i+1 < argc)
+            output = argv[++i];
+        else if (arg == "-cache" && i+1 < argc)
+            cache_dir = argv[++i];
+        else if (arg == "-no-cache")
+            cache_dir = NULL;
+        else if (arg == "-emit-ast" && i+1 < argc)
+            emit_ast = argv[++i];
+        else if (OptLevel::parse(arg, level))
+            continue;
+        else if (arg == "-time-passes")
+            OptLevel::enableTiming();
+        else if (arg == "-run")
+            run = true;
+        else if (arg == "-tier-threshold" && i+1 < argc)
+            tier_threshold = atoi(argv[++i]);
+        else
+            files.push_back(argv[i]);
+    }
+    if (jobs == 0)
+        jobs = 1;
+
+    // with an output, compile and link every module (or every .mamba
+    // file below a directory) into a single program
+    if (output) {
+        Driver driver(jobs, level);
+        if (cache_dir)
+            driver.setCache(cache_dir);
+        for (auto f: files)
+            driver.addInput(f);
+        return driver.build(output) ? 0 : 1;
+    }
+
+    if (files.size() <= 1) {
+        MambaContext ctx;
+        int ret = ctx.parse(files.empty() ? NULL : files[0]);
+        std::cout << ctx.getErrors();
+        if (ret == 0 && emit_ast) {
+            std::ofstream out(emit_ast, std::ios::binary);
+            out << ast::serialize(ctx.getOutput());
+        }
+        if (ret == 0 && run) {
+            TypeChecker checker(ctx.getArena());
+            if (!checker.run(ctx.getOutput())) {
+                std::cout << checker.getErrors();
+                return 1;
+            }
+            Devirtualizer().run(ctx.getOutput());
+            Codegen::init();
+            Codegen codegen(llvm::getGlobalContext(), "jit", true, level);
+            if (tier_threshold > 0 && codegen.getTiers())
+                codegen.getTiers()->setThreshold(tier_threshold);
+            codegen.run(codegen.generate(ctx.getOutput(), "__main"));
+            return 0;
+        }
+        std::cout << ctx.getOutput() << std::endl;
+        return ret;
+    }
+
+    std::vector<ParseResult> results = parseFiles(files, jobs);
+
+    int failed = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        const ParseResult &r = results[i];
+        if (r.status == 0) {
+            std::cout << files[i] << ": ok" << std::endl;
+        } else {
+            std::cout << files[i] << ": failed (" << r.num_errors << " errors)" << std::endl;
+            std::cout << r.errors;
+            failed++;
+        }
+    }
+    std::cout << files.size() - failed << " of " << files.size() << " files parsed" << std::endl;
+
+    return failed ? 1 : 0;
 }
@@ -5,6 +5,8 @@
 
 // hack to send scanner to yylex
 #define context_scanner context->getScanner()
+// every node is allocated in the context arena
+#define context_arena context->getArena()
 %}
 
 %require "2.5"
@@ -21,25 +23,26 @@
     double real;
     long int integer;
     int token;
-    std::string *string;
+    ast::Span string;
+    ast::symbol_t symbol;
     ast::Node *node;
+    ast::ListNode *list;
     ast::TypeList *tlist;
     ast::Type *type;
+    ast::Slice *slice;
 }
 
-%token<string> IDENTIFIER STRING
+%token<symbol> IDENTIFIER
+%token<string> STRING
 %token<real> REAL
 %token<integer> INTEGER
 %token<token> INDENT DEDENT NEWLINE
 %token<token> T_LT T_LE T_GT T_GE T_EQ T_NE
 %token<token> T_ADD T_SUB T_MUL T_DIV T_MOD T_POW
 %token<token> T_LSHIFT T_RSHIFT T_BITAND T_BITOR T_BITXOR T_BITNEG T_ARROW T_ELLIPSIS
-%token<token> VAR FUN FALSE TRUE RECORD UNION OR AND NOT IF ELSE ELIF WHILE BREAK CONTINUE FOR IN RETURN
+%token<token> VAR FUN FALSE TRUE RECORD UNION OR AND NOT IF ELSE ELIF WHILE BREAK CONTINUE FOR IN RETURN IS IFACE AS MATCH
 
-/* Clean up memory in case of error */
-%destructor { delete $$; } <node>
-%destructor { delete $$; } IDENTIFIER
-%destructor { delete $$; } STRING
+/* Nodes discarded on error are reclaimed with the context arena */
 
 %left OR
 %left AND
@@ -54,9 +57,11 @@
 %right T_POW
 
 %type<token> cmp_op bitshift_op arith_op term_op
-%type<node> suite stmt_block simple_stmt small_stmt compound_stmt assn_stmt decl_stmt func_stmt break_stmt continue_stmt return_stmt while_stmt for_stmt if_stmt elif_stmt func_expr expr_list_ne expr_list array_expr call_expr subs_expr wexpr expr sexpr not_expr and_expr comp_expr bitor_expr bitand_expr bitxor_expr bitshift_expr arith_expr term_expr power_expr record_suite record_stmt union_decl union_block union_suite union_stmt
-%type<type> pointer_type array_type ref_type tuple_type func_type return_type type
-%type<tlist> record_block func_params type_list type_list_ne
+%type<node> cast_expr member_expr iface_stmt suite simple_stmt small_stmt compound_stmt assn_stmt decl_stmt func_stmt break_stmt continue_stmt return_stmt while_stmt for_stmt if_stmt elif_stmt func_expr array_expr call_expr subs_expr wexpr opt_expr expr sexpr not_expr and_expr comp_expr bitor_expr bitand_expr bitxor_expr bitshift_expr arith_expr term_expr power_expr record_suite record_stmt union_decl union_suite union_stmt match_stmt match_arm
+%type<type> pointer_type array_type slice_type ref_type tuple_type func_type return_type type
+%type<list> stmt_block expr_list_ne expr_list tuple_elems named_args union_block match_block
+%type<slice> slice_range
+%type<tlist> record_block iface_suite iface_block func_params type_list type_list_ne generic_params unpack_names
 
 %start program
 
@@ -71,16 +76,16 @@ suite:
 
 stmt_block:
     compound_stmt
-    { $$ = new ast::StmtList(); $$->appendChild($1); } |
+    { $$ = context_arena.make<ast::StmtList>(); $$->appendChild(context_arena, $1); } |
 
     simple_stmt
-    { $$ = new ast::StmtList(); $$->appendChild($1); } |
+    { $$ = context_arena.make<ast::StmtList>(); $$->appendChild(context_arena, $1); } |
 
     stmt_block simple_stmt
-    { $$ = $1; $$->appendChild($2); } |
+    { $$ = $1; $$->appendChild(context_arena, $2); } |
 
     stmt_block compound_stmt
-    { $$ = $1; $$->appendChild($2); } ;
+    { $$ = $1; $$->appendChild(context_arena, $2); } ;
 
 simple_stmt:
     small_stmt NEWLINE
@@ -88,7 +93,7 @@ simple_stmt:
 
 small_stmt:
     expr
-    { $$ = new ast::Expr($1); } |
+    { $$ = context_arena.make<ast::Expr>($1); } |
 
     decl_stmt
     { $$ = $1; } |
@@ -122,70 +127,147 @@ compound_stmt:
     { $$ = $1; } |
 
     union_stmt
+    { $$ = $1; } |
+
+    match_stmt
+    { $$ = $1; } |
+
+    iface_stmt
     { $$ = $1; } ;
 
 break_stmt:
     BREAK
-    { $$ = new ast::Break(); } ;
+    { $$ = context_arena.make<ast::Break>(); } ;
 
 continue_stmt:
     CONTINUE
-    { $$ = new ast::Continue(); } ;
+    { $$ = context_arena.make<ast::Continue>(); } ;
 
 return_stmt:
     RETURN
-    { $$ = new ast::Return(NULL); } |
+    { $$ = context_arena.make<ast::Return>(nullptr); } |
 
     RETURN expr
-    { $$ = new ast::Return($2); } ;
+    { $$ = context_arena.make<ast::Return>($2); } ;
 
 assn_stmt:
     wexpr '=' expr
-    { $$ = new ast::Assign($1, $3); } |
+    { $$ = context_arena.make<ast::Assign>(context_arena, $1, $3); } |
 
     wexpr '=' assn_stmt
-    { $$ = $3; ((ast::Assign*)$$)->vars.push_back($1); } ;
+    { $$ = $3; ((ast::Assign*)$$)->vars.push_back(context_arena, $1); } ;
 
 decl_stmt:
     VAR IDENTIFIER '=' expr
-    { $$ = new ast::Declaration($2, $4, NULL); } |
+    { $$ = context_arena.make<ast::Declaration>($2, $4, nullptr); } |
 
     VAR type IDENTIFIER '=' expr
-    { $$ = new ast::Declaration($3, $5, $2); } ;
+    { $$ = context_arena.make<ast::Declaration>($3, $5, $2); } |
+
+    VAR tuple_type '=' expr
+    {
+        /* the names are read as the types of a tuple type */
+        ast::TypeList *names = context_arena.make<ast::TypeList>();
+        for (auto t: static_cast<ast::TypeList*>(static_cast<ast::TupleType*>($2)->base_type)->types) {
+            ast::SimpleType *name = dynamic_cast<ast::SimpleType*>(t);
+            if (name == nullptr) {
+                yyerror(&@2, context, "expected a name to unpack into");
+                YYERROR;
+            }
+            names->appendNamedChild(context_arena, name->tname, nullptr);
+        }
+        $$ = context_arena.make<ast::Unpack>(ast::Symbols::EMPTY, names, $4);
+    } |
+
+    VAR IDENTIFIER '(' unpack_names ')' '=' expr
+    { $$ = context_arena.make<ast::Unpack>($2, $4, $7); } ;
+
+unpack_names:
+    IDENTIFIER
+    { $$ = context_arena.make<ast::TypeList>(); $$->appendNamedChild(context_arena, $1, nullptr); } |
+
+    unpack_names ',' IDENTIFIER
+    { $$ = $1; $$->appendNamedChild(context_arena, $3, nullptr); } ;
 
 func_stmt:
     FUN IDENTIFIER func_expr
-    { $$ = new ast::FuncDecl($2, $3); } ;
+    { $$ = context_arena.make<ast::FuncDecl>($2, $3); } |
+
+    FUN IDENTIFIER '{' generic_params '}' func_expr
+    { $$ = context_arena.make<ast::FuncDecl>($2, $6, $4); } |
+
+    FUN IDENTIFIER '.' IDENTIFIER func_expr
+    { $$ = context_arena.make<ast::FuncDecl>(ast::Symbols::intern(ast::Symbols::name($2) + "." + ast::Symbols::name($4)), $5); } ;
+
+generic_params:
+    IDENTIFIER
+    { $$ = context_arena.make<ast::TypeList>(); $$->appendNamedChild(context_arena, $1, nullptr); } |
+
+    IDENTIFIER IS IDENTIFIER
+    { $$ = context_arena.make<ast::TypeList>(); $$->appendNamedChild(context_arena, $1, context_arena.make<ast::SimpleType>($3)); } |
+
+    generic_params ',' IDENTIFIER
+    { $$ = $1; $$->appendNamedChild(context_arena, $3, nullptr); } |
+
+    generic_params ',' IDENTIFIER IS IDENTIFIER
+    { $$ = $1; $$->appendNamedChild(context_arena, $3, context_arena.make<ast::SimpleType>($5)); } ;
 
 if_stmt:
     IF expr ':' suite elif_stmt
-    { $$ = new ast::IfElse($2, $4, $5); } ;
+    { $$ = context_arena.make<ast::IfElse>($2, $4, $5); } ;
 
 elif_stmt:
     %empty
     { $$ = NULL; } |
 
     ELIF expr ':' suite elif_stmt
-    { $$ = new ast::IfElse($2, $4, $5); } |
+    { $$ = context_arena.make<ast::IfElse>($2, $4, $5); } |
 
     ELSE ':' suite
     { $$ = $3; } ;
 
 while_stmt:
     WHILE expr ':' suite
-    { $$ = new ast::While($2, $4); } ;
+    { $$ = context_arena.make<ast::While>($2, $4); } ;
 
 for_stmt:
     FOR IDENTIFIER IN expr ':' suite
-    { $$ = new ast::For($2, $4, $6); } ;
+    { $$ = context_arena.make<ast::For>($2, $4, $6); } ;
 
 record_stmt:
     RECORD IDENTIFIER ':' record_suite
-    { $$ = new ast::RecordDef($2, $4); } ;
+    { $$ = context_arena.make<ast::RecordDef>($2, $4); } |
+
+    RECORD IDENTIFIER AS IDENTIFIER ':' record_suite
+    { $$ = context_arena.make<ast::RecordDef>($2, $6, $4); } ;
 
 union_stmt:
     UNION IDENTIFIER ':' union_suite
-    { $$ = new ast::UnionDef($2, $4); } ;
+    { $$ = context_arena.make<ast::UnionDef>($2, $4); } |
+
+    UNION IDENTIFIER '{' generic_params '}' ':' union_suite
+    { $$ = context_arena.make<ast::UnionDef>($2, $7, $4); } ;
+
+match_stmt:
+    MATCH expr ':' NEWLINE INDENT match_block DEDENT
+    { $$ = context_arena.make<ast::Match>($2, static_cast<ast::StmtList*>($6)); } |
+
+    MATCH expr ':' NEWLINE INDENT match_block ELSE ':' suite DEDENT
+    { $6->appendChild(context_arena, context_arena.make<ast::MatchArm>(ast::Symbols::EMPTY, ast::Symbols::EMPTY, $9)); $$ = context_arena.make<ast::Match>($2, static_cast<ast::StmtList*>($6)); } ;
+
+match_block:
+    match_arm
+    { $$ = context_arena.make<ast::StmtList>(); $$->appendChild(context_arena, $1); } |
+
+    match_block match_arm
+    { $$ = $1; $1->appendChild(context_arena, $2); } ;
+
+match_arm:
+    IDENTIFIER ':' suite
+    { $$ = context_arena.make<ast::MatchArm>($1, ast::Symbols::EMPTY, $3); } |
+
+    IDENTIFIER '(' IDENTIFIER ')' ':' suite
+    { $$ = context_arena.make<ast::MatchArm>($1, $3, $6); } ;
 
 record_suite:
     NEWLINE INDENT record_block DEDENT
@@ -193,10 +275,25 @@ record_suite:
 
 record_block:
     type IDENTIFIER NEWLINE
-    { $$ = new ast::TypeList(); $$->appendNamedChild($2, $1); } |
+    { $$ = context_arena.make<ast::TypeList>(); $$->appendNamedChild(context_arena, $2, $1); } |
 
     record_block type IDENTIFIER NEWLINE
-    { $$ = $1; $$->appendNamedChild($3, $2); } ;
+    { $$ = $1; $$->appendNamedChild(context_arena, $3, $2); } ;
+
+iface_stmt:
+    IFACE IDENTIFIER ':' iface_suite
+    { $$ = context_arena.make<ast::IfaceDef>($2, $4); } ;
+
+iface_suite:
+    NEWLINE INDENT iface_block DEDENT
+    { $$ = $3; } ;
+
+iface_block:
+    FUN IDENTIFIER func_type NEWLINE
+    { $$ = context_arena.make<ast::TypeList>(); $$->appendNamedChild(context_arena, $2, $3); } |
+
+    iface_block FUN IDENTIFIER func_type NEWLINE
+    { $$ = $1; $$->appendNamedChild(context_arena, $3, $4); } ;
 
 union_suite:
     NEWLINE INDENT union_block DEDENT
@@ -204,47 +301,51 @@ union_suite:
 
 union_block:
     union_decl NEWLINE
-    { $$ = new ast::UnionList(); $$->appendChild($1); } |
+    { $$ = context_arena.make<ast::UnionList>(); $$->appendChild(context_arena, $1); } |
 
     union_block union_decl NEWLINE
-    { $$ = $1; $1->appendChild($2); } ;
+    { $$ = $1; $1->appendChild(context_arena, $2); } ;
 
 union_decl:
     IDENTIFIER
-    { $$ = new ast::UnionItem($1, NULL); } |
+    { $$ = context_arena.make<ast::UnionItem>($1, nullptr); } |
 
     IDENTIFIER '(' type ')'
-    { $$ = new ast::UnionItem($1, $3); } ;
+    { $$ = context_arena.make<ast::UnionItem>($1, $3); } ;
 
 pointer_type:
     '*' type
-    { $$ = new ast::PtrType($2); } ;
+    { $$ = context_arena.make<ast::PtrType>($2); } ;
 
 array_type:
     '[' type ']'
-    { $$ = new ast::ArrayType($2); } ;
+    { $$ = context_arena.make<ast::ArrayType>($2); } ;
+
+slice_type:
+    '[' type ':' ']'
+    { $$ = context_arena.make<ast::SliceType>($2); } ;
 
 ref_type:
     '&' type
-    { $$ = new ast::RefType($2); } ;
+    { $$ = context_arena.make<ast::RefType>($2); } ;
 
 type_list:
     type
-    { $$ = new ast::TypeList(); $$->appendChild($1); } |
+    { $$ = context_arena.make<ast::TypeList>(); $$->appendChild(context_arena, $1); } |
 
     type_list ',' type
-    { $$ = $1; $$->appendChild($3); } ;
+    { $$ = $1; $$->appendChild(context_arena, $3); } ;
 
 type_list_ne:
     type ',' type
-    { $$ = new ast::TypeList(); $$->appendChild($1); $$->appendChild($3); } |
+    { $$ = context_arena.make<ast::TypeList>(); $$->appendChild(context_arena, $1); $$->appendChild(context_arena, $3); } |
 
     type_list_ne ',' type
-    { $$ = $1; $$->appendChild($3); } ;
+    { $$ = $1; $$->appendChild(context_arena, $3); } ;
 
 tuple_type:
     '(' type_list_ne ')'
-    { $$ = new ast::TupleType($2); } ;
+    { $$ = context_arena.make<ast::TupleType>($2); } ;
 
 return_type:
     T_ARROW type
@@ -252,14 +353,17 @@ return_type:
 
 func_type:
     '|' '|' return_type
-    { $$ = new ast::FuncType(new ast::TypeList(), $3); } |
+    { $$ = context_arena.make<ast::FuncType>(context_arena.make<ast::TypeList>(), $3); } |
 
     '|' type_list '|' return_type
-    { $$ = new ast::FuncType($2, $4); } ;
+    { $$ = context_arena.make<ast::FuncType>($2, $4); } ;
 
 type:
     IDENTIFIER
-    { $$ = new ast::SimpleType($1); } |
+    { $$ = context_arena.make<ast::SimpleType>($1); } |
+
+    IDENTIFIER '{' type_list '}'
+    { $$ = context_arena.make<ast::GenericType>($1, $3); } |
 
     pointer_type
     { $$ = $1; } |
@@ -267,6 +371,9 @@ type:
     array_type
     { $$ = $1; } |
 
+    slice_type
+    { $$ = $1; } |
+
     tuple_type
     { $$ = $1; } |
 
@@ -278,84 +385,159 @@ type:
 
 func_params:
     type IDENTIFIER
-    { $$ = new ast::TypeList(); $$->appendNamedChild($2, $1); } |
+    { $$ = context_arena.make<ast::TypeList>(); $$->appendNamedChild(context_arena, $2, $1); } |
 
     func_params ',' type IDENTIFIER
-    { $$ = $1; $$->appendNamedChild($4, $3); } ;
+    { $$ = $1; $$->appendNamedChild(context_arena, $4, $3); } ;
 
 func_expr:
     '|' '|' return_type ':' suite
-    { $$ = new ast::Function(new ast::FuncType(new ast::TypeList(), $3), $5); } |
+    { $$ = context_arena.make<ast::Function>(context_arena.make<ast::FuncType>(context_arena.make<ast::TypeList>(), $3), $5); } |
 
     '|' func_params '|' return_type ':' suite
-    { $$ = new ast::Function(new ast::FuncType($2, $4), $6); } ;
+    { $$ = context_arena.make<ast::Function>(context_arena.make<ast::FuncType>($2, $4), $6); } |
+
+    '|' '|' ':' suite
+    { $$ = context_arena.make<ast::Function>(context_arena.make<ast::FuncType>(context_arena.make<ast::TypeList>(), nullptr), $4); } |
+
+    '|' func_params '|' ':' suite
+    { $$ = context_arena.make<ast::Function>(context_arena.make<ast::FuncType>($2, nullptr), $5); } ;
 
 wexpr:
     IDENTIFIER
-    { $$ = new ast::Variable($1); } |
+    { $$ = context_arena.make<ast::Variable>($1); } |
 
     IDENTIFIER '[' expr ']'
-    { $$ = new ast::Subscript(new ast::Variable($1), $3); } ;
+    { $$ = context_arena.make<ast::Subscript>(context_arena.make<ast::Variable>($1), $3); } |
+
+    member_expr
+    { $$ = $1; } ;
 
 expr_list_ne:
     expr
-    { $$ = new ast::ExprList(); $$->appendChild($1); } |
+    { $$ = context_arena.make<ast::ExprList>(); $$->appendChild(context_arena, $1); } |
 
     expr_list_ne ',' expr
-    { $$ = $1; $1->appendChild($3); } ;
+    { $$ = $1; $1->appendChild(context_arena, $3); } ;
+
+
+tuple_elems:
+    expr ',' expr
+    { $$ = context_arena.make<ast::ExprList>(); $$->appendChild(context_arena, $1); $$->appendChild(context_arena, $3); } |
 
+    tuple_elems ',' expr
+    { $$ = $1; $1->appendChild(context_arena, $3); } ;
 
 expr_list:
     %empty
-    { $$ = new ast::ExprList(); } |
+    { $$ = context_arena.make<ast::ExprList>(); } |
 
     expr_list_ne
     { $$ = $1; } ;
 
 array_expr:
     '[' expr_list_ne ']'
-    { $$ = new ast::Array($2); } ;
+    { $$ = context_arena.make<ast::Array>(static_cast<ast::ExprList*>($2)); } ;
+
+member_expr:
+    IDENTIFIER '.' IDENTIFIER
+    { $$ = context_arena.make<ast::Member>(context_arena.make<ast::Variable>($1), $3); } |
+
+    call_expr '.' IDENTIFIER
+    { $$ = context_arena.make<ast::Member>($1, $3); } |
+
+    subs_expr '.' IDENTIFIER
+    { $$ = context_arena.make<ast::Member>($1, $3); } |
+
+    member_expr '.' IDENTIFIER
+    { $$ = context_arena.make<ast::Member>($1, $3); } ;
+
+named_args:
+    IDENTIFIER '=' expr
+    { $$ = context_arena.make<ast::ExprList>(); $$->appendChild(context_arena, context_arena.make<ast::NamedArg>($1, $3)); } |
+
+    named_args ',' IDENTIFIER '=' expr
+    { $$ = $1; $1->appendChild(context_arena, context_arena.make<ast::NamedArg>($3, $5)); } ;
 
 call_expr:
     IDENTIFIER '(' expr_list ')'
-    { $$ = new ast::Call(new ast::Variable($1), $3); } |
+    { $$ = context_arena.make<ast::Call>(context_arena.make<ast::Variable>($1), static_cast<ast::ExprList*>($3)); } |
+
+    IDENTIFIER '(' named_args ')'
+    { $$ = context_arena.make<ast::Call>(context_arena.make<ast::Variable>($1), static_cast<ast::ExprList*>($3)); } |
+
+    member_expr '(' expr_list ')'
+    { $$ = context_arena.make<ast::Call>($1, static_cast<ast::ExprList*>($3)); } |
 
     call_expr '(' expr_list ')'
-    { $$ = new ast::Call($1, $3); } ;
+    { $$ = context_arena.make<ast::Call>($1, static_cast<ast::ExprList*>($3)); } ;
+
+opt_expr:
+    %empty
+    { $$ = nullptr; } |
+
+    expr
+    { $$ = $1; } ;
+
+/* the sliced expression is filled in by subs_expr */
+slice_range:
+    opt_expr ':' opt_expr
+    { $$ = context_arena.make<ast::Slice>(nullptr, $1, $3, nullptr); } |
+
+    opt_expr ':' opt_expr ':' opt_expr
+    { $$ = context_arena.make<ast::Slice>(nullptr, $1, $3, $5); } ;
 
 subs_expr:
     IDENTIFIER '[' expr ']'
-    { $$ = new ast::Subscript(new ast::Variable($1), $3); } |
+    { $$ = context_arena.make<ast::Subscript>(context_arena.make<ast::Variable>($1), $3); } |
 
     array_expr '[' expr ']'
-    { $$ = new ast::Subscript($1, $3); } |
+    { $$ = context_arena.make<ast::Subscript>($1, $3); } |
 
     call_expr '[' expr ']'
-    { $$ = new ast::Subscript($1, $3); } |
+    { $$ = context_arena.make<ast::Subscript>($1, $3); } |
+
+    member_expr '[' expr ']'
+    { $$ = context_arena.make<ast::Subscript>($1, $3); } |
 
     subs_expr '[' expr ']'
-    { $$ = new ast::Subscript($1, $3); } ;
+    { $$ = context_arena.make<ast::Subscript>($1, $3); } |
+
+    IDENTIFIER '[' slice_range ']'
+    { $$ = $3; $3->var = context_arena.make<ast::Variable>($1); } |
+
+    array_expr '[' slice_range ']'
+    { $$ = $3; $3->var = $1; } |
+
+    call_expr '[' slice_range ']'
+    { $$ = $3; $3->var = $1; } |
+
+    member_expr '[' slice_range ']'
+    { $$ = $3; $3->var = $1; } |
+
+    subs_expr '[' slice_range ']'
+    { $$ = $3; $3->var = $1; } ;
 
 expr:
     and_expr
     { $$ = $1; } |
 
     expr OR and_expr
-    { $$ = new ast::Or($1, $3); } ;
+    { $$ = context_arena.make<ast::Or>($1, $3); } ;
 
 and_expr:
     not_expr
     { $$ = $1; } |
 
     and_expr AND not_expr
-    { $$ = new ast::And($1, $3); } ;
+    { $$ = context_arena.make<ast::And>($1, $3); } ;
 
 not_expr:
     comp_expr
     { $$ = $1; } |
 
     NOT comp_expr
-    { $$ = new ast::Unary($1, $2); } ;
+    { $$ = context_arena.make<ast::Unary>($1, $2); } ;
 
 cmp_op:
     '<'
@@ -381,28 +563,28 @@ comp_expr:
     { $$ = $1; } |
 
     comp_expr cmp_op bitor_expr
-    { $$ = new ast::Binary($2, $1, $3); } ;
+    { $$ = context_arena.make<ast::Binary>($2, $1, $3); } ;
 
 bitor_expr:
     bitxor_expr
     { $$ = $1; } |
 
     bitor_expr '|' bitxor_expr
-    { $$ = new ast::Binary(T_BITOR, $1, $3); } ;
+    { $$ = context_arena.make<ast::Binary>(T_BITOR, $1, $3); } ;
 
 bitxor_expr:
     bitand_expr
     { $$ = $1; } |
 
     bitxor_expr '^' bitand_expr
-    { $$ = new ast::Binary(T_BITXOR, $1, $3); } ;
+    { $$ = context_arena.make<ast::Binary>(T_BITXOR, $1, $3); } ;
 
 bitand_expr:
     bitshift_expr
     { $$ = $1; } |
 
     bitand_expr '&' bitshift_expr
-    { $$ = new ast::Binary(T_BITAND, $1, $3); } ;
+    { $$ = context_arena.make<ast::Binary>(T_BITAND, $1, $3); } ;
 
 bitshift_op:
     T_LSHIFT
@@ -416,7 +598,7 @@ bitshift_expr:
     { $$ = $1; } |
 
     bitshift_expr bitshift_op arith_expr
-    { $$ = new ast::Binary($2, $1, $3); } ;
+    { $$ = context_arena.make<ast::Binary>($2, $1, $3); } ;
 
 arith_op:
     '+'
@@ -430,7 +612,7 @@ arith_expr:
     { $$ = $1; } |
 
     arith_expr arith_op term_expr
-    { $$ = new ast::Binary($2, $1, $3); } ;
+    { $$ = context_arena.make<ast::Binary>($2, $1, $3); } ;
 
 term_op:
     '*'
@@ -443,32 +625,45 @@ term_op:
     { $$ = T_MOD; } ;
 
 term_expr:
+    cast_expr
+    { $$ = $1; } |
+
+    term_expr term_op cast_expr
+    { $$ = context_arena.make<ast::Binary>($2, $1, $3); } ;
+
+cast_expr:
     power_expr
     { $$ = $1; } |
 
-    term_expr term_op power_expr
-    { $$ = new ast::Binary($2, $1, $3); } ;
+    cast_expr AS type
+    { $$ = context_arena.make<ast::Cast>($1, $3); } ;
 
 power_expr:
     sexpr
     { $$ = $1; } |
 
     power_expr T_POW sexpr
-    { $$ = new ast::Binary($2, $1, $3); } ;
+    { $$ = context_arena.make<ast::Binary>($2, $1, $3); } ;
 
 sexpr:
     '+' sexpr %prec T_BITNEG
-    { $$ = new ast::Unary(T_ADD, $2); } |
+    { $$ = context_arena.make<ast::Unary>(T_ADD, $2); } |
 
     '-' sexpr %prec T_BITNEG
-    { $$ = new ast::Unary(T_SUB, $2); } |
+    { $$ = context_arena.make<ast::Unary>(T_SUB, $2); } |
 
     T_BITNEG sexpr
-    { $$ = new ast::Unary(T_BITNEG, $2); } |
+    { $$ = context_arena.make<ast::Unary>(T_BITNEG, $2); } |
+
+    '*' sexpr %prec T_BITNEG
+    { $$ = context_arena.make<ast::New>($2); } |
 
     '(' expr ')'
     { $$ = $2; } |
 
+    '(' tuple_elems ')'
+    { $$ = context_arena.make<ast::Tuple>(static_cast<ast::ExprList*>($2)); } |
+
     array_expr
     { $$ = $1; } |
 
@@ -478,24 +673,27 @@ sexpr:
     subs_expr
     { $$ = $1; } |
 
+    member_expr
+    { $$ = $1; } |
+
     func_expr
     { $$ = $1; } |
 
     TRUE
-    { $$ = new ast::True(); } |
+    { $$ = context_arena.make<ast::True>(); } |
 
     FALSE
-    { $$ = new ast::False(); } |
+    { $$ = context_arena.make<ast::False>(); } |
 
     INTEGER
-    { $$ = new ast::Integer($1); } |
+    { $$ = context_arena.make<ast::Integer>($1); } |
 
     REAL
-    { $$ = new ast::Real($1); } |
+    { $$ = context_arena.make<ast::Real>($1); } |
 
     STRING
-    { $$ = new ast::String($1); } |
+    { $$ = context_arena.make<ast::String>($1); } |
 
     IDENTIFIER
-    { $$ = new ast::Variable($1); } ;
+    { $$ = context_arena.make<ast::Variable>($1); } ;
 %%
@@ -1,35 +1,151 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "mamba_context.h"
+#include "serialize.h"
 #include "lexer.h"
 
-MambaContext::MambaContext(): output(NULL) {
+#define READ_BLOCK_SIZE (64*1024)
+
+MambaContext::MambaContext(): output(NULL), num_errors(0), source(NULL), source_size(0), source_capacity(0), source_mapped(false) {
     yylex_init(&scanner);
     yyset_extra(this, scanner);
 }
 
 MambaContext::~MambaContext() {
     yylex_destroy(scanner);
-    if (output)
-        delete output;
+    releaseSource();
+}
+
+// Read a whole file into the source buffer without parsing it, parse()
+// then scans the loaded buffer.
+bool MambaContext::load(const char *name) {
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "cannot open " << name << std::endl;
+        return false;
+    }
+    bool ok = loadFile(fd);
+    close(fd);
+    return ok;
 }
 
 int MambaContext::parse(const char *name) {
-    if (name) {
-        input.open(name);
-    } else {
+    if (source != NULL) {
+        /* already loaded */
+    } else if (name) {
+        if (!load(name))
+            return 1;
+    } else if (isatty(STDIN_FILENO)) {
+        // interactive input is fed to flex one character at a time
+        // through YY_INPUT, so each line is parsed as soon as it is typed.
         input.copyfmt(std::cin);
         input.clear(std::cin.rdstate());
         input.basic_ios<char>::rdbuf(std::cin.rdbuf());
+        return yyparse(this);
+    } else if (!loadStream(STDIN_FILENO)) {
+        return 1;
+    }
+
+    // pre-parsed trees are loaded straight from the (mapped) buffer
+    if (ast::isSerialized(source, source_size)) {
+        output = ast::deserialize(source, source_size, arena);
+        if (output == NULL) {
+            addError("malformed AST file\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    YY_BUFFER_STATE buffer = yy_scan_buffer(source, source_size + 2, scanner);
+    int ret = yyparse(this);
+    yy_delete_buffer(buffer, scanner);
+
+    return ret;
+}
+
+bool MambaContext::loadFile(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        return false;
+    if (!S_ISREG(st.st_mode))
+        return loadStream(fd);
+
+    size_t size = st.st_size;
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    // Map the file directly when the zero-filled tail of its last page
+    // has room for the two NUL bytes flex expects at the end of the
+    // buffer, the mapping is private since flex writes into the buffer.
+    // A file filling its last page has no such tail, past EOF is unmapped.
+    if (size > 0 && size % page != 0 && page - size % page >= 2) {
+        void *addr = mmap(NULL, size + 2, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            source = (char *)addr;
+            source_size = size;
+            source_capacity = size + 2;
+            source_mapped = true;
+            return true;
+        }
+    }
+
+    source_capacity = size + 2;
+    source = (char *)malloc(source_capacity);
+    if (source == NULL)
+        return false;
+
+    while (source_size < size) {
+        ssize_t n = ::read(fd, source + source_size, size - source_size);
+        if (n < 0)
+            return false;
+        if (n == 0)
+            break;
+        source_size += n;
+    }
+    source[source_size] = source[source_size + 1] = '\0';
+
+    return true;
+}
+
+bool MambaContext::loadStream(int fd) {
+    for (;;) {
+        if (source_capacity < source_size + READ_BLOCK_SIZE + 2) {
+            size_t capacity = 2*source_capacity + READ_BLOCK_SIZE + 2;
+            char *grown = (char *)realloc(source, capacity);
+            if (grown == NULL)
+                return false;
+            source = grown;
+            source_capacity = capacity;
+        }
+
+        ssize_t n = ::read(fd, source + source_size, READ_BLOCK_SIZE);
+        if (n < 0)
+            return false;
+        if (n == 0)
+            break;
+        source_size += n;
     }
+    source[source_size] = source[source_size + 1] = '\0';
 
-    return yyparse(this);
+    return true;
+}
+
+void MambaContext::releaseSource() {
+    if (source_mapped)
+        munmap(source, source_capacity);
+    else
+        free(source);
+    source = NULL;
+    source_size = source_capacity = 0;
+    source_mapped = false;
 }
 
 int MambaContext::read(char *buf, int max_size) {
     if (input.eof() || input.fail())
         return 0;
 
-#define YY_INTERACTIVE
-#ifdef YY_INTERACTIVE
     input.get(buf[0]);
     if (input.eof())
         return 0;
@@ -37,11 +153,4 @@ int MambaContext::read(char *buf, int max_size) {
         return 0;//-1
     else
         return 1;
-#else
-    input.read(buf, max_size);
-    if (input.bad())
-        return 0;//-1
-    else
-        return input.gcount();
-#endif
 }
@@ -3,20 +3,61 @@
 
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <vector>
+#include "arena.h"
 #include "ast.h"
 
+/*
+ * Indentation and bracket tracking of the lexer. It lives in the
+ * context (the scanner's extra data) so that independent contexts can
+ * lex on different threads.
+ */
+struct LexerState {
+    std::vector<char> paren;
+    std::vector<int> indent;
+    int pending_indents;
+    int pending_dedents;
+
+    LexerState(): pending_indents(0), pending_dedents(0) { }
+};
+
 class MambaContext {
     private:
         std::ifstream input;
+        Arena arena;
         ast::Node *output;
         void *scanner;
+        LexerState lexer_state;
+        std::string errors;
+        int num_errors;
+
+        // whole-file input handed to flex with yy_scan_buffer, the
+        // buffer is either mmap'ed or read in large blocks and must end
+        // with two NUL bytes.
+        char *source;
+        size_t source_size;
+        size_t source_capacity;
+        bool source_mapped;
+
+        bool loadFile(int fd);
+        bool loadStream(int fd);
+        void releaseSource();
 
     public:
         MambaContext();
         virtual ~MambaContext();
+        bool load(const char *name);
         int parse(const char *name=NULL);
         int read(char *buf, int max_size);
+        const char *getSource() const { return source; }
+        size_t getSourceSize() const { return source_size; }
         void *getScanner() { return scanner; }
+        Arena &getArena() { return arena; }
+        LexerState &getLexerState() { return lexer_state; }
+        void addError(const std::string &msg) { errors += msg; num_errors++; }
+        const std::string &getErrors() const { return errors; }
+        int getNumErrors() const { return num_errors; }
         ast::Node *getOutput() { return output; }
         void setOutput(ast::Node *_output) { output = _output; }
 };
@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <llvm/PassManager.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/FormattedStream.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/ToolOutputFile.h>
+#include "native.h"
+
+#ifndef MAMBA_RUNTIME_DIR
+#define MAMBA_RUNTIME_DIR "runtime"
+#endif
+
+static llvm::CodeGenOpt::Level codegenLevel(const OptLevel &level) {
+    if (level.size > 0)
+        return llvm::CodeGenOpt::Default;
+    switch (level.speed) {
+        case 0: return llvm::CodeGenOpt::None;
+        case 1: return llvm::CodeGenOpt::Less;
+        case 2: return llvm::CodeGenOpt::Default;
+        default: return llvm::CodeGenOpt::Aggressive;
+    }
+}
+
+NativeBackend::NativeBackend(const OptLevel &level): triple(llvm::sys::getDefaultTargetTriple()) {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (target == nullptr)
+        return;
+
+    llvm::TargetOptions options;
+    machine.reset(target->createTargetMachine(triple, llvm::sys::getHostCPUName(), "", options,
+                llvm::Reloc::PIC_, llvm::CodeModel::Default, codegenLevel(level)));
+    if (!machine)
+        error = "no target machine for " + triple;
+}
+
+void NativeBackend::prepare(llvm::Module *module) {
+    module->setTargetTriple(triple);
+    module->setDataLayout(machine->getDataLayout());
+}
+
+const llvm::DataLayout *NativeBackend::hostDataLayout() {
+    static NativeBackend host;
+    return host.ok() ? host.machine->getDataLayout() : nullptr;
+}
+
+bool NativeBackend::emitObject(llvm::Module *module, const std::string &path) {
+    prepare(module);
+
+    llvm::tool_output_file out(path.c_str(), error, llvm::sys::fs::F_None);
+    if (!error.empty())
+        return false;
+
+    llvm::PassManager pm;
+    pm.add(new llvm::DataLayoutPass(*machine->getDataLayout()));
+    llvm::formatted_raw_ostream fos(out.os());
+    if (machine->addPassesToEmitFile(pm, fos, llvm::TargetMachine::CGFT_ObjectFile)) {
+        error = "target cannot emit object files";
+        return false;
+    }
+    pm.run(*module);
+    fos.flush();
+
+    out.keep();
+    return true;
+}
+
+// Link with the system compiler driver, which knows where the C
+// library and the startup files live.
+bool NativeBackend::link(const std::vector<std::string> &objects, const std::string &output) {
+    const char *cxx = getenv("CXX");
+    std::vector<std::string> args;
+    args.push_back(cxx ? cxx : "c++");
+    args.push_back("-o");
+    args.push_back(output);
+    args.insert(args.end(), objects.begin(), objects.end());
+    args.push_back("-L" MAMBA_RUNTIME_DIR);
+    args.push_back("-lmamba_rt");
+
+    std::vector<char *> argv;
+    for (auto &a: args)
+        argv.push_back(const_cast<char *>(a.c_str()));
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        error = "cannot run the linker";
+        return false;
+    }
+    if (pid == 0) {
+        execvp(argv[0], &argv[0]);
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        error = "linking " + output + " failed";
+        return false;
+    }
+    return true;
+}
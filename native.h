@@ -0,0 +1,40 @@
+#ifndef __NATIVE_H__
+#define __NATIVE_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+#include "optimizer.h"
+
+/*
+ * Ahead of time backend. Lowers a module through the TargetMachine of
+ * the host to an object file and links objects together with the
+ * runtime library into a standalone executable, so a program starts
+ * without going through the JIT.
+ */
+class NativeBackend {
+    private:
+        std::unique_ptr<llvm::TargetMachine> machine;
+        std::string triple;
+        std::string error;
+
+    public:
+        NativeBackend(const OptLevel &level = OptLevel());
+
+        bool ok() const { return machine != nullptr; }
+        const std::string &getError() const { return error; }
+
+        // Data layout of the host, or null without a target for it.
+        static const llvm::DataLayout *hostDataLayout();
+
+        // Set the triple and data layout of the target, before any pass
+        // runs over module.
+        void prepare(llvm::Module *module);
+
+        bool emitObject(llvm::Module *module, const std::string &path);
+        bool link(const std::vector<std::string> &objects, const std::string &output);
+};
+
+#endif//__NATIVE_H__
@@ -0,0 +1,105 @@
+#include <llvm/Pass.h>
+#include <llvm/Analysis/Passes.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/Transforms/Scalar.h>
+#include "bounds.h"
+#include "optimizer.h"
+#include "refcount.h"
+
+bool OptLevel::parse(const std::string &flag, OptLevel &level) {
+    if (flag.size() != 3 || flag[0] != '-' || flag[1] != 'O')
+        return false;
+    if (flag[2] >= '0' && flag[2] <= '3')
+        level = OptLevel(flag[2] - '0', 0);
+    else if (flag[2] == 's')
+        level = OptLevel(2, 1);
+    else
+        return false;
+    return true;
+}
+
+std::string OptLevel::str() const {
+    if (size > 0)
+        return "Os";
+    return std::string("O") + char('0' + speed);
+}
+
+void OptLevel::addFunctionPasses(llvm::FunctionPassManager &fpm) const {
+    if (speed == 0)
+        return;
+
+    fpm.add(llvm::createTypeBasedAliasAnalysisPass());
+    fpm.add(llvm::createBasicAliasAnalysisPass());
+    fpm.add(llvm::createSROAPass());
+    fpm.add(createRefcountPass());
+    fpm.add(llvm::createEarlyCSEPass());
+    fpm.add(llvm::createInstructionCombiningPass());
+    fpm.add(llvm::createCFGSimplificationPass());
+    fpm.add(llvm::createReassociatePass());
+
+    if (speed >= 2) {
+        fpm.add(llvm::createJumpThreadingPass());
+        fpm.add(llvm::createCorrelatedValuePropagationPass());
+        fpm.add(llvm::createLoopRotatePass());
+        fpm.add(llvm::createLICMPass());
+        fpm.add(llvm::createLoopUnswitchPass(size > 0));
+        fpm.add(llvm::createInstructionCombiningPass());
+        fpm.add(llvm::createIndVarSimplifyPass());
+        fpm.add(llvm::createLoopIdiomPass());
+        fpm.add(llvm::createLoopDeletionPass());
+        if (size == 0)
+            fpm.add(llvm::createLoopUnrollPass());
+    }
+
+    fpm.add(llvm::createGVNPass());
+    // GVN merges the reads of an array length the checks compare with
+    fpm.add(createBoundsCheckPass());
+
+    if (speed >= 2) {
+        fpm.add(llvm::createSCCPPass());
+        fpm.add(llvm::createInstructionCombiningPass());
+        fpm.add(llvm::createJumpThreadingPass());
+        fpm.add(llvm::createDeadStoreEliminationPass());
+        fpm.add(llvm::createAggressiveDCEPass());
+    }
+
+    fpm.add(llvm::createCFGSimplificationPass());
+    fpm.add(llvm::createInstructionCombiningPass());
+
+    if (speed >= 2)
+        fpm.add(llvm::createTailCallEliminationPass());
+}
+
+// Inlining leaves objects a callee returned local to the caller, and
+// the length of an array it was given in plain sight. This runs before
+// the loop vectorizer.
+static void addMambaPasses(const llvm::PassManagerBuilder &, llvm::PassManagerBase &pm) {
+    pm.add(createRefcountPass());
+    pm.add(createBoundsCheckPass());
+}
+
+void OptLevel::addModulePasses(llvm::PassManagerBase &pm) const {
+    llvm::PassManagerBuilder builder;
+    builder.OptLevel = speed;
+    builder.SizeLevel = size;
+    builder.DisableUnrollLoops = speed < 2 || size > 0;
+    builder.LoopVectorize = speed >= 3;
+    builder.SLPVectorize = speed >= 3;
+
+    // below -O2 only functions marked alwaysinline are inlined
+    if (speed >= 2)
+        builder.Inliner = llvm::createFunctionInliningPass(speed, size);
+    else
+        builder.Inliner = llvm::createAlwaysInlinerPass();
+
+    builder.addExtension(llvm::PassManagerBuilder::EP_ScalarOptimizerLate, addMambaPasses);
+
+    // at -O1 and up this brings SROA, LICM, loop unrolling and dead
+    // argument elimination along with the inliner
+    builder.populateModulePassManager(pm);
+}
+
+void OptLevel::enableTiming() {
+    llvm::TimePassesIsEnabled = true;
+}
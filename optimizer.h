@@ -0,0 +1,35 @@
+#ifndef __OPTIMIZER_H__
+#define __OPTIMIZER_H__
+
+#include <string>
+#include <llvm/PassManager.h>
+
+/*
+ * Optimization level, as given by -O0 to -O3 or -Os, and the pass
+ * pipelines it selects. Function passes run on every function as it is
+ * generated, module passes over a whole module before it is written out;
+ * they carry the interprocedural work: inlining and dead argument
+ * elimination. The JIT only uses the level to turn tiering on, see
+ * TieredJIT.
+ */
+class OptLevel {
+    public:
+        unsigned speed;
+        unsigned size;
+
+        OptLevel(unsigned _speed = 2, unsigned _size = 0): speed(_speed), size(_size) { }
+
+        // -O0 .. -O3, -Os
+        static bool parse(const std::string &flag, OptLevel &level);
+        std::string str() const;
+
+        bool enabled() const { return speed > 0 || size > 0; }
+
+        void addFunctionPasses(llvm::FunctionPassManager &fpm) const;
+        void addModulePasses(llvm::PassManagerBase &pm) const;
+
+        // Collect the time spent in every pass, reported at exit.
+        static void enableTiming();
+};
+
+#endif//__OPTIMIZER_H__
@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <llvm/Analysis/ConstantFolding.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include "refcount.h"
+
+using ::llvm::BasicBlock;
+using ::llvm::CallInst;
+using ::llvm::DataLayout;
+using ::llvm::Function;
+using ::llvm::Instruction;
+using ::llvm::IRBuilder;
+using ::llvm::Module;
+using ::llvm::Value;
+
+namespace {
+
+class RefcountOpt: public llvm::FunctionPass {
+    private:
+        Function *alloc, *retain, *release, *dealloc;
+        Function *retain_local, *release_local;
+
+        Function *callee(Instruction *inst) {
+            CallInst *call = llvm::dyn_cast<CallInst>(inst);
+            return call ? call->getCalledFunction() : nullptr;
+        }
+
+        static Value *object(CallInst *call) {
+            return call->getArgOperand(0)->stripPointerCasts();
+        }
+
+        Function *defineLocal(Module &M, const char *name, bool inc);
+        bool cancelPairs(BasicBlock &block);
+        bool isLocal(Instruction *obj, std::vector<CallInst *> &counts);
+        bool promote(Instruction *obj, std::vector<CallInst *> &counts, const DataLayout *DL);
+
+    public:
+        static char ID;
+        // larger objects stay on the heap, deep recursion must not
+        // exhaust the stack
+        static const uint64_t MAX_STACK_OBJECT = 1024;
+        static const unsigned MAMBA_ALIGN = 16;
+
+        RefcountOpt(): FunctionPass(ID), alloc(nullptr), retain(nullptr), release(nullptr), dealloc(nullptr),
+            retain_local(nullptr), release_local(nullptr) { }
+
+        virtual bool doInitialization(Module &M);
+        virtual bool runOnFunction(Function &F);
+};
+
+char RefcountOpt::ID = 0;
+
+/*
+ * define internal void @name(i8 *obj) alwaysinline {
+ *     %count = getelementptr (bitcast obj to i64*), -1
+ *     %n = add/sub (load %count), 1
+ *     store %n, %count
+ *     ; release only
+ *     br (%n == 0), %free, %done
+ * free:
+ *     call @mamba_free(obj)
+ * }
+ */
+Function *RefcountOpt::defineLocal(Module &M, const char *name, bool inc) {
+    if (Function *func = M.getFunction(name))
+        return func;
+
+    llvm::LLVMContext &ctx = M.getContext();
+    Function *func = Function::Create(dealloc->getFunctionType(), Function::InternalLinkage, name, &M);
+    func->addFnAttr(llvm::Attribute::AlwaysInline);
+    IRBuilder<> b(BasicBlock::Create(ctx, "entry", func));
+
+    Value *obj = func->arg_begin();
+    Value *count = b.CreateGEP(b.CreateBitCast(obj, b.getInt64Ty()->getPointerTo()), b.getInt64(-1), "count");
+    Value *n = b.CreateLoad(count);
+    n = inc ? b.CreateAdd(n, b.getInt64(1)) : b.CreateSub(n, b.getInt64(1));
+    b.CreateStore(n, count);
+    if (inc) {
+        b.CreateRetVoid();
+        return func;
+    }
+
+    BasicBlock *free_block = BasicBlock::Create(ctx, "free", func);
+    BasicBlock *done = BasicBlock::Create(ctx, "done", func);
+    b.CreateCondBr(b.CreateICmpEQ(n, b.getInt64(0)), free_block, done);
+    b.SetInsertPoint(free_block);
+    b.CreateCall(dealloc, obj);
+    b.CreateBr(done);
+    b.SetInsertPoint(done);
+    b.CreateRetVoid();
+    return func;
+}
+
+bool RefcountOpt::doInitialization(Module &M) {
+    alloc = M.getFunction("mamba_alloc");
+    retain = M.getFunction("mamba_retain");
+    release = M.getFunction("mamba_release");
+    dealloc = M.getFunction("mamba_free");
+    if (!alloc || !retain || !release || !dealloc)
+        return false;
+
+    retain_local = defineLocal(M, "mamba.retain.local", true);
+    release_local = defineLocal(M, "mamba.release.local", false);
+    return true;
+}
+
+bool RefcountOpt::cancelPairs(BasicBlock &block) {
+    std::map<Value *, CallInst *> pending;
+    std::vector<Instruction *> dead;
+    for (auto &inst: block) {
+        Function *func = callee(&inst);
+        if (func == retain) {
+            pending[object(llvm::cast<CallInst>(&inst))] = llvm::cast<CallInst>(&inst);
+        } else if (func == release) {
+            auto it = pending.find(object(llvm::cast<CallInst>(&inst)));
+            if (it != pending.end()) {
+                dead.push_back(it->second);
+                dead.push_back(&inst);
+                pending.erase(it);
+                continue;
+            }
+            pending.clear();
+        } else if (llvm::isa<CallInst>(&inst) || llvm::isa<llvm::InvokeInst>(&inst)) {
+            // may drop the reference the pending retain stands for
+            pending.clear();
+        }
+    }
+    for (auto inst: dead)
+        inst->eraseFromParent();
+    return !dead.empty();
+}
+
+// An object does not escape when its pointer is only cast, offset,
+// compared, loaded and stored through, and passed to the counting calls,
+// which are collected in counts. The pointer may also sit in a field of
+// an aggregate, like the buffer of an array, as long as only that field
+// is read back out.
+bool RefcountOpt::isLocal(Instruction *obj, std::vector<CallInst *> &counts) {
+    typedef std::vector<unsigned> path_t;
+    // a value and where the pointer is inside it, empty for the pointer
+    std::vector<std::pair<Value *, path_t> > work(1, std::make_pair(obj, path_t()));
+    while (!work.empty()) {
+        Value *val = work.back().first;
+        path_t path = work.back().second;
+        work.pop_back();
+        for (auto it = val->use_begin(); it != val->use_end(); ++it) {
+            llvm::User *user = it->getUser();
+            if (llvm::InsertValueInst *insert = llvm::dyn_cast<llvm::InsertValueInst>(user)) {
+                path_t fields(insert->idx_begin(), insert->idx_end());
+                if (it->getOperandNo() == 1)
+                    fields.insert(fields.end(), path.begin(), path.end());
+                else if (fields == path)
+                    continue;   // the pointer is overwritten
+                else
+                    fields = path;
+                work.push_back(std::make_pair(insert, fields));
+            } else if (llvm::ExtractValueInst *extract = llvm::dyn_cast<llvm::ExtractValueInst>(user)) {
+                path_t fields(extract->idx_begin(), extract->idx_end());
+                if (fields.size() <= path.size() && std::equal(fields.begin(), fields.end(), path.begin()))
+                    work.push_back(std::make_pair(extract, path_t(path.begin() + fields.size(), path.end())));
+            } else if (!path.empty()) {
+                return false;
+            } else if (llvm::isa<llvm::BitCastInst>(user) || llvm::isa<llvm::GetElementPtrInst>(user)) {
+                work.push_back(std::make_pair(user, path_t()));
+            } else if (llvm::isa<llvm::LoadInst>(user) || llvm::isa<llvm::ICmpInst>(user)) {
+                continue;
+            } else if (llvm::StoreInst *store = llvm::dyn_cast<llvm::StoreInst>(user)) {
+                if (store->getValueOperand() == val)
+                    return false;
+            } else if (CallInst *call = llvm::dyn_cast<CallInst>(user)) {
+                Function *func = call->getCalledFunction();
+                if (func != retain && func != release && func != dealloc)
+                    return false;
+                counts.push_back(call);
+            } else {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * Move a local object to a slot in the entry block, without a header
+ * and without counting. The slot is as big as the constant size the
+ * object was allocated with, and aligned like the heap. A slot is
+ * reused when the allocation runs again, which is safe because the old
+ * object could only be reached through a phi, and phis escape.
+ */
+bool RefcountOpt::promote(Instruction *obj, std::vector<CallInst *> &counts, const DataLayout *DL) {
+    Value *size = llvm::cast<CallInst>(obj)->getArgOperand(0);
+    if (llvm::ConstantExpr *expr = llvm::dyn_cast<llvm::ConstantExpr>(size))
+        size = llvm::ConstantFoldConstantExpression(expr, DL);
+    llvm::ConstantInt *bytes = llvm::dyn_cast_or_null<llvm::ConstantInt>(size);
+    if (bytes == nullptr || bytes->getZExtValue() > MAX_STACK_OBJECT)
+        return false;
+
+    BasicBlock &entry = obj->getParent()->getParent()->getEntryBlock();
+    llvm::Type *type = llvm::ArrayType::get(llvm::Type::getInt8Ty(obj->getContext()), bytes->getZExtValue());
+    llvm::AllocaInst *slot = new llvm::AllocaInst(type, obj->getName() + ".stack", entry.begin());
+    slot->setAlignment(MAMBA_ALIGN);
+    for (auto call: counts)
+        call->eraseFromParent();
+    obj->replaceAllUsesWith(new llvm::BitCastInst(slot, obj->getType(), "", obj));
+    obj->eraseFromParent();
+    return true;
+}
+
+bool RefcountOpt::runOnFunction(Function &F) {
+    if (alloc == nullptr)
+        return false;
+
+    bool changed = false;
+    for (auto &block: F)
+        changed |= cancelPairs(block);
+
+    std::vector<Instruction *> objects;
+    for (auto &block: F)
+        for (auto &inst: block)
+            if (callee(&inst) == alloc)
+                objects.push_back(&inst);
+
+    // folds the size of a type, without it only plain constants promote
+    const DataLayout *DL = F.getParent()->getDataLayout();
+    if (llvm::DataLayoutPass *DLP = getAnalysisIfAvailable<llvm::DataLayoutPass>())
+        DL = &DLP->getDataLayout();
+
+    for (auto obj: objects) {
+        std::vector<CallInst *> counts;
+        if (!isLocal(obj, counts))
+            continue;
+        if (promote(obj, counts, DL)) {
+            changed = true;
+            continue;
+        }
+
+        bool retained = false;
+        for (auto call: counts)
+            retained |= call->getCalledFunction() == retain;
+
+        for (auto call: counts) {
+            Function *func = call->getCalledFunction();
+            if (func == retain)
+                call->setCalledFunction(retain_local);
+            else if (func == release)
+                call->setCalledFunction(retained ? release_local : dealloc);
+            else
+                continue;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+}
+
+llvm::FunctionPass *createRefcountPass() {
+    return new RefcountOpt();
+}
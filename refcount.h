@@ -0,0 +1,25 @@
+#ifndef __REFCOUNT_H__
+#define __REFCOUNT_H__
+
+#include <llvm/Pass.h>
+
+/*
+ * Cleans up the reference counting Codegen emits for heap objects. It
+ * needs SSA form, so it runs after mem2reg or SROA.
+ *
+ *  - A retain followed in the same block by a release of the same
+ *    object cancels out, unless a call in between could drop another
+ *    reference to it.
+ *  - An object allocated in the function that never leaves it, except
+ *    through the counting calls, does not outlive the call. It moves to
+ *    the stack frame, where SROA can break it up, and its counting goes
+ *    away.
+ *  - A local object too large for the frame is still not reachable from
+ *    another thread. Its count is updated in place, without atomics,
+ *    which once inlined lets GVN and instcombine fold most of it away.
+ *  - If such an object is never retained it has a single owner and is
+ *    freed directly, without counting at all.
+ */
+llvm::FunctionPass *createRefcountPass();
+
+#endif//__REFCOUNT_H__
@@ -0,0 +1,238 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <mutex>
+#include "runtime.h"
+
+/*
+ * Default heap allocator of the runtime. Objects up to 4KB come from
+ * slabs split in blocks of a fixed size class, larger ones straight from
+ * malloc. Every thread keeps a free list per class and trades blocks in
+ * batches with a shared list, so most allocations and frees take no
+ * lock. Slabs are never given back to the system.
+ *
+ * The allocator only defines the functions declared with it in
+ * runtime.h. An object file defining them, linked before libmamba_rt.a,
+ * replaces it.
+ */
+
+namespace {
+
+// The header before every object, MAMBA_HEADER bytes. The count is
+// managed by mamba_retain and mamba_release.
+struct Header {
+    uint32_t cls;
+    uint32_t unused;
+    int64_t count;
+};
+
+// next free block, stored in the object of a free block
+struct Block {
+    Block *next;
+};
+
+const uint32_t CLASS_SIZES[] = {
+    16, 32, 48, 64, 80, 96, 112, 128, 144, 160, 176, 192, 208, 224, 240, 256,
+    384, 512, 768, 1024, 1536, 2048, 3072, 4096
+};
+const uint32_t NUM_CLASSES = sizeof(CLASS_SIZES)/sizeof(CLASS_SIZES[0]);
+const uint32_t LARGE = 0xffffffff;
+const uint32_t ARENA = 0xfffffffe;
+
+const size_t SLAB_SIZE = 64*1024;
+const size_t ARENA_CHUNK = 64*1024;
+// blocks moved between a thread and the shared list at once
+const uint32_t BATCH = 32;
+
+uint32_t sizeClass(uint64_t size) {
+    if (size <= 256)
+        return size == 0 ? 0 : (size - 1)/16;
+    for (uint32_t c = 16; c < NUM_CLASSES; c++)
+        if (size <= CLASS_SIZES[c])
+            return c;
+    return LARGE;
+}
+
+Header *header(void *obj) {
+    return (Header *)obj - 1;
+}
+
+void *object(Header *h) {
+    return h + 1;
+}
+
+void *allocate(size_t size) {
+    void *block = malloc(size);
+    if (block == NULL)
+        mamba_panic("out of memory");
+    return block;
+}
+
+struct Central {
+    std::mutex lock;
+    Block *free;
+};
+
+Central central[NUM_CLASSES];
+
+// A new slab, with all its blocks on the shared list. Called with the
+// lock of the class held.
+void grow(uint32_t cls) {
+    size_t size = MAMBA_HEADER + CLASS_SIZES[cls];
+    char *slab = (char *)allocate(SLAB_SIZE);
+    for (char *b = slab; b + size <= slab + SLAB_SIZE; b += size) {
+        Header *h = (Header *)b;
+        h->cls = cls;
+        Block *block = (Block *)object(h);
+        block->next = central[cls].free;
+        central[cls].free = block;
+    }
+}
+
+// Trivially destructible, so it stays usable while the thread exits.
+struct Cache {
+    Block *free[NUM_CLASSES];
+    uint32_t size[NUM_CLASSES];
+    bool exiting;
+};
+
+thread_local Cache cache;
+
+// Move n blocks of a class from the thread to the shared list.
+void flush(uint32_t cls, uint32_t n) {
+    std::lock_guard<std::mutex> guard(central[cls].lock);
+    for (; n > 0 && cache.free[cls]; n--) {
+        Block *block = cache.free[cls];
+        cache.free[cls] = block->next;
+        cache.size[cls]--;
+        block->next = central[cls].free;
+        central[cls].free = block;
+    }
+}
+
+// Hands the blocks of a thread back when it exits.
+struct Reaper {
+    bool armed;
+    ~Reaper() {
+        for (uint32_t c = 0; c < NUM_CLASSES; c++)
+            flush(c, cache.size[c]);
+        cache.exiting = true;
+    }
+};
+
+thread_local Reaper reaper;
+
+void refill(uint32_t cls) {
+    reaper.armed = true;
+    std::lock_guard<std::mutex> guard(central[cls].lock);
+    for (uint32_t n = 0; n < BATCH; n++) {
+        if (central[cls].free == NULL)
+            grow(cls);
+        Block *block = central[cls].free;
+        central[cls].free = block->next;
+        block->next = cache.free[cls];
+        cache.free[cls] = block;
+        cache.size[cls]++;
+    }
+}
+
+/*
+ * Allocations of a thread inside an arena scope bump a pointer through
+ * chunks of the arena, which are freed together when the scope ends.
+ * Scopes nest, the innermost one is used.
+ */
+struct Chunk {
+    Chunk *next;
+};
+
+struct Arena {
+    Arena *outer;
+    Chunk *chunks;
+    char *ptr, *end;
+};
+
+thread_local Arena *arena;
+
+void *arenaAlloc(uint64_t size) {
+    size = MAMBA_HEADER + (size + 15)/16*16;
+    if (arena->end - arena->ptr < (ptrdiff_t)size) {
+        size_t chunk = size > ARENA_CHUNK - MAMBA_HEADER ? size + MAMBA_HEADER : ARENA_CHUNK;
+        Chunk *c = (Chunk *)allocate(chunk);
+        c->next = arena->chunks;
+        arena->chunks = c;
+        // keep objects aligned past the chunk link
+        arena->ptr = (char *)c + MAMBA_HEADER;
+        arena->end = (char *)c + chunk;
+    }
+    Header *h = (Header *)arena->ptr;
+    arena->ptr += size;
+    h->cls = ARENA;
+    return object(h);
+}
+
+}
+
+void *mamba_alloc(uint64_t size) {
+    Header *h;
+    uint32_t cls = sizeClass(size);
+    if (arena) {
+        h = header(arenaAlloc(size));
+    } else if (cls == LARGE) {
+        h = (Header *)allocate(MAMBA_HEADER + size);
+        h->cls = LARGE;
+    } else {
+        if (cache.free[cls] == NULL)
+            refill(cls);
+        Block *block = cache.free[cls];
+        cache.free[cls] = block->next;
+        cache.size[cls]--;
+        h = header(block);
+    }
+    h->count = 1;
+    return object(h);
+}
+
+void mamba_free(void *obj) {
+    Header *h = header(obj);
+    if (h->cls == ARENA)
+        return;
+    if (h->cls == LARGE) {
+        free(h);
+        return;
+    }
+
+    uint32_t cls = h->cls;
+    Block *block = (Block *)obj;
+    block->next = cache.free[cls];
+    cache.free[cls] = block;
+    cache.size[cls]++;
+    if (cache.exiting) {
+        flush(cls, cache.size[cls]);
+        return;
+    }
+    // a thread that only frees also caches blocks to hand back, and
+    // should not hoard those others allocate
+    reaper.armed = true;
+    if (cache.size[cls] > 2*BATCH)
+        flush(cls, BATCH);
+}
+
+void mamba_arena_push() {
+    Arena *a = (Arena *)allocate(sizeof(Arena));
+    a->outer = arena;
+    a->chunks = NULL;
+    a->ptr = a->end = NULL;
+    arena = a;
+}
+
+void mamba_arena_pop() {
+    Arena *a = arena;
+    if (a == NULL)
+        mamba_panic("no arena scope to end");
+    while (a->chunks) {
+        Chunk *c = a->chunks;
+        a->chunks = c->next;
+        free(c);
+    }
+    arena = a->outer;
+    free(a);
+}
@@ -0,0 +1,63 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "runtime.h"
+
+void mamba_print_bool(int32_t val) {
+    fputs(val ? "true\n" : "false\n", stdout);
+}
+
+void mamba_print_int(int32_t val) {
+    printf("%" PRId32 "\n", val);
+}
+
+void mamba_print_int64(int64_t val) {
+    printf("%" PRId64 "\n", val);
+}
+
+void mamba_print_float(float val) {
+    printf("%g\n", val);
+}
+
+void mamba_print_float64(double val) {
+    printf("%g\n", val);
+}
+
+void mamba_print_str(const char *val) {
+    puts(val);
+}
+
+void mamba_panic(const char *msg) {
+    fflush(stdout);
+    fprintf(stderr, "panic: %s\n", msg);
+    abort();
+}
+
+void mamba_bounds_fail(int64_t idx, int64_t len) {
+    char msg[80];
+    snprintf(msg, sizeof(msg), "index %" PRId64 " out of bounds for length %" PRId64, idx, len);
+    mamba_panic(msg);
+}
+
+void mamba_slice_fail(int64_t lo, int64_t hi, int64_t step, int64_t len) {
+    char msg[120];
+    snprintf(msg, sizeof(msg), "slice [%" PRId64 ":%" PRId64 ":%" PRId64 "] out of bounds for length %" PRId64, lo, hi, step, len);
+    mamba_panic(msg);
+}
+
+static int64_t *count(void *obj) {
+    return (int64_t *)obj - 1;
+}
+
+void mamba_retain(void *obj) {
+    __atomic_add_fetch(count(obj), 1, __ATOMIC_RELAXED);
+}
+
+void mamba_release(void *obj) {
+    if (__atomic_sub_fetch(count(obj), 1, __ATOMIC_ACQ_REL) == 0)
+        mamba_free(obj);
+}
+
+int32_t mamba_release_last(void *obj) {
+    return __atomic_sub_fetch(count(obj), 1, __ATOMIC_ACQ_REL) == 0;
+}
@@ -0,0 +1,47 @@
+#ifndef __RUNTIME_H__
+#define __RUNTIME_H__
+
+#include <stdint.h>
+
+/*
+ * Mamba runtime library. Generated code calls these by their C names,
+ * the JIT maps them to this process, executables link against
+ * libmamba_rt.a.
+ */
+extern "C" {
+    void mamba_print_bool(int32_t val);
+    void mamba_print_int(int32_t val);
+    void mamba_print_int64(int64_t val);
+    void mamba_print_float(float val);
+    void mamba_print_float64(double val);
+    void mamba_print_str(const char *val);
+
+    // report a fatal error and abort
+    void mamba_panic(const char *msg);
+    void mamba_bounds_fail(int64_t idx, int64_t len);
+    void mamba_slice_fail(int64_t lo, int64_t hi, int64_t step, int64_t len);
+
+    // Reference counted heap objects. The count is an int64_t right
+    // before the object, MAMBA_HEADER bytes hold it to keep the object
+    // aligned. A new object has a count of one. Retain and release are
+    // atomic; code that knows an object stays on one thread updates the
+    // count in place instead.
+    void mamba_retain(void *obj);
+    void mamba_release(void *obj);
+    // Like release, but the last reference returns 1 instead of freeing
+    // obj, so the caller can release what it holds before mamba_free.
+    int32_t mamba_release_last(void *obj);
+
+    // The allocator, in alloc.cc, which a program may replace at link
+    // time. Between a push and its pop the allocations of a thread come
+    // from an arena, freed all at once by the pop. Objects from an arena
+    // must not outlive it.
+    void *mamba_alloc(uint64_t size);
+    void mamba_free(void *obj);
+    void mamba_arena_push();
+    void mamba_arena_pop();
+}
+
+#define MAMBA_HEADER 16
+
+#endif//__RUNTIME_H__
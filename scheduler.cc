@@ -0,0 +1,101 @@
+#include "scheduler.h"
+
+namespace {
+    // index of the worker running on this thread, -1 outside the pool
+    thread_local int current_worker = -1;
+    thread_local const void *current_scheduler = nullptr;
+}
+
+Scheduler::Scheduler(unsigned num_workers): queued(0), pending(0), next_victim(0), stopping(false) {
+    if (num_workers == 0)
+        num_workers = 1;
+    for (unsigned i = 0; i < num_workers; i++)
+        workers.push_back(std::unique_ptr<Worker>(new Worker()));
+    for (unsigned i = 0; i < num_workers; i++)
+        threads.push_back(std::thread(&Scheduler::run, this, i));
+}
+
+Scheduler::~Scheduler() {
+    wait();
+    {
+        std::lock_guard<std::mutex> guard(idle_lock);
+        stopping = true;
+    }
+    idle_cv.notify_all();
+    for (auto &t: threads)
+        t.join();
+}
+
+void Scheduler::spawn(Task task) {
+    unsigned id;
+    if (current_scheduler == this)
+        id = current_worker;
+    else
+        id = next_victim++ % workers.size();
+
+    // count the task before publishing it so a worker that grabs it
+    // right away never sees queued drop below zero
+    pending++;
+    {
+        std::lock_guard<std::mutex> guard(idle_lock);
+        queued++;
+    }
+    {
+        std::lock_guard<std::mutex> guard(workers[id]->lock);
+        workers[id]->tasks.push_back(std::move(task));
+    }
+    idle_cv.notify_one();
+}
+
+// Block until every spawned task, including tasks spawned by tasks, has
+// finished. Must not be called from inside a task.
+void Scheduler::wait() {
+    std::unique_lock<std::mutex> guard(idle_lock);
+    done_cv.wait(guard, [this]() { return pending == 0; });
+}
+
+bool Scheduler::pop(unsigned id, Task &task) {
+    Worker &w = *workers[id];
+    std::lock_guard<std::mutex> guard(w.lock);
+    if (w.tasks.empty())
+        return false;
+    task = std::move(w.tasks.back());
+    w.tasks.pop_back();
+    return true;
+}
+
+bool Scheduler::steal(unsigned id, Task &task) {
+    for (unsigned i = 1; i < workers.size(); i++) {
+        Worker &w = *workers[(id + i) % workers.size()];
+        std::lock_guard<std::mutex> guard(w.lock);
+        if (!w.tasks.empty()) {
+            task = std::move(w.tasks.front());
+            w.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Scheduler::run(unsigned id) {
+    current_worker = id;
+    current_scheduler = this;
+
+    for (;;) {
+        Task task;
+        if (pop(id, task) || steal(id, task)) {
+            queued--;
+            task();
+            if (--pending == 0) {
+                std::lock_guard<std::mutex> guard(idle_lock);
+                done_cv.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(idle_lock);
+        idle_cv.wait(guard, [this]() { return stopping || queued > 0; });
+        if (stopping && queued == 0)
+            return;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Work-stealing task scheduler. Every worker owns a deque: it pushes and
+ * pops its own tasks at the back and, once it runs dry, steals from the
+ * front of the other workers' deques. Tasks spawned from inside a task
+ * stay on the spawning worker, so related work keeps its locality while
+ * idle workers balance the load.
+ */
+class Scheduler {
+    public:
+        typedef std::function<void()> Task;
+
+        Scheduler(unsigned num_workers = std::thread::hardware_concurrency());
+        ~Scheduler();
+
+        void spawn(Task task);
+        void wait();
+        unsigned size() const { return workers.size(); }
+
+    private:
+        struct Worker {
+            std::mutex lock;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<Worker> > workers;
+        std::vector<std::thread> threads;
+        std::atomic<size_t> queued;
+        std::atomic<size_t> pending;
+        std::atomic<unsigned> next_victim;
+        bool stopping;
+
+        std::mutex idle_lock;
+        std::condition_variable idle_cv;
+        std::condition_variable done_cv;
+
+        bool pop(unsigned id, Task &task);
+        bool steal(unsigned id, Task &task);
+        void run(unsigned id);
+
+        Scheduler(const Scheduler &);
+        Scheduler &operator=(const Scheduler &);
+};
+
+#endif//__SCHEDULER_H__
@@ -0,0 +1,518 @@
+#include <string.h>
+#include <vector>
+#include "serialize.h"
+#include "mamba_context.h"
+
+namespace ast {
+
+static const char MAGIC[4] = {'M', 'A', 'S', 'T'};
+static const uint64_t VERSION = 4;
+// deeper trees are malformed, reading them would overflow the stack
+static const unsigned MAX_DEPTH = 4096;
+
+// operator tokens in the order they are numbered in the file, only append
+static const int OPERATORS[] = {
+    T_LT, T_GT, T_LE, T_GE, T_EQ, T_NE, T_ADD, T_SUB, T_MUL, T_DIV, T_MOD,
+    T_POW, T_LSHIFT, T_RSHIFT, T_BITAND, T_BITOR, T_BITXOR, T_BITNEG, NOT
+};
+static const size_t NUM_OPERATORS = sizeof(OPERATORS)/sizeof(OPERATORS[0]);
+
+class Writer: public Visitor {
+private:
+    std::string body;
+    std::vector<symbol_t> symbols;
+    std::vector<uint32_t> local_ids;
+
+    void byte(uint8_t b) {
+        body.push_back(b);
+    }
+
+    void uint(uint64_t v) {
+        while (v >= 0x80) {
+            byte(v | 0x80);
+            v >>= 7;
+        }
+        byte(v);
+    }
+
+    void sint(int64_t v) {
+        uint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+    }
+
+    void text(const char *str, size_t len) {
+        uint(len);
+        body.append(str, len);
+    }
+
+    void symbol(symbol_t sym) {
+        if (sym >= local_ids.size())
+            local_ids.resize(Symbols::size(), 0);
+        if (local_ids[sym] == 0) {
+            symbols.push_back(sym);
+            local_ids[sym] = symbols.size();
+        }
+        uint(local_ids[sym] - 1);
+    }
+
+    void op(int token) {
+        size_t i = 0;
+        while (i < NUM_OPERATORS && OPERATORS[i] != token)
+            i++;
+        uint(i);
+    }
+
+    void tag(NodeTag t) {
+        byte(t);
+    }
+
+    void node(Node *n) {
+        if (n)
+            n->accept(this);
+        else
+            tag(TAG_NIL);
+    }
+
+    template<class T, unsigned N>
+    void list(const SmallList<T, N> &l) {
+        uint(l.size());
+        for (auto &n: l)
+            node(n);
+    }
+
+public:
+    void write(Node *root) {
+        node(root);
+    }
+
+    // the symbol table is only complete once every node was written
+    std::string finish() {
+        std::string nodes;
+        nodes.swap(body);
+        body.append(MAGIC, sizeof(MAGIC));
+        uint(VERSION);
+        uint(symbols.size());
+        for (auto &sym: symbols) {
+            const std::string &name = Symbols::name(sym);
+            text(name.data(), name.size());
+        }
+        return body + nodes;
+    }
+
+    virtual void visit(True *) { tag(TAG_TRUE); }
+    virtual void visit(False *) { tag(TAG_FALSE); }
+    virtual void visit(Integer *v) { tag(TAG_INTEGER); sint(v->val); }
+    virtual void visit(Real *v) { tag(TAG_REAL); body.append((const char *)&v->val, sizeof(v->val)); }
+    virtual void visit(String *v) { tag(TAG_STRING); text(v->val.ptr, v->val.len); }
+    virtual void visit(Variable *v) { tag(TAG_VARIABLE); symbol(v->val); }
+    virtual void visit(Declaration *v) { tag(TAG_DECLARATION); symbol(v->name); node(v->expr); node(v->type_spec); }
+    virtual void visit(Assign *v) { tag(TAG_ASSIGN); node(v->expr); list(v->vars); }
+    virtual void visit(Call *v) { tag(TAG_CALL); node(v->parent); node(v->params); }
+    virtual void visit(Return *v) { tag(TAG_RETURN); node(v->e); }
+    virtual void visit(Unary *v) { tag(TAG_UNARY); op(v->op); node(v->down); }
+    virtual void visit(Binary *v) { tag(TAG_BINARY); op(v->op); node(v->left); node(v->right); }
+    virtual void visit(And *v) { tag(TAG_AND); node(v->left); node(v->right); }
+    virtual void visit(Or *v) { tag(TAG_OR); node(v->left); node(v->right); }
+    virtual void visit(IfElse *v) { tag(TAG_IFELSE); node(v->expr); node(v->body); node(v->ifelse); }
+    virtual void visit(While *v) { tag(TAG_WHILE); node(v->expr); node(v->body); }
+    virtual void visit(Break *) { tag(TAG_BREAK); }
+    virtual void visit(Continue *) { tag(TAG_CONTINUE); }
+    virtual void visit(For *v) { tag(TAG_FOR); symbol(v->vname); node(v->iterable); node(v->body); }
+    virtual void visit(Array *v) { tag(TAG_ARRAY); node(v->elems); }
+    virtual void visit(Subscript *v) { tag(TAG_SUBSCRIPT); node(v->var); node(v->idx); }
+    virtual void visit(Expr *v) { tag(TAG_EXPR); node(v->e); }
+    virtual void visit(Function *v) { tag(TAG_FUNCTION); node(v->proto); node(v->body); }
+    virtual void visit(FuncDecl *v) { tag(TAG_FUNCDECL); symbol(v->name); node(v->func); node(v->generics); }
+    virtual void visit(UnionItem *v) { tag(TAG_UNIONITEM); symbol(v->name); node(v->type_spec); }
+    virtual void visit(UnionList *v) { tag(TAG_UNIONLIST); list(v->items); }
+    virtual void visit(RecordDef *v) { tag(TAG_RECORDDEF); symbol(v->name); node(v->decl_list); symbol(v->layout); }
+    virtual void visit(UnionDef *v) { tag(TAG_UNIONDEF); symbol(v->name); node(v->type_list); node(v->generics); }
+    virtual void visit(ExprList *v) { tag(TAG_EXPRLIST); list(v->items); }
+    virtual void visit(StmtList *v) { tag(TAG_STMTLIST); list(v->items); }
+    virtual void visit(SimpleType *v) { tag(TAG_SIMPLETYPE); symbol(v->tname); }
+    virtual void visit(RefType *v) { tag(TAG_REFTYPE); node(v->base_type); }
+    virtual void visit(PtrType *v) { tag(TAG_PTRTYPE); node(v->base_type); }
+    virtual void visit(ArrayType *v) { tag(TAG_ARRAYTYPE); node(v->base_type); }
+    virtual void visit(TupleType *v) { tag(TAG_TUPLETYPE); node(v->base_type); }
+    virtual void visit(FuncType *v) { tag(TAG_FUNCTYPE); node(v->params); node(v->ret); }
+    virtual void visit(TypeList *v) {
+        tag(TAG_TYPELIST);
+        list(v->types);
+        uint(v->names.size());
+        for (auto &n: v->names)
+            symbol(n);
+    }
+    virtual void visit(IfaceDef *v) { tag(TAG_IFACEDEF); symbol(v->name); node(v->methods); }
+    virtual void visit(Cast *v) { tag(TAG_CAST); node(v->expr); node(v->type); }
+    virtual void visit(Member *v) { tag(TAG_MEMBER); node(v->obj); symbol(v->name); }
+    virtual void visit(New *v) { tag(TAG_NEW); node(v->expr); }
+    virtual void visit(Slice *v) { tag(TAG_SLICE); node(v->var); node(v->lo); node(v->hi); node(v->step); }
+    virtual void visit(SliceType *v) { tag(TAG_SLICETYPE); node(v->base_type); }
+    virtual void visit(GenericType *v) { tag(TAG_GENERICTYPE); symbol(v->tname); node(v->args); }
+    virtual void visit(Match *v) { tag(TAG_MATCH); node(v->expr); node(v->arms); }
+    virtual void visit(MatchArm *v) { tag(TAG_MATCHARM); symbol(v->name); symbol(v->var); node(v->body); }
+    virtual void visit(NamedArg *v) { tag(TAG_NAMEDARG); symbol(v->name); node(v->expr); }
+    virtual void visit(Tuple *v) { tag(TAG_TUPLE); node(v->elems); }
+    virtual void visit(Unpack *v) { tag(TAG_UNPACK); symbol(v->tname); node(v->vars); node(v->expr); }
+};
+
+class Reader {
+private:
+    const uint8_t *p, *end;
+    Arena &arena;
+    std::vector<symbol_t> symbols;
+    unsigned depth;
+    bool ok;
+
+    uint8_t byte() {
+        if (p == end) {
+            ok = false;
+            return 0;
+        }
+        return *p++;
+    }
+
+    uint64_t uint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64 && ok; shift += 7) {
+            uint8_t b = byte();
+            v |= (uint64_t)(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return v;
+        }
+        ok = false;
+        return 0;
+    }
+
+    int64_t sint() {
+        uint64_t v = uint();
+        return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+    }
+
+    Span text() {
+        Span s = {"", 0};
+        uint64_t len = uint();
+        if (!ok || len > (uint64_t)(end - p)) {
+            ok = false;
+            return s;
+        }
+        s.ptr = arena.copy((const char *)p, len);
+        s.len = len;
+        p += len;
+        return s;
+    }
+
+    symbol_t symbol() {
+        uint64_t i = uint();
+        if (i >= symbols.size()) {
+            ok = false;
+            return Symbols::EMPTY;
+        }
+        return symbols[i];
+    }
+
+    int op() {
+        uint64_t i = uint();
+        if (i >= NUM_OPERATORS) {
+            ok = false;
+            return 0;
+        }
+        return OPERATORS[i];
+    }
+
+    // optional child of type T
+    template<class T>
+    T *child() {
+        Node *n = node();
+        if (n == NULL)
+            return NULL;
+        T *t = dynamic_cast<T *>(n);
+        if (t == NULL)
+            ok = false;
+        return t;
+    }
+
+    // mandatory child of type T
+    template<class T>
+    T *need() {
+        T *t = child<T>();
+        if (t == NULL)
+            ok = false;
+        return t;
+    }
+
+    template<class T>
+    T *list(T *l) {
+        uint64_t count = uint();
+        for (uint64_t i = 0; i < count && ok; i++)
+            l->items.push_back(arena, need<Node>());
+        return l;
+    }
+
+    Node *node() {
+        if (!ok || depth == MAX_DEPTH) {
+            ok = false;
+            return NULL;
+        }
+        depth++;
+        Node *n = tagged();
+        depth--;
+        return n;
+    }
+
+    Node *tagged();
+
+public:
+    Reader(const char *data, size_t size, Arena &_arena):
+        p((const uint8_t *)data), end((const uint8_t *)data + size), arena(_arena), depth(0), ok(true) { }
+
+    Node *read() {
+        if (!isSerialized((const char *)p, end - p))
+            return NULL;
+        p += sizeof(MAGIC);
+        if (uint() != VERSION)
+            return NULL;
+
+        uint64_t count = uint();
+        for (uint64_t i = 0; i < count && ok; i++) {
+            Span name = text();
+            symbols.push_back(Symbols::intern(name.ptr, name.len));
+        }
+
+        Node *root = node();
+        return ok && p == end ? root : NULL;
+    }
+};
+
+// Children are read into locals first since the order in which function
+// arguments are evaluated is unspecified.
+Node *Reader::tagged() {
+    switch (byte()) {
+        case TAG_NIL:
+            return NULL;
+        case TAG_TRUE:
+            return arena.make<True>();
+        case TAG_FALSE:
+            return arena.make<False>();
+        case TAG_INTEGER:
+            return arena.make<Integer>(sint());
+        case TAG_REAL: {
+            real_t val = 0;
+            if ((size_t)(end - p) < sizeof(val)) {
+                ok = false;
+                return NULL;
+            }
+            memcpy(&val, p, sizeof(val));
+            p += sizeof(val);
+            return arena.make<Real>(val);
+        }
+        case TAG_STRING:
+            return arena.make<String>(text());
+        case TAG_VARIABLE:
+            return arena.make<Variable>(symbol());
+        case TAG_DECLARATION: {
+            symbol_t name = symbol();
+            Node *expr = need<Node>();
+            Node *type_spec = child<Node>();
+            return arena.make<Declaration>(name, expr, type_spec);
+        }
+        case TAG_ASSIGN: {
+            Node *expr = need<Node>();
+            uint64_t count = uint();
+            if (count == 0) {
+                ok = false;
+                return NULL;
+            }
+            Assign *a = arena.make<Assign>(arena, need<Node>(), expr);
+            for (uint64_t i = 1; i < count && ok; i++)
+                a->vars.push_back(arena, need<Node>());
+            return a;
+        }
+        case TAG_CALL: {
+            Node *parent = need<Node>();
+            ExprList *params = need<ExprList>();
+            return arena.make<Call>(parent, params);
+        }
+        case TAG_RETURN:
+            return arena.make<Return>(child<Node>());
+        case TAG_UNARY: {
+            int o = op();
+            Node *down = need<Node>();
+            return arena.make<Unary>(o, down);
+        }
+        case TAG_BINARY: {
+            int o = op();
+            Node *left = need<Node>();
+            Node *right = need<Node>();
+            return arena.make<Binary>(o, left, right);
+        }
+        case TAG_AND: {
+            Node *left = need<Node>();
+            Node *right = need<Node>();
+            return arena.make<And>(left, right);
+        }
+        case TAG_OR: {
+            Node *left = need<Node>();
+            Node *right = need<Node>();
+            return arena.make<Or>(left, right);
+        }
+        case TAG_IFELSE: {
+            Node *expr = need<Node>();
+            Node *body = need<Node>();
+            Node *ifelse = child<Node>();
+            return arena.make<IfElse>(expr, body, ifelse);
+        }
+        case TAG_WHILE: {
+            Node *expr = need<Node>();
+            Node *body = need<Node>();
+            return arena.make<While>(expr, body);
+        }
+        case TAG_BREAK:
+            return arena.make<Break>();
+        case TAG_CONTINUE:
+            return arena.make<Continue>();
+        case TAG_FOR: {
+            symbol_t vname = symbol();
+            Node *iterable = need<Node>();
+            Node *body = need<Node>();
+            return arena.make<For>(vname, iterable, body);
+        }
+        case TAG_ARRAY:
+            return arena.make<Array>(need<ExprList>());
+        case TAG_SUBSCRIPT: {
+            Node *var = need<Node>();
+            Node *idx = need<Node>();
+            return arena.make<Subscript>(var, idx);
+        }
+        case TAG_EXPR:
+            return arena.make<Expr>(need<Node>());
+        case TAG_FUNCTION: {
+            FuncType *proto = need<FuncType>();
+            Node *body = need<Node>();
+            return arena.make<Function>(proto, body);
+        }
+        case TAG_FUNCDECL: {
+            symbol_t name = symbol();
+            Node *func = need<Node>();
+            TypeList *generics = child<TypeList>();
+            return arena.make<FuncDecl>(name, func, generics);
+        }
+        case TAG_UNIONITEM: {
+            symbol_t name = symbol();
+            Node *type_spec = child<Node>();
+            return arena.make<UnionItem>(name, type_spec);
+        }
+        case TAG_UNIONLIST:
+            return list(arena.make<UnionList>());
+        case TAG_RECORDDEF: {
+            symbol_t name = symbol();
+            Node *decl_list = need<Node>();
+            return arena.make<RecordDef>(name, decl_list, symbol());
+        }
+        case TAG_UNIONDEF: {
+            symbol_t name = symbol();
+            Node *type_list = need<Node>();
+            TypeList *generics = child<TypeList>();
+            return arena.make<UnionDef>(name, type_list, generics);
+        }
+        case TAG_EXPRLIST:
+            return list(arena.make<ExprList>());
+        case TAG_STMTLIST:
+            return list(arena.make<StmtList>());
+        case TAG_SIMPLETYPE:
+            return arena.make<SimpleType>(symbol());
+        case TAG_REFTYPE:
+            return arena.make<RefType>(need<Type>());
+        case TAG_PTRTYPE:
+            return arena.make<PtrType>(need<Type>());
+        case TAG_ARRAYTYPE:
+            return arena.make<ArrayType>(need<Type>());
+        case TAG_TUPLETYPE:
+            return arena.make<TupleType>(need<Type>());
+        case TAG_FUNCTYPE: {
+            TypeList *params = need<TypeList>();
+            Type *ret = child<Type>();
+            return arena.make<FuncType>(params, ret);
+        }
+        case TAG_TYPELIST: {
+            TypeList *t = arena.make<TypeList>();
+            uint64_t count = uint();
+            // the constraint of a type parameter may be missing
+            for (uint64_t i = 0; i < count && ok; i++)
+                t->types.push_back(arena, child<Type>());
+            count = uint();
+            for (uint64_t i = 0; i < count && ok; i++)
+                t->names.push_back(arena, symbol());
+            return t;
+        }
+        case TAG_IFACEDEF: {
+            symbol_t name = symbol();
+            TypeList *methods = need<TypeList>();
+            return arena.make<IfaceDef>(name, methods);
+        }
+        case TAG_CAST: {
+            Node *expr = need<Node>();
+            Type *type = need<Type>();
+            return arena.make<Cast>(expr, type);
+        }
+        case TAG_MEMBER: {
+            Node *obj = need<Node>();
+            symbol_t name = symbol();
+            return arena.make<Member>(obj, name);
+        }
+        case TAG_NEW:
+            return arena.make<New>(need<Node>());
+        case TAG_SLICE: {
+            Node *var = need<Node>();
+            Node *lo = child<Node>();
+            Node *hi = child<Node>();
+            Node *step = child<Node>();
+            return arena.make<Slice>(var, lo, hi, step);
+        }
+        case TAG_SLICETYPE:
+            return arena.make<SliceType>(need<Type>());
+        case TAG_GENERICTYPE: {
+            symbol_t tname = symbol();
+            return arena.make<GenericType>(tname, need<TypeList>());
+        }
+        case TAG_MATCH: {
+            Node *expr = need<Node>();
+            return arena.make<Match>(expr, need<StmtList>());
+        }
+        case TAG_MATCHARM: {
+            symbol_t name = symbol();
+            symbol_t var = symbol();
+            return arena.make<MatchArm>(name, var, need<Node>());
+        }
+        case TAG_NAMEDARG: {
+            symbol_t name = symbol();
+            return arena.make<NamedArg>(name, need<Node>());
+        }
+        case TAG_TUPLE:
+            return arena.make<Tuple>(need<ExprList>());
+        case TAG_UNPACK: {
+            symbol_t tname = symbol();
+            TypeList *vars = need<TypeList>();
+            return arena.make<Unpack>(tname, vars, need<Node>());
+        }
+        default:
+            ok = false;
+            return NULL;
+    }
+}
+
+bool isSerialized(const char *data, size_t size) {
+    return size >= sizeof(MAGIC) && memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+std::string serialize(Node *root) {
+    Writer writer;
+    writer.write(root);
+    return writer.finish();
+}
+
+Node *deserialize(const char *data, size_t size, Arena &arena) {
+    Reader reader(data, size, arena);
+    return reader.read();
+}
+
+}
@@ -0,0 +1,31 @@
+#ifndef __SERIALIZE_H__
+#define __SERIALIZE_H__
+
+#include <string>
+#include "arena.h"
+#include "ast.h"
+
+/*
+ * Compact binary format for trees built by the parser.
+ *
+ *   "MAST" version:varint nsymbols:varint (len:varint bytes)* node
+ *
+ * A node is its NodeTag byte followed by its payload and its children in
+ * declaration order; a missing child is a single TAG_NIL byte. Integers
+ * are LEB128 varints (zigzag for signed values), reals are 8 raw bytes
+ * in host order, and identifiers are indices into the symbol table at the
+ * start of the file so the file does not depend on the symbol ids of the
+ * process that wrote it. Operators are stored as stable indices, not as
+ * parser token numbers.
+ */
+namespace ast {
+    bool isSerialized(const char *data, size_t size);
+    std::string serialize(Node *root);
+
+    // Rebuild a tree in arena, returns NULL if the data is malformed or
+    // nested too deeply.
+    // Nothing in the tree points into data, so it can be unmapped after.
+    Node *deserialize(const char *data, size_t size, Arena &arena);
+}
+
+#endif//__SERIALIZE_H__
@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include "symbol.h"
+
+namespace ast {
+
+const symbol_t Symbols::EMPTY;
+
+namespace {
+    // Names are kept in chunks that never move, so name() reads them
+    // without the lock; only intern() takes it.
+    const size_t CHUNK_BITS = 12;
+    const size_t CHUNK_SIZE = 1 << CHUNK_BITS;
+    const size_t MAX_CHUNKS = 4096;
+
+    struct SymbolTable {
+        std::mutex lock;
+        std::unordered_map<std::string, symbol_t> ids;
+        std::atomic<const std::string **> chunks[MAX_CHUNKS];
+        std::atomic<size_t> count;
+
+        SymbolTable(): count(0) {
+            for (auto &c: chunks)
+                c.store(nullptr, std::memory_order_relaxed);
+            append(&ids.insert(std::make_pair(std::string(), Symbols::EMPTY)).first->first);
+        }
+
+        // called with the lock held
+        void append(const std::string *name) {
+            size_t n = count.load(std::memory_order_relaxed);
+            if (n >= CHUNK_SIZE*MAX_CHUNKS)
+                abort();
+            const std::string **chunk = chunks[n >> CHUNK_BITS].load(std::memory_order_relaxed);
+            if (chunk == nullptr) {
+                chunk = new const std::string *[CHUNK_SIZE];
+                chunks[n >> CHUNK_BITS].store(chunk, std::memory_order_release);
+            }
+            chunk[n & (CHUNK_SIZE - 1)] = name;
+            count.store(n + 1, std::memory_order_release);
+        }
+    };
+
+    SymbolTable &table() {
+        static SymbolTable t;
+        return t;
+    }
+}
+
+symbol_t Symbols::intern(const char *str, size_t len) {
+    SymbolTable &t = table();
+    std::lock_guard<std::mutex> guard(t.lock);
+
+    auto res = t.ids.insert(std::make_pair(std::string(str, len), (symbol_t)t.count.load(std::memory_order_relaxed)));
+    if (res.second)
+        t.append(&res.first->first);
+    return res.first->second;
+}
+
+const std::string &Symbols::name(symbol_t sym) {
+    SymbolTable &t = table();
+    return *t.chunks[sym >> CHUNK_BITS].load(std::memory_order_acquire)[sym & (CHUNK_SIZE - 1)];
+}
+
+size_t Symbols::size() {
+    return table().count.load(std::memory_order_acquire);
+}
+
+}
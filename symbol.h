@@ -0,0 +1,29 @@
+#ifndef __SYMBOL_H__
+#define __SYMBOL_H__
+
+#include <stdint.h>
+#include <string>
+
+namespace ast {
+    typedef uint32_t symbol_t;
+
+    /*
+     * Process wide string interner. Identifiers are turned into dense
+     * symbol ids by the lexer, so name resolution compares and indexes
+     * integers instead of hashing strings. Ids are never recycled and the
+     * table is safe to use from several parsers at once.
+     */
+    class Symbols {
+        public:
+            static const symbol_t EMPTY = 0;
+
+            static symbol_t intern(const char *str, size_t len);
+            static symbol_t intern(const std::string &str) {
+                return intern(str.data(), str.size());
+            }
+            static const std::string &name(symbol_t sym);
+            static size_t size();
+    };
+}
+
+#endif//__SYMBOL_H__
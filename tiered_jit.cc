@@ -0,0 +1,153 @@
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/Scalar.h>
+#include "bounds.h"
+#include "refcount.h"
+#include "tiered_jit.h"
+
+using ::llvm::BasicBlock;
+using ::llvm::Function;
+using ::llvm::GlobalValue;
+using ::llvm::GlobalVariable;
+using ::llvm::IRBuilder;
+using ::llvm::Value;
+
+const uint32_t TieredJIT::DEFAULT_THRESHOLD;
+
+TieredJIT::TieredJIT(llvm::ExecutionEngine *_engine, llvm::Module *_module, std::mutex &_module_lock):
+    engine(_engine), module(_module), module_lock(_module_lock), optimizer(_module),
+    threshold(DEFAULT_THRESHOLD), busy(false), stopping(false), recompiled(0) {
+
+    optimizer.add(new llvm::DataLayoutPass(*engine->getDataLayout()));
+    // only hot functions get here, they are worth the most we have
+    OptLevel(3).addFunctionPasses(optimizer);
+    optimizer.doInitialization();
+
+    // void mamba_tier_up(i8 *jit, i32 id)
+    IRBuilder<> b(module->getContext());
+    llvm::Type *params[] = { b.getInt8PtrTy(), b.getInt32Ty() };
+    llvm::FunctionType *fty = llvm::FunctionType::get(b.getVoidTy(), params, false);
+    hook = Function::Create(fty, Function::ExternalLinkage, "mamba_tier_up", module);
+    engine->addGlobalMapping(hook, (void *)&TieredJIT::hot);
+
+    // every function is compiled when it is first requested, so running
+    // code never calls back into the code generator behind our lock
+    engine->DisableLazyCompilation(true);
+
+    worker = std::thread(&TieredJIT::run, this);
+}
+
+TieredJIT::~TieredJIT() {
+    {
+        std::lock_guard<std::mutex> guard(queue_lock);
+        stopping = true;
+    }
+    queue_cv.notify_all();
+    worker.join();
+}
+
+void TieredJIT::addBaselinePasses(llvm::FunctionPassManager &fpm) {
+    fpm.add(llvm::createPromoteMemoryToRegisterPass());
+    fpm.add(createRefcountPass());
+    fpm.add(llvm::createCFGSimplificationPass());
+}
+
+void TieredJIT::addBaselineModulePasses(llvm::PassManagerBase &pm) {
+    pm.add(llvm::createAlwaysInlinerPass());
+    pm.add(createRefcountPass());
+    pm.add(createBoundsCheckPass());
+}
+
+/*
+ * entry:    %n = add (load @f.calls), 1
+ *           store %n, @f.calls
+ *           br (%n == threshold), %tier.up, %tier.body
+ * tier.up:  call @mamba_tier_up(jit, id)
+ *           br %tier.body
+ */
+void TieredJIT::instrument(Function *func) {
+    IRBuilder<> b(module->getContext());
+    Tier tier;
+    tier.func = func;
+    tier.counter = new GlobalVariable(*module, b.getInt32Ty(), false, GlobalValue::InternalLinkage, b.getInt32(0), func->getName() + ".calls");
+    tier.entry = &func->getEntryBlock();
+    tier.body = tier.entry->splitBasicBlock(tier.entry->begin(), "tier.body");
+    tier.up = BasicBlock::Create(module->getContext(), "tier.up", func, tier.body);
+
+    tier.entry->getTerminator()->eraseFromParent();
+    b.SetInsertPoint(tier.entry);
+    Value *count = b.CreateAdd(b.CreateLoad(tier.counter), b.getInt32(1));
+    b.CreateStore(count, tier.counter);
+    b.CreateCondBr(b.CreateICmpEQ(count, b.getInt32(threshold)), tier.up, tier.body);
+
+    b.SetInsertPoint(tier.up);
+    Value *self = llvm::ConstantExpr::getIntToPtr(b.getInt64((uintptr_t)this), b.getInt8PtrTy());
+    b.CreateCall2(hook, self, b.getInt32(tiers.size()));
+    b.CreateBr(tier.body);
+
+    tiers.push_back(tier);
+}
+
+// Undo instrument(). The counter itself stays, the old code still
+// refers to it.
+void TieredJIT::strip(Tier &tier) {
+    tier.entry->getTerminator()->eraseFromParent();
+    while (!tier.entry->empty())
+        tier.entry->back().eraseFromParent();
+    llvm::BranchInst::Create(tier.body, tier.entry);
+    tier.up->eraseFromParent();
+}
+
+void TieredJIT::recompile(uint32_t id) {
+    std::lock_guard<std::mutex> guard(module_lock);
+    Tier &tier = tiers[id];
+    strip(tier);
+    optimizer.run(*tier.func);
+    engine->recompileAndRelinkFunction(tier.func);
+}
+
+void TieredJIT::hot(TieredJIT *jit, uint32_t id) {
+    {
+        std::lock_guard<std::mutex> guard(jit->queue_lock);
+        jit->queue.push_back(id);
+    }
+    jit->queue_cv.notify_one();
+}
+
+void TieredJIT::drain() {
+    std::unique_lock<std::mutex> guard(queue_lock);
+    idle_cv.wait(guard, [this]() { return queue.empty() && !busy; });
+}
+
+unsigned TieredJIT::getNumRecompiled() {
+    std::lock_guard<std::mutex> guard(queue_lock);
+    return recompiled;
+}
+
+void TieredJIT::run() {
+    std::unique_lock<std::mutex> guard(queue_lock);
+    for (;;) {
+        queue_cv.wait(guard, [this]() { return stopping || !queue.empty(); });
+        if (stopping)
+            break;
+
+        uint32_t id = queue.front();
+        queue.pop_front();
+        busy = true;
+
+        guard.unlock();
+        recompile(id);
+        guard.lock();
+
+        busy = false;
+        recompiled++;
+        idle_cv.notify_all();
+    }
+
+    // wake anyone draining a queue that will no longer be served
+    queue.clear();
+    idle_cv.notify_all();
+}
@@ -0,0 +1,88 @@
+#ifndef __TIERED_JIT_H__
+#define __TIERED_JIT_H__
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <stdint.h>
+#include <llvm/PassManager.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Module.h>
+#include "optimizer.h"
+
+/*
+ * Two tier compilation for the JIT. Functions are first built with a few
+ * cheap passes and a counter on entry. When a counter reaches the
+ * threshold the function is queued, a background thread removes the
+ * counter, runs the -O3 function passes over it, whatever the level,
+ * and the engine relinks the old code to the new one.
+ *
+ * The module lock guards the module and its LLVMContext. It must be held
+ * while building IR or asking the engine for code, but not while running
+ * generated code.
+ */
+class TieredJIT {
+    public:
+        static const uint32_t DEFAULT_THRESHOLD = 1000;
+
+        TieredJIT(llvm::ExecutionEngine *engine, llvm::Module *module, std::mutex &module_lock);
+        ~TieredJIT();
+
+        static void addBaselinePasses(llvm::FunctionPassManager &fpm);
+        // the module passes of the baseline, once the module is complete
+        static void addBaselineModulePasses(llvm::PassManagerBase &pm);
+
+        // Add an entry counter to a function built with the baseline
+        // passes. Called with the module lock held.
+        void instrument(llvm::Function *func);
+
+        // Block until every queued function has been recompiled.
+        void drain();
+
+        void setThreshold(uint32_t _threshold) { threshold = _threshold; }
+        unsigned getNumRecompiled();
+
+        // called by generated code, once per function
+        static void hot(TieredJIT *jit, uint32_t id);
+
+    private:
+        struct Tier {
+            llvm::Function *func;
+            llvm::GlobalVariable *counter;
+            llvm::BasicBlock *entry;
+            llvm::BasicBlock *up;
+            llvm::BasicBlock *body;
+        };
+
+        llvm::ExecutionEngine *engine;
+        llvm::Module *module;
+        std::mutex &module_lock;
+        llvm::FunctionPassManager optimizer;
+        llvm::Function *hook;
+        uint32_t threshold;
+
+        // guarded by the module lock
+        std::deque<Tier> tiers;
+
+        std::mutex queue_lock;
+        std::condition_variable queue_cv;
+        std::condition_variable idle_cv;
+        std::deque<uint32_t> queue;
+        bool busy;
+        bool stopping;
+        unsigned recompiled;
+        std::thread worker;
+
+        void strip(Tier &tier);
+        void recompile(uint32_t id);
+        void run();
+
+        TieredJIT(const TieredJIT &);
+        TieredJIT &operator=(const TieredJIT &);
+};
+
+#endif//__TIERED_JIT_H__
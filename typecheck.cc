@@ -0,0 +1,1498 @@
+#include <algorithm>
+#include <set>
+#include <stdint.h>
+#include "clone.h"
+#include "fingerprint.h"
+#include "typecheck.h"
+#include "typeclass.h"
+
+using sema::Type;
+using sema::Types;
+
+static const Type *VOID() { return Types::voidType(); }
+
+static bool isInteger(const Type *t) {
+    return t->kind == Type::BUILTIN && t->id >= TY_INT8 && t->id <= TY_UNT64;
+}
+
+// builtins that convert to each other with as
+static bool isScalar(const Type *t) {
+    return t->kind == Type::BUILTIN && t->id != TY_STR;
+}
+
+// arrays and the slices of them
+static bool isSequence(const Type *t) {
+    return t->kind == Type::ARRAY || t->kind == Type::SLICE;
+}
+
+// a number written in the source, or its negation
+static bool isLiteral(ast::Node *n) {
+    ast::Unary *u = dynamic_cast<ast::Unary *>(n);
+    if (u && u->op == T_SUB)
+        n = u->down;
+    return dynamic_cast<ast::Integer *>(n) || dynamic_cast<ast::Real *>(n);
+}
+
+// whether the integer val is in the range of the builtin id
+static bool fits(long val, TypeId id) {
+    switch (id) {
+        case TY_INT8: return val >= INT8_MIN && val <= INT8_MAX;
+        case TY_INT16: return val >= INT16_MIN && val <= INT16_MAX;
+        case TY_INT32: return val >= INT32_MIN && val <= INT32_MAX;
+        case TY_UNT8: return val >= 0 && val <= UINT8_MAX;
+        case TY_UNT16: return val >= 0 && val <= UINT16_MAX;
+        case TY_UNT32: return val >= 0 && val <= UINT32_MAX;
+        case TY_UNT64: return val >= 0;
+        default: return true;
+    }
+}
+
+TypeChecker::TypeChecker(Arena &_arena): loops(0), arena(_arena), self(ast::Symbols::intern("Self")),
+    fixed(ast::Symbols::intern("fixed")), soa(ast::Symbols::intern("soa")),
+    hinted(nullptr), hint(nullptr), num_errors(0) {
+    pushScope();
+}
+
+void TypeChecker::error(const std::string &msg) {
+    errors += msg + "\n";
+    num_errors++;
+}
+
+// Check n and return its type, nullptr if it failed.
+const Type *TypeChecker::check(ast::Node *n) {
+    n->accept(this);
+    return n->ty;
+}
+
+// Check n where a value of type expected is wanted. Only n itself sees
+// the hint, not the nodes inside it.
+const Type *TypeChecker::check(ast::Node *n, const Type *expected) {
+    ast::Node *saved_node = hinted;
+    const Type *saved = hint;
+    hinted = n;
+    hint = expected;
+    n->accept(this);
+    hinted = saved_node;
+    hint = saved;
+    return n->ty;
+}
+
+const Type *TypeChecker::lookup(ast::symbol_t name) {
+    return name < bindings.size() ? bindings[name] : nullptr;
+}
+
+void TypeChecker::bind(ast::symbol_t name, const Type *type) {
+    if (name >= bindings.size())
+        bindings.resize(ast::Symbols::size(), nullptr);
+    env.back().push_back(std::make_pair(name, bindings[name]));
+    bindings[name] = type;
+}
+
+void TypeChecker::defineType(ast::symbol_t name) {
+    if (name >= type_names.size())
+        type_names.resize(ast::Symbols::size(), false);
+    type_names[name] = true;
+}
+
+void TypeChecker::pushScope() {
+    env.push_back(scope_t());
+}
+
+void TypeChecker::popScope() {
+    scope_t &scope = env.back();
+    for (auto it = scope.rbegin(); it != scope.rend(); ++it)
+        bindings[it->first] = it->second;
+    env.pop_back();
+}
+
+void TypeChecker::body(ast::Node *n) {
+    pushScope();
+    check(n);
+    popScope();
+}
+
+void TypeChecker::loop(ast::Node *n) {
+    loops++;
+    body(n);
+    loops--;
+}
+
+ast::FuncDecl *TypeChecker::lookupGeneric(ast::symbol_t name) {
+    return name < generics.size() ? generics[name] : nullptr;
+}
+
+const Type *TypeChecker::typeParam(ast::symbol_t name) {
+    return name < type_params.size() ? type_params[name] : nullptr;
+}
+
+void TypeChecker::setTypeParam(ast::symbol_t name, const Type *type) {
+    if (name >= type_params.size())
+        type_params.resize(ast::Symbols::size(), nullptr);
+    type_params[name] = type;
+}
+
+// Match the declared type of a parameter against the type of an
+// argument, binding the type parameters it mentions in subst.
+bool TypeChecker::unify(ast::TypeList *generics, ast::Type *param, const Type *arg, std::vector<const Type *> &subst) {
+    if (ast::SimpleType *t = dynamic_cast<ast::SimpleType *>(param)) {
+        for (size_t i = 0; i < generics->names.size(); i++) {
+            if (generics->names[i] == t->tname) {
+                if (subst[i] == nullptr)
+                    subst[i] = arg;
+                return subst[i] == arg;
+            }
+        }
+        return check(t) == arg;
+    }
+    if (ast::PtrType *t = dynamic_cast<ast::PtrType *>(param))
+        return arg->kind == Type::POINTER && unify(generics, t->base_type, arg->base, subst);
+    if (ast::RefType *t = dynamic_cast<ast::RefType *>(param))
+        return arg->kind == Type::REFERENCE && unify(generics, t->base_type, arg->base, subst);
+    if (ast::ArrayType *t = dynamic_cast<ast::ArrayType *>(param))
+        return arg->kind == Type::ARRAY && unify(generics, t->base_type, arg->base, subst);
+    if (ast::SliceType *t = dynamic_cast<ast::SliceType *>(param))
+        return arg->kind == Type::SLICE && unify(generics, t->base_type, arg->base, subst);
+    if (ast::GenericType *t = dynamic_cast<ast::GenericType *>(param)) {
+        if (arg->kind != Type::NAMED || arg->name != t->tname || arg->elems.size() != t->args->types.size())
+            return false;
+        for (size_t i = 0; i < arg->elems.size(); i++)
+            if (!unify(generics, t->args->types[i], arg->elems[i], subst))
+                return false;
+        return true;
+    }
+    if (ast::TupleType *t = dynamic_cast<ast::TupleType *>(param)) {
+        ast::TypeList *elems = static_cast<ast::TypeList *>(t->base_type);
+        if (arg->kind != Type::TUPLE || arg->elems.size() != elems->types.size())
+            return false;
+        for (size_t i = 0; i < arg->elems.size(); i++)
+            if (!unify(generics, elems->types[i], arg->elems[i], subst))
+                return false;
+        return true;
+    }
+    if (ast::FuncType *t = dynamic_cast<ast::FuncType *>(param)) {
+        if (arg->kind != Type::FUNCTION || arg->elems.size() != t->params->types.size())
+            return false;
+        for (size_t i = 0; i < arg->elems.size(); i++)
+            if (!unify(generics, t->params->types[i], arg->elems[i], subst))
+                return false;
+        return t->ret ? unify(generics, t->ret, arg->base, subst) : arg->base == VOID();
+    }
+    return false;
+}
+
+// Constraints name the operators a type parameter needs.
+bool TypeChecker::satisfies(const Type *type, ast::Type *constraint) {
+    if (constraint == nullptr)
+        return true;
+    const std::string &name = static_cast<ast::SimpleType *>(constraint)->type_name();
+    if (name == "Copyable")
+        return true;
+    if (name == "Equatable")
+        return OpTable::binaryType(T_EQ, type, type) != nullptr;
+    if (name == "Orderable")
+        return OpTable::binaryType(T_LT, type, type) != nullptr;
+    if (name == "Numeric")
+        return OpTable::binaryType(T_ADD, type, type) != nullptr && OpTable::binaryType(T_MUL, type, type) != nullptr;
+    if (name == "Integral")
+        return isInteger(type);
+    ast::symbol_t sym = static_cast<ast::SimpleType *>(constraint)->tname;
+    if (lookupIface(sym))
+        return implements(type, Types::iface(sym));
+    error("unknown constraint " + name);
+    return false;
+}
+
+void TypeChecker::declare(ast::symbol_t name, ast::Node *n) {
+    declarations.insert(std::make_pair(name, n));
+    const std::string &str = ast::Symbols::name(name);
+    size_t dot = str.rfind('.');
+    if (dot != std::string::npos)
+        declarations.insert(std::make_pair(ast::Symbols::intern(str.substr(dot + 1)), n));
+}
+
+// Names of the named types in type.
+static void typeNames(const Type *type, std::vector<ast::symbol_t> &names) {
+    if (type->kind == Type::NAMED || type->kind == Type::IFACE)
+        names.push_back(type->name);
+    if (type->base)
+        typeNames(type->base, names);
+    for (auto t: type->elems)
+        typeNames(t, names);
+}
+
+// The fingerprint follows every name in the declaration and its type
+// arguments, and the methods a for loop calls, to what they may resolve
+// to, in the order they are met. Locals that shadow a declaration only
+// add it. Called once per instance.
+std::string TypeChecker::mangle(ast::FuncDecl *decl, const std::vector<const Type *> &subst) {
+    Fingerprint fingerprint;
+    std::vector<ast::symbol_t> names;
+    fingerprint.collect(&names);
+    decl->accept(&fingerprint);
+    for (auto t: subst)
+        typeNames(t, names);
+    names.push_back(ast::Symbols::intern("iter"));
+    names.push_back(ast::Symbols::intern("next"));
+
+    std::set<ast::symbol_t> followed;
+    std::set<ast::Node *> seen;
+    seen.insert(decl);
+    for (size_t i = 0; i < names.size(); i++) {
+        if (!followed.insert(names[i]).second)
+            continue;
+        auto range = declarations.equal_range(names[i]);
+        for (auto d = range.first; d != range.second; ++d)
+            if (seen.insert(d->second).second)
+                d->second->accept(&fingerprint);
+    }
+
+    std::string name = ast::Symbols::name(decl->name) + "{";
+    for (size_t i = 0; i < subst.size(); i++)
+        name += (i ? "," : "") + subst[i]->str();
+    return name + "}." + fingerprint.hex().substr(0, 16);
+}
+
+// The checked instance of a generic function for the given argument
+// types, nullptr if the arguments do not fit it.
+ast::FuncDecl *TypeChecker::instantiate(ast::FuncDecl *decl, const std::vector<const Type *> &args) {
+    const std::string &fname = ast::Symbols::name(decl->name);
+    ast::Function *func = static_cast<ast::Function *>(decl->func);
+    ast::TypeList *params = func->proto->params;
+    ast::TypeList *tparams = decl->generics;
+
+    if (params->types.size() != args.size()) {
+        error("wrong number of arguments for " + fname);
+        return nullptr;
+    }
+    std::vector<const Type *> subst(tparams->names.size(), nullptr);
+    for (size_t i = 0; i < args.size(); i++) {
+        if (!unify(tparams, params->types[i], args[i], subst)) {
+            error("argument " + std::to_string(i+1) + " of " + fname + " cannot be " + args[i]->str());
+            return nullptr;
+        }
+    }
+    for (size_t i = 0; i < subst.size(); i++) {
+        const std::string &tname = ast::Symbols::name(tparams->names[i]);
+        if (subst[i] == nullptr) {
+            error("cannot infer type parameter " + tname + " of " + fname);
+            return nullptr;
+        }
+        if (!satisfies(subst[i], tparams->types[i])) {
+            error(subst[i]->str() + " is not " + tparams->types[i]->type_name() + " as " + tname + " of " + fname);
+            return nullptr;
+        }
+    }
+
+    instance_key_t key(decl, subst);
+    auto it = instances.find(key);
+    if (it != instances.end())
+        return it->second;
+
+    // cached before the body is checked, so instances can recurse
+    ast::Function *copy = static_cast<ast::Function *>(ast::clone(func, arena));
+    ast::FuncDecl *inst = arena.make<ast::FuncDecl>(ast::Symbols::intern(mangle(decl, subst)), copy);
+    instances[key] = inst;
+
+    std::vector<const Type *> saved;
+    for (size_t i = 0; i < subst.size(); i++) {
+        saved.push_back(typeParam(tparams->names[i]));
+        setTypeParam(tparams->names[i], subst[i]);
+    }
+    std::vector<const Type *> caller = generic_scopes[decl];
+    bindings.swap(caller);
+    check(copy);
+    bindings.swap(caller);
+    for (size_t i = 0; i < subst.size(); i++)
+        setTypeParam(tparams->names[i], saved[i]);
+
+    if (copy->ty == nullptr) {
+        // errors were reported, do not report them again for other calls
+        instances[key] = nullptr;
+        return nullptr;
+    }
+    inst->ty = VOID();
+    decl->instances.push_back(arena, inst);
+    return inst;
+}
+
+ast::IfaceDef *TypeChecker::lookupIface(ast::symbol_t name) {
+    return name < ifaces.size() ? ifaces[name] : nullptr;
+}
+
+void TypeChecker::defineIface(ast::IfaceDef *v) {
+    if (v->name >= ifaces.size())
+        ifaces.resize(ast::Symbols::size(), nullptr);
+    ifaces[v->name] = v;
+}
+
+bool TypeChecker::implements(const Type *type, const Type *iface) {
+    if (type->kind == Type::IFACE) {
+        error("cannot use " + type->str() + " as " + iface->str());
+        return false;
+    }
+    ast::TypeList *methods = lookupIface(iface->name)->methods;
+    for (size_t i = 0; i < methods->names.size(); i++) {
+        const Type *sig = methods->types[i]->ty;
+        if (sig == nullptr)
+            return false;
+        std::vector<const Type *> params = sig->elems;
+        params[0] = type;
+        const Type *expected = Types::function(params, sig->base);
+
+        std::string fname = type->str() + "." + ast::Symbols::name(methods->names[i]);
+        const Type *actual = lookup(ast::Symbols::intern(fname));
+        if (actual == nullptr) {
+            error(type->str() + " does not implement " + iface->str() + ", " + fname + " is missing");
+            return false;
+        }
+        if (actual != expected) {
+            error(fname + " must be " + expected->str() + " to implement " + iface->str());
+            return false;
+        }
+    }
+    return true;
+}
+
+void TypeChecker::declareUnion(ast::UnionDef *v) {
+    if (v->name < unions.size() && unions[v->name] == v)
+        return;
+    defineType(v->name);
+    if (v->name >= unions.size())
+        unions.resize(ast::Symbols::size(), nullptr);
+    unions[v->name] = v;
+
+    ast::UnionList *items = static_cast<ast::UnionList *>(v->type_list);
+    for (size_t i = 0; i < items->items.size(); i++) {
+        ast::symbol_t name = static_cast<ast::UnionItem *>(items->items[i])->name;
+        if (name >= variants.size())
+            variants.resize(ast::Symbols::size(), std::make_pair(nullptr, 0));
+        if (variants[name].first)
+            error("variant " + ast::Symbols::name(name) + " is already defined");
+        else
+            variants[name] = std::make_pair(v, i);
+    }
+}
+
+// The union a named type is an instance of, nullptr for other types.
+ast::UnionDef *TypeChecker::lookupUnion(const Type *type) {
+    if (type->kind != Type::NAMED || type->name >= unions.size())
+        return nullptr;
+    return unions[type->name];
+}
+
+const Type *TypeChecker::instance(ast::UnionDef *u, const std::vector<const Type *> &args) {
+    const std::string &uname = ast::Symbols::name(u->name);
+    if (args.size() != u->generics->names.size()) {
+        error("wrong number of type arguments for " + uname);
+        return nullptr;
+    }
+    for (size_t i = 0; i < args.size(); i++) {
+        if (!satisfies(args[i], u->generics->types[i])) {
+            error(args[i]->str() + " is not " + u->generics->types[i]->type_name() + " as " + ast::Symbols::name(u->generics->names[i]) + " of " + uname);
+            return nullptr;
+        }
+    }
+    return Types::named(u->name, args);
+}
+
+// Payload of variant i of a union type, nullptr when it has none. The
+// payloads of a generic union were checked with every type parameter
+// standing for itself.
+const Type *TypeChecker::payload(const Type *type, size_t i) {
+    ast::UnionDef *u = lookupUnion(type);
+    ast::Node *spec = static_cast<ast::UnionItem *>(static_cast<ast::UnionList *>(u->type_list)->items[i])->type_spec;
+    if (spec == nullptr || u->generics == nullptr)
+        return spec ? spec->ty : nullptr;
+    std::vector<ast::symbol_t> params(u->generics->names.begin(), u->generics->names.end());
+    return Types::substitute(spec->ty, params, type->elems);
+}
+
+// Type of the variant name of node n built from args.
+const Type *TypeChecker::construct(ast::Node *n, ast::symbol_t name, const std::vector<const Type *> &args) {
+    ast::UnionDef *u = variants[name].first;
+    size_t i = variants[name].second;
+    ast::Type *spec = static_cast<ast::Type *>(static_cast<ast::UnionItem *>(static_cast<ast::UnionList *>(u->type_list)->items[i])->type_spec);
+    const std::string &vname = ast::Symbols::name(name);
+    if (args.size() != (spec ? 1 : 0)) {
+        error(vname + (spec ? " takes one argument" : " takes no arguments"));
+        return nullptr;
+    }
+
+    const Type *type = Types::named(u->name);
+    if (u->generics) {
+        std::vector<const Type *> subst(u->generics->names.size(), nullptr);
+        if (spec && !unify(u->generics, spec, args[0], subst)) {
+            error("cannot build " + vname + " from " + args[0]->str());
+            return nullptr;
+        }
+        bool inferred = std::find(subst.begin(), subst.end(), nullptr) == subst.end();
+        if (inferred)
+            type = instance(u, subst);
+        else if (n == hinted && hint && hint->kind == Type::NAMED && hint->name == u->name)
+            type = hint;
+        else {
+            error("cannot infer the type of " + vname + ", declare it as " + ast::Symbols::name(u->name) + "{...}");
+            return nullptr;
+        }
+    }
+    if (type && spec && payload(type, i) != args[0]) {
+        error("cannot build " + vname + " of " + type->str() + " from " + args[0]->str());
+        return nullptr;
+    }
+    return type;
+}
+
+void TypeChecker::declareRecord(ast::RecordDef *v) {
+    defineType(v->name);
+    if (v->name >= records.size())
+        records.resize(ast::Symbols::size(), nullptr);
+    records[v->name] = v;
+}
+
+ast::RecordDef *TypeChecker::lookupRecord(const Type *type) {
+    if (type->kind != Type::NAMED || type->name >= records.size())
+        return nullptr;
+    return records[type->name];
+}
+
+// Index of a field of r, -1 if it has none by that name.
+int TypeChecker::field(ast::RecordDef *r, ast::symbol_t name) {
+    ast::TypeList *fields = static_cast<ast::TypeList *>(r->decl_list);
+    for (size_t i = 0; i < fields->names.size(); i++)
+        if (fields->names[i] == name)
+            return i;
+    return -1;
+}
+
+// Every field is given once, in order or by name. Each argument is
+// checked against its field, so Point(next=None) infers the union.
+const Type *TypeChecker::construct(ast::Call *v, ast::RecordDef *r) {
+    ast::TypeList *fields = static_cast<ast::TypeList *>(r->decl_list);
+    const std::string &rname = ast::Symbols::name(r->name);
+    std::vector<ast::Node *> given(fields->names.size(), nullptr);
+    bool ok = true;
+    for (size_t i = 0; i < v->params->items.size(); i++) {
+        ast::Node *n = v->params->items[i];
+        ast::NamedArg *arg = dynamic_cast<ast::NamedArg *>(n);
+        int f = arg ? field(r, arg->name) : i < given.size() ? i : -1;
+        if (f < 0) {
+            error(arg ? rname + " has no field " + ast::Symbols::name(arg->name) : "too many arguments for " + rname);
+            ok = false;
+            continue;
+        }
+        const std::string &fname = ast::Symbols::name(fields->names[f]);
+        if (given[f]) {
+            error("field " + fname + " of " + rname + " is given twice");
+            ok = false;
+            continue;
+        }
+        given[f] = n;
+        const Type *expected = fields->types[f]->ty;
+        const Type *type = check(arg ? arg->expr : n, expected);
+        if (arg)
+            arg->ty = type;
+        if (type && expected && type != expected)
+            error("field " + fname + " of " + rname + " should be " + expected->str() + " not " + type->str());
+        ok = ok && type && type == expected;
+    }
+    for (size_t f = 0; f < given.size(); f++) {
+        if (given[f] == nullptr) {
+            error("field " + ast::Symbols::name(fields->names[f]) + " of " + rname + " is missing");
+            ok = false;
+        }
+    }
+    return ok ? Types::named(r->name) : nullptr;
+}
+
+// Whether a value of type holds one of the named type by value, in a
+// field or a payload. Types not checked yet are skipped, the cycle is
+// found from the type checked last.
+bool TypeChecker::contains(const Type *type, ast::symbol_t name, std::vector<const Type *> &seen) {
+    if (type == nullptr || type->kind != Type::NAMED || std::find(seen.begin(), seen.end(), type) != seen.end())
+        return false;
+    if (type->name == name)
+        return true;
+    seen.push_back(type);
+    if (ast::RecordDef *r = lookupRecord(type)) {
+        for (auto t: static_cast<ast::TypeList *>(r->decl_list)->types)
+            if (contains(t->ty, name, seen))
+                return true;
+    } else if (ast::UnionDef *u = lookupUnion(type)) {
+        for (size_t i = 0; i < static_cast<ast::UnionList *>(u->type_list)->items.size(); i++)
+            if (contains(payload(type, i), name, seen))
+                return true;
+    }
+    return false;
+}
+
+// Whether releasing a value of type means releasing heap objects.
+bool TypeChecker::references(const Type *type) {
+    if (type->kind == Type::POINTER || type->kind == Type::IFACE || isSequence(type))
+        return true;
+    if (type->kind == Type::TUPLE) {
+        for (auto t: type->elems)
+            if (references(t))
+                return true;
+        return false;
+    }
+    if (ast::RecordDef *r = lookupRecord(type)) {
+        for (auto t: static_cast<ast::TypeList *>(r->decl_list)->types)
+            if (t->ty && references(t->ty))
+                return true;
+        return false;
+    }
+    ast::UnionDef *u = lookupUnion(type);
+    if (u == nullptr)
+        return false;
+    for (size_t i = 0; i < static_cast<ast::UnionList *>(u->type_list)->items.size(); i++) {
+        const Type *p = payload(type, i);
+        if (p && references(p))
+            return true;
+    }
+    return false;
+}
+
+// Heap values hold no references, so releasing one never has to look
+// inside it.
+bool TypeChecker::canAllocate(const Type *type) {
+    if (type->kind == Type::BUILTIN || (type->kind == Type::NAMED && !references(type)))
+        return true;
+    error("cannot allocate " + type->str() + " on the heap");
+    return false;
+}
+
+// Releasing an array frees its buffer without looking at the elements,
+// so they cannot hold heap references. Interface values are the
+// exception, the last reference to the buffer releases their boxes.
+bool TypeChecker::arrayOf(const Type *elem) {
+    if (elem->kind == Type::IFACE || !references(elem))
+        return true;
+    error("arrays of " + elem->str() + " are not supported");
+    return false;
+}
+
+// Every element of a tuple has a value.
+bool TypeChecker::tupleOf(const std::vector<const Type *> &elems) {
+    for (auto t: elems) {
+        if (t == VOID()) {
+            error("tuples cannot hold " + t->str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// The elements of an soa array are not laid out one after the other, so
+// no stride reaches them. A slice does not know the length of its
+// buffer, so it cannot release the boxes of interface values in it.
+bool TypeChecker::sliceOf(const Type *elem) {
+    if (elem->kind == Type::IFACE) {
+        error("cannot slice arrays of " + elem->str() + ", an interface");
+        return false;
+    }
+    ast::RecordDef *r = lookupRecord(elem);
+    if (r == nullptr || r->layout != soa)
+        return true;
+    error("cannot slice arrays of " + elem->str() + ", its layout is soa");
+    return false;
+}
+
+// Result type of calling func with args, nullptr if they do not fit.
+const Type *TypeChecker::apply(const Type *func, const std::vector<const Type *> &args) {
+    if (func->kind != Type::FUNCTION) {
+        error("cannot call " + func->str());
+        return nullptr;
+    }
+    if (func->elems.size() != args.size()) {
+        error("wrong number of arguments for " + func->str());
+        return nullptr;
+    }
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i] != func->elems[i]) {
+            error("argument " + std::to_string(i+1) + " should be " + func->elems[i]->str() + " not " + args[i]->str());
+            return nullptr;
+        }
+    }
+    return func->base;
+}
+
+// obj.name(args) calls the method of an interface value, or the function
+// T.name with obj as its first argument.
+const Type *TypeChecker::method(ast::Member *m, std::vector<const Type *> args) {
+    const Type *obj = check(m->obj);
+    if (obj == nullptr)
+        return nullptr;
+    const std::string &name = ast::Symbols::name(m->name);
+
+    const Type *value = obj->kind == Type::POINTER ? obj->base : obj;
+    if (name == "copyToHeap" || (name == "copyToStack" && value != obj)) {
+        if (!args.empty()) {
+            error(name + " takes no arguments");
+            return nullptr;
+        }
+        const Type *ret = value;
+        if (name == "copyToHeap") {
+            if (!canAllocate(value))
+                return nullptr;
+            ret = Types::pointer(value);
+        }
+        m->ty = Types::function(std::vector<const Type *>(1, obj), ret);
+        return ret;
+    }
+    obj = value;
+
+    const Type *func = nullptr;
+    if (obj->kind == Type::IFACE) {
+        ast::TypeList *methods = lookupIface(obj->name)->methods;
+        for (size_t i = 0; i < methods->names.size(); i++)
+            if (methods->names[i] == m->name)
+                m->slot = i;
+        if (m->slot < 0) {
+            error(obj->str() + " has no method " + name);
+            return nullptr;
+        }
+        func = methods->types[m->slot]->ty;
+        if (func == nullptr)
+            return nullptr;
+        args.insert(args.begin(), Types::named(self));
+    } else {
+        func = lookup(ast::Symbols::intern(obj->str() + "." + name));
+        if (func == nullptr) {
+            error(obj->str() + " has no method " + name);
+            return nullptr;
+        }
+        args.insert(args.begin(), obj);
+    }
+    m->ty = func;
+    return apply(func, args);
+}
+
+bool TypeChecker::run(ast::Node *root) {
+    // records, unions and interfaces may be used before their definition
+    if (ast::StmtList *stmts = dynamic_cast<ast::StmtList *>(root)) {
+        for (auto n: stmts->items) {
+            if (ast::RecordDef *r = dynamic_cast<ast::RecordDef *>(n)) {
+                declareRecord(r);
+                declare(r->name, r);
+            } else if (ast::UnionDef *u = dynamic_cast<ast::UnionDef *>(n)) {
+                declareUnion(u);
+                declare(u->name, u);
+            } else if (ast::IfaceDef *i = dynamic_cast<ast::IfaceDef *>(n)) {
+                defineIface(i);
+                declare(i->name, i);
+            }
+        }
+        for (auto n: stmts->items)
+            if (dynamic_cast<ast::IfaceDef *>(n) || dynamic_cast<ast::UnionDef *>(n) || dynamic_cast<ast::RecordDef *>(n))
+                check(n);
+    }
+    check(root);
+    return num_errors == 0;
+}
+
+void TypeChecker::visit(ast::True *v) { v->ty = Types::builtin(TY_BOOL); }
+void TypeChecker::visit(ast::False *v) { v->ty = Types::builtin(TY_BOOL); }
+// Type of the integer literal val where a value of type expected is
+// wanted: that integer type if val fits in it, Int otherwise.
+const Type *TypeChecker::literal(long val, const Type *expected) {
+    if (expected == nullptr || !isInteger(expected))
+        return Types::builtin(fits(val, TY_INT32) ? TY_INT32 : TY_INT64);
+    if (!fits(val, expected->id))
+        error("integer literal " + std::to_string(val) + " does not fit in " + expected->str());
+    return expected;
+}
+
+void TypeChecker::visit(ast::Integer *v) { v->ty = literal(v->val, hinted == v ? hint : nullptr); }
+
+void TypeChecker::visit(ast::Real *v) {
+    const Type *expected = hinted == v ? hint : nullptr;
+    if (expected && (expected->is(TY_FLOAT32) || expected->is(TY_FLOAT64)))
+        v->ty = expected;
+    else
+        v->ty = Types::builtin(TY_FLOAT32);
+}
+void TypeChecker::visit(ast::String *v) { v->ty = Types::builtin(TY_STR); }
+
+void TypeChecker::visit(ast::Variable *v) {
+    v->ty = lookup(v->val);
+    if (v->ty == nullptr && v->val < variants.size() && variants[v->val].first)
+        v->ty = construct(v, v->val, std::vector<const Type *>());
+    else if (v->ty == nullptr)
+        error("variable " + ast::Symbols::name(v->val) + " not found");
+}
+
+void TypeChecker::visit(ast::Declaration *v) {
+    const Type *spec = v->type_spec ? check(v->type_spec) : nullptr;
+    const Type *type = check(v->expr, spec);
+    if (v->type_spec) {
+        if (type && spec && type != spec)
+            error("cannot initialize " + ast::Symbols::name(v->name) + " of type " + spec->str() + " with " + type->str());
+        type = spec;
+    }
+    if (type == VOID()) {
+        error("variable " + ast::Symbols::name(v->name) + " has no value");
+        type = nullptr;
+    }
+    bind(v->name, type);
+    v->ty = VOID();
+}
+
+void TypeChecker::visit(ast::Assign *v) {
+    // a single target is checked first, the value is checked against it
+    const Type *single = v->vars.size() == 1 ? check(v->vars[0]) : nullptr;
+    const Type *type = check(v->expr, single);
+    for (auto n: v->vars) {
+        ast::Member *m = dynamic_cast<ast::Member *>(n);
+        if (!dynamic_cast<ast::Variable *>(n) && !dynamic_cast<ast::Subscript *>(n) && !m) {
+            error("cannot assign to an expression");
+            continue;
+        }
+        const Type *target = v->vars.size() == 1 ? single : check(n);
+        if (m && target && m->field < 0) {
+            error("cannot assign to an expression");
+            continue;
+        }
+        ast::Subscript *s = dynamic_cast<ast::Subscript *>(n);
+        if (s && s->var->ty && s->var->ty->kind == Type::TUPLE) {
+            error("cannot assign to an element of a tuple, tuples are values");
+            continue;
+        }
+        if (type && target && type != target)
+            error("cannot assign " + type->str() + " to " + target->str());
+    }
+    v->ty = VOID();
+}
+
+void TypeChecker::visit(ast::Call *v) {
+    ast::Variable *callee = dynamic_cast<ast::Variable *>(v->parent);
+    if (callee && lookup(callee->val) == nullptr && callee->val < records.size() && records[callee->val]) {
+        v->ty = construct(v, records[callee->val]);
+        return;
+    }
+
+    // the parameters of a function variable are the hints of its arguments
+    const Type *known = callee ? lookup(callee->val) : nullptr;
+    if (known && known->kind != Type::FUNCTION)
+        known = nullptr;
+    std::vector<const Type *> args;
+    bool ok = true;
+    for (size_t i = 0; i < v->params->items.size(); i++) {
+        args.push_back(check(v->params->items[i], known && i < known->elems.size() ? known->elems[i] : nullptr));
+        ok = ok && args.back();
+    }
+
+    // print is builtin unless the program defines its own
+    if (ast::Member *m = dynamic_cast<ast::Member *>(v->parent)) {
+        if (ok)
+            v->ty = method(m, args);
+        return;
+    }
+
+    if (callee && lookup(callee->val) == nullptr && ast::Symbols::name(callee->val) == "print") {
+        if (args.size() != 1)
+            error("print takes one argument");
+        else if (ok && args[0]->kind != Type::BUILTIN)
+            error("cannot print " + args[0]->str());
+        v->ty = VOID();
+        return;
+    }
+
+    // objects allocated in the scope die with it, a function without
+    // parameters or result has nowhere to keep them
+    if (callee && lookup(callee->val) == nullptr && ast::Symbols::name(callee->val) == "arena") {
+        ast::Variable *body = args.size() == 1 ? dynamic_cast<ast::Variable *>(v->params->items[0]) : nullptr;
+        if (!body || (ok && (args[0]->kind != Type::FUNCTION || !args[0]->elems.empty() || args[0]->base != VOID())))
+            error("arena takes a function without parameters or result");
+        v->ty = VOID();
+        return;
+    }
+
+    if (callee && lookup(callee->val) == nullptr && ast::Symbols::name(callee->val) == "range") {
+        error("range can only be iterated by a for loop");
+        return;
+    }
+
+    if (callee && lookup(callee->val) == nullptr && callee->val < variants.size() && variants[callee->val].first) {
+        if (ok)
+            v->ty = construct(v, callee->val, args);
+        return;
+    }
+
+    ast::FuncDecl *generic = callee && lookup(callee->val) == nullptr ? lookupGeneric(callee->val) : nullptr;
+    if (generic) {
+        if (!ok)
+            return;
+        v->instance = instantiate(generic, args);
+        // the proto of an instance is checked before its body, so a
+        // recursive call already knows the result type
+        const Type *proto = v->instance ? static_cast<ast::Function *>(v->instance->func)->proto->ty : nullptr;
+        if (proto)
+            v->ty = proto->base;
+        return;
+    }
+
+    const Type *func = check(v->parent);
+    if (func && ok)
+        v->ty = apply(func, args);
+}
+
+void TypeChecker::visit(ast::Return *v) {
+    const Type *type = v->e ? check(v->e, returns.empty() ? nullptr : returns.back()) : VOID();
+    v->ty = VOID();
+    if (returns.empty()) {
+        error("return outside of a function");
+        return;
+    }
+    if (type && type != returns.back())
+        error("cannot return " + type->str() + " from a function returning " + returns.back()->str());
+}
+
+void TypeChecker::visit(ast::Unary *v) {
+    const Type *expected = hinted == v ? hint : nullptr;
+    // -n is one literal, so -128 fits in an Int8
+    ast::Integer *i = v->op == T_SUB ? dynamic_cast<ast::Integer *>(v->down) : nullptr;
+    if (i) {
+        v->ty = i->ty = literal(-i->val, expected);
+        return;
+    }
+    const Type *type = check(v->down, v->op == T_SUB ? expected : nullptr);
+    if (type == nullptr)
+        return;
+    v->ty = OpTable::unaryType(v->op, type);
+    if (v->ty == nullptr)
+        error("operator not defined for " + type->str());
+}
+
+// A literal operand takes the type of the other one, two literals the
+// type the whole expression is checked against.
+void TypeChecker::visit(ast::Binary *v) {
+    const Type *L, *R;
+    if (isLiteral(v->left) && !isLiteral(v->right)) {
+        R = check(v->right);
+        L = check(v->left, R);
+    } else {
+        L = check(v->left, isLiteral(v->left) && hinted == v ? hint : nullptr);
+        R = check(v->right, L);
+    }
+    if (L == nullptr || R == nullptr)
+        return;
+    v->ty = OpTable::binaryType(v->op, L, R);
+    if (v->ty == nullptr)
+        error("operator not defined for " + L->str() + " and " + R->str());
+}
+
+void TypeChecker::visit(ast::And *v) {
+    const Type *L = check(v->left);
+    const Type *R = check(v->right);
+    if (L && R && !(L->is(TY_BOOL) && R->is(TY_BOOL)))
+        error("and needs Bool operands");
+    else if (L && R)
+        v->ty = L;
+}
+
+void TypeChecker::visit(ast::Or *v) {
+    const Type *L = check(v->left);
+    const Type *R = check(v->right);
+    if (L && R && !(L->is(TY_BOOL) && R->is(TY_BOOL)))
+        error("or needs Bool operands");
+    else if (L && R)
+        v->ty = L;
+}
+
+void TypeChecker::visit(ast::IfElse *v) {
+    const Type *cond = check(v->expr);
+    if (cond && !cond->is(TY_BOOL))
+        error("condition must be Bool, not " + cond->str());
+    body(v->body);
+    if (v->ifelse)
+        body(v->ifelse);
+    v->ty = VOID();
+}
+
+void TypeChecker::visit(ast::While *v) {
+    const Type *cond = check(v->expr);
+    if (cond && !cond->is(TY_BOOL))
+        error("condition must be Bool, not " + cond->str());
+    loop(v->body);
+    v->ty = VOID();
+}
+
+void TypeChecker::visit(ast::Break *v) {
+    if (loops == 0)
+        error("break outside of a loop");
+    v->ty = VOID();
+}
+
+void TypeChecker::visit(ast::Continue *v) {
+    if (loops == 0)
+        error("continue outside of a loop");
+    v->ty = VOID();
+}
+
+// The value of an integer literal n, or -n.
+static bool integer(ast::Node *n, long &val) {
+    ast::Unary *u = dynamic_cast<ast::Unary *>(n);
+    ast::Integer *i = dynamic_cast<ast::Integer *>(u && u->op == T_SUB ? u->down : n);
+    if (i == nullptr)
+        return false;
+    val = u && u->op == T_SUB ? -i->val : i->val;
+    return true;
+}
+
+// Type of the integers range(b), range(a, b) or range(a, b, step)
+// counts. Literal arguments take the type of the others, which must all
+// be the same.
+const Type *TypeChecker::range(ast::Call *v) {
+    size_t n = v->params->items.size();
+    if (n < 1 || n > 3) {
+        error("range takes one to three arguments");
+        return nullptr;
+    }
+
+    const Type *elem = nullptr;
+    bool ok = true;
+    for (int literals = 0; literals < 2; literals++) {
+        if (literals && elem == nullptr)
+            elem = Types::builtin(TY_INT32);
+        for (auto p: v->params->items) {
+            if (isLiteral(p) != (literals == 1))
+                continue;
+            const Type *type = check(p, elem);
+            if (type == nullptr) {
+                ok = false;
+            } else if (!isInteger(type)) {
+                error("range bounds must be integers, not " + type->str());
+                ok = false;
+            } else if (elem && type != elem) {
+                error("range bounds of type " + elem->str() + " and " + type->str());
+                ok = false;
+            } else {
+                elem = type;
+            }
+        }
+    }
+    if (!ok)
+        return nullptr;
+    long val;
+    if (n == 3 && integer(v->params->items[2], val) && val == 0) {
+        error("range step cannot be zero");
+        return nullptr;
+    }
+    return elem;
+}
+
+// Type of the payloads an iterator *I, or the one T.iter returns for a
+// T, gives to a for loop.
+const Type *TypeChecker::iterate(ast::For *v, const Type *type) {
+    const Type *it = type;
+    if (type->kind != Type::POINTER && type->kind != Type::IFACE) {
+        v->iter = lookup(ast::Symbols::intern(type->str() + ".iter"));
+        if (v->iter) {
+            if (v->iter->kind != Type::FUNCTION || v->iter->elems.size() != 1 || v->iter->elems[0] != type || v->iter->base->kind != Type::POINTER) {
+                error(type->str() + ".iter must take a " + type->str() + " and return an iterator *I");
+                return nullptr;
+            }
+            it = v->iter->base;
+        }
+    }
+
+    v->next = it->kind == Type::POINTER ? lookup(ast::Symbols::intern(it->base->str() + ".next")) : nullptr;
+    if (v->next == nullptr) {
+        error("cannot iterate over " + type->str());
+        return nullptr;
+    }
+
+    const Type *next = v->next;
+    ast::UnionDef *u = next->kind == Type::FUNCTION ? lookupUnion(next->base) : nullptr;
+    ast::UnionList *items = u ? static_cast<ast::UnionList *>(u->type_list) : nullptr;
+    std::string fname = it->base->str() + ".next";
+    if (u == nullptr || next->elems.size() != 1 || next->elems[0] != it || items->items.size() != 2) {
+        error(fname + " must take a " + it->str() + " and return a union like Maybe{T}");
+        return nullptr;
+    }
+    const Type *first = payload(next->base, 0), *second = payload(next->base, 1);
+    if ((first == nullptr) == (second == nullptr)) {
+        error(fname + " must return a union with one variant without a payload and one with");
+        return nullptr;
+    }
+    v->walk = v->iter ? ast::For::ITERABLE : ast::For::ITERATOR;
+    return first ? first : second;
+}
+
+void TypeChecker::visit(ast::For *v) {
+    ast::Call *call = dynamic_cast<ast::Call *>(v->iterable);
+    ast::Variable *callee = call ? dynamic_cast<ast::Variable *>(call->parent) : nullptr;
+    const Type *elem = nullptr;
+    if (callee && lookup(callee->val) == nullptr && ast::Symbols::name(callee->val) == "range") {
+        v->walk = ast::For::RANGE;
+        elem = range(call);
+    } else if (const Type *type = check(v->iterable)) {
+        elem = isSequence(type) ? type->base : iterate(v, type);
+    }
+    v->elem = elem;
+
+    pushScope();
+    bind(v->vname, elem);
+    loop(v->body);
+    popScope();
+    v->ty = VOID();
+}
+
+// Literal elements take the type of the others, or the element type the
+// array is checked against.
+void TypeChecker::visit(ast::Array *v) {
+    const Type *elem = nullptr;
+    bool ok = true;
+    for (int literals = 0; literals < 2; literals++) {
+        if (literals && elem == nullptr && hinted == v && hint && hint->kind == Type::ARRAY)
+            elem = hint->base;
+        for (auto n: v->elems->items) {
+            if (isLiteral(n) != (literals == 1))
+                continue;
+            const Type *type = check(n, elem);
+            if (type == nullptr)
+                ok = false;
+            else if (elem == nullptr)
+                elem = type;
+            else if (type != elem && ok) {
+                error("array elements of type " + elem->str() + " and " + type->str());
+                ok = false;
+            }
+        }
+    }
+    if (v->elems->items.empty())
+        error("cannot infer the type of an empty array");
+    else if (ok && arrayOf(elem))
+        v->ty = Types::array(elem);
+}
+
+void TypeChecker::visit(ast::Subscript *v) {
+    const Type *type = check(v->var);
+    const Type *idx = check(v->idx);
+    if (type == nullptr || idx == nullptr)
+        return;
+    ast::Integer *i = dynamic_cast<ast::Integer *>(v->idx);
+    if (type->kind == Type::TUPLE) {
+        if (i == nullptr || i->val < 0 || i->val >= (long)type->elems.size())
+            error("a tuple " + type->str() + " is indexed by a constant from 0 to " + std::to_string(type->elems.size() - 1));
+        else
+            v->ty = type->elems[i->val];
+    } else if (!isSequence(type))
+        error("cannot index " + type->str());
+    else if (!isInteger(idx))
+        error("array index must be an integer, not " + idx->str());
+    else
+        v->ty = type->base;
+}
+
+void TypeChecker::visit(ast::Expr *v) {
+    check(v->e);
+    v->ty = VOID();
+}
+
+// Whether a break in n leaves the loop n is the body of.
+static bool breaks(ast::Node *n) {
+    if (dynamic_cast<ast::Break *>(n))
+        return true;
+    if (ast::StmtList *l = dynamic_cast<ast::StmtList *>(n)) {
+        for (auto s: l->items)
+            if (breaks(s))
+                return true;
+    } else if (ast::IfElse *i = dynamic_cast<ast::IfElse *>(n)) {
+        return breaks(i->body) || (i->ifelse && breaks(i->ifelse));
+    } else if (ast::Match *m = dynamic_cast<ast::Match *>(n)) {
+        for (auto a: m->arms->items)
+            if (breaks(static_cast<ast::MatchArm *>(a)->body))
+                return true;
+    }
+    return false;
+}
+
+// Whether control never reaches the end of n: every path through it
+// returns or stays in a while true loop.
+bool TypeChecker::exits(ast::Node *n) {
+    if (dynamic_cast<ast::Return *>(n))
+        return true;
+    if (ast::StmtList *l = dynamic_cast<ast::StmtList *>(n)) {
+        for (auto s: l->items)
+            if (exits(s))
+                return true;
+    } else if (ast::IfElse *i = dynamic_cast<ast::IfElse *>(n)) {
+        return i->ifelse && exits(i->body) && exits(i->ifelse);
+    } else if (ast::While *w = dynamic_cast<ast::While *>(n)) {
+        return dynamic_cast<ast::True *>(w->expr) && !breaks(w->body);
+    } else if (ast::Match *m = dynamic_cast<ast::Match *>(n)) {
+        // the checker rejected arms that repeat a variant
+        ast::UnionDef *u = m->expr->ty ? lookupUnion(m->expr->ty) : nullptr;
+        bool all = u && m->arms->items.size() == static_cast<ast::UnionList *>(u->type_list)->items.size();
+        for (auto a: m->arms->items) {
+            ast::MatchArm *arm = static_cast<ast::MatchArm *>(a);
+            all = all || arm->name == ast::Symbols::EMPTY;
+            if (!exits(arm->body))
+                return false;
+        }
+        return all;
+    }
+    return false;
+}
+
+void TypeChecker::visit(ast::Function *v) {
+    const Type *type = check(v->proto);
+    if (type == nullptr)
+        return;
+
+    // a function body sees the enclosing scopes but not their loops
+    unsigned outer_loops = loops;
+    loops = 0;
+    returns.push_back(type->base);
+    pushScope();
+    ast::TypeList *params = v->proto->params;
+    for (size_t i = 0; i < params->names.size(); i++)
+        bind(params->names[i], type->elems[i]);
+    check(v->body);
+    popScope();
+    returns.pop_back();
+    loops = outer_loops;
+    if (type->base != VOID() && !exits(v->body))
+        error("function returning " + type->base->str() + " can end without a return");
+
+    v->ty = type;
+}
+
+void TypeChecker::visit(ast::FuncDecl *v) {
+    declare(v->name, v);
+    // generic functions are checked through their instances
+    if (v->generics) {
+        if (v->name >= generics.size())
+            generics.resize(ast::Symbols::size(), nullptr);
+        generics[v->name] = v;
+        generic_scopes[v] = bindings;
+        v->ty = VOID();
+        return;
+    }
+
+    // bound before the body is checked, so functions can recurse
+    ast::Function *func = static_cast<ast::Function *>(v->func);
+    bind(v->name, check(func->proto));
+    check(func);
+    v->ty = VOID();
+}
+
+void TypeChecker::visit(ast::UnionItem *v) {
+    if (v->type_spec)
+        check(v->type_spec);
+    v->ty = VOID();
+}
+
+void TypeChecker::visit(ast::UnionList *v) {
+    for (auto n: v->items)
+        check(n);
+    v->ty = VOID();
+}
+
+void TypeChecker::visit(ast::RecordDef *v) {
+    declareRecord(v);
+    if (v->ty)
+        return;
+    const std::string &rname = ast::Symbols::name(v->name);
+    if (v->layout != ast::Symbols::EMPTY && v->layout != fixed && v->layout != soa)
+        error("unknown layout " + ast::Symbols::name(v->layout) + " of " + rname + ", it is fixed or soa");
+
+    ast::TypeList *fields = static_cast<ast::TypeList *>(v->decl_list);
+    check(fields);
+    for (size_t i = 0; i < fields->names.size(); i++) {
+        const std::string &fname = ast::Symbols::name(fields->names[i]);
+        const Type *type = fields->types[i]->ty;
+        std::vector<const Type *> seen;
+        if (field(v, fields->names[i]) != (int)i)
+            error("field " + fname + " of " + rname + " is already defined");
+        else if (type && type->kind == Type::IFACE)
+            error("field " + fname + " of " + rname + " cannot be an interface");
+        else if (contains(type, v->name, seen))
+            error("record " + rname + " cannot hold itself, use a pointer");
+    }
+    v->ty = VOID();
+}
+
+// A generic union is checked with its type parameters standing for
+// themselves, instances substitute them.
+void TypeChecker::visit(ast::UnionDef *v) {
+    declareUnion(v);
+    if (v->ty)
+        return;
+    ast::TypeList *params = v->generics;
+    std::vector<const Type *> saved;
+    for (size_t i = 0; params && i < params->names.size(); i++) {
+        saved.push_back(typeParam(params->names[i]));
+        setTypeParam(params->names[i], Types::named(params->names[i]));
+    }
+    check(v->type_list);
+    for (size_t i = 0; params && i < params->names.size(); i++)
+        setTypeParam(params->names[i], saved[i]);
+
+    for (auto n: static_cast<ast::UnionList *>(v->type_list)->items) {
+        ast::UnionItem *item = static_cast<ast::UnionItem *>(n);
+        std::vector<const Type *> seen;
+        if (item->type_spec && contains(item->type_spec->ty, v->name, seen))
+            error("union " + ast::Symbols::name(v->name) + " cannot hold itself, use a pointer");
+    }
+    v->ty = VOID();
+}
+
+void TypeChecker::visit(ast::ExprList *v) {
+    for (auto n: v->items)
+        check(n);
+    v->ty = VOID();
+}
+
+void TypeChecker::visit(ast::StmtList *v) {
+    for (auto n: v->items)
+        check(n);
+    v->ty = VOID();
+}
+
+void TypeChecker::visit(ast::SimpleType *v) {
+    const std::string &name = ast::Symbols::name(v->tname);
+    TypeId id = typeIdByName(name);
+    if (const Type *param = typeParam(v->tname))
+        v->ty = param;
+    else if (id != TY_OTHER)
+        v->ty = Types::builtin(id);
+    else if (v->tname < unions.size() && unions[v->tname] && unions[v->tname]->generics)
+        error(name + " needs type arguments");
+    else if (v->tname < type_names.size() && type_names[v->tname])
+        v->ty = Types::named(v->tname);
+    else if (lookupIface(v->tname))
+        v->ty = Types::iface(v->tname);
+    else
+        error("unknown type " + name);
+}
+
+void TypeChecker::visit(ast::RefType *v) {
+    if (const Type *base = check(v->base_type))
+        v->ty = Types::reference(base);
+}
+
+void TypeChecker::visit(ast::PtrType *v) {
+    if (const Type *base = check(v->base_type))
+        v->ty = Types::pointer(base);
+}
+
+void TypeChecker::visit(ast::ArrayType *v) {
+    const Type *base = check(v->base_type);
+    if (base && arrayOf(base))
+        v->ty = Types::array(base);
+}
+
+void TypeChecker::visit(ast::SliceType *v) {
+    const Type *base = check(v->base_type);
+    if (base && arrayOf(base) && sliceOf(base))
+        v->ty = Types::slice(base);
+}
+
+void TypeChecker::visit(ast::TupleType *v) {
+    const Type *elems = check(v->base_type);
+    if (elems && tupleOf(elems->elems))
+        v->ty = Types::tuple(elems->elems);
+}
+
+void TypeChecker::visit(ast::FuncType *v) {
+    const Type *params = check(v->params);
+    const Type *ret = v->ret ? check(v->ret) : VOID();
+    if (params && ret)
+        v->ty = Types::function(params->elems, ret);
+}
+
+// A type list resolves to the tuple of its types.
+void TypeChecker::visit(ast::TypeList *v) {
+    std::vector<const Type *> elems;
+    bool ok = true;
+    for (auto t: v->types) {
+        elems.push_back(check(t));
+        ok = ok && elems.back();
+    }
+    if (ok)
+        v->ty = Types::tuple(elems);
+}
+
+// Methods are checked with Self bound to a placeholder type, the first
+// parameter stands for the object and no other may mention it.
+void TypeChecker::visit(ast::IfaceDef *v) {
+    if (v->ty)
+        return;
+    defineIface(v);
+    const Type *placeholder = Types::named(self);
+    const Type *saved = typeParam(self);
+    setTypeParam(self, placeholder);
+
+    ast::TypeList *methods = v->methods;
+    for (size_t i = 0; i < methods->names.size(); i++) {
+        const Type *sig = check(methods->types[i]);
+        if (sig == nullptr)
+            continue;
+        const std::string name = ast::Symbols::name(v->name) + "." + ast::Symbols::name(methods->names[i]);
+        bool ok = !sig->elems.empty() && sig->elems[0] == placeholder && sig->base != placeholder;
+        for (size_t j = 1; j < sig->elems.size(); j++)
+            ok = ok && sig->elems[j] != placeholder;
+        if (!ok) {
+            error("method " + name + " must take Self as its first and only Self parameter");
+            methods->types[i]->ty = nullptr;
+        }
+    }
+
+    setTypeParam(self, saved);
+    v->ty = VOID();
+}
+
+void TypeChecker::visit(ast::Cast *v) {
+    const Type *from = check(v->expr);
+    const Type *to = check(v->type);
+    if (from == nullptr || to == nullptr)
+        return;
+    if (from == to || (isScalar(from) && isScalar(to)))
+        v->ty = to;
+    else if (from->kind == Type::ARRAY && to->kind == Type::SLICE && from->base == to->base)
+        v->ty = to;
+    else if (to->kind == Type::IFACE) {
+        if (implements(from, to))
+            v->ty = to;
+    } else
+        error("cannot cast " + from->str() + " to " + to->str());
+}
+
+// A field, of a record or of the record a pointer points to, or the
+// length of a sequence. obj.name(...) is checked by the call.
+void TypeChecker::visit(ast::Member *v) {
+    const Type *obj = check(v->obj);
+    if (obj == nullptr)
+        return;
+    ast::RecordDef *r = lookupRecord(obj->kind == Type::POINTER ? obj->base : obj);
+    if (r && (v->field = field(r, v->name)) >= 0)
+        v->ty = static_cast<ast::TypeList *>(r->decl_list)->types[v->field]->ty;
+    else if (isSequence(obj) && ast::Symbols::name(v->name) == "length")
+        v->ty = Types::builtin(TY_INT32);
+    else
+        error(obj->str() + " has no member " + ast::Symbols::name(v->name));
+}
+
+void TypeChecker::visit(ast::New *v) {
+    const Type *type = check(v->expr);
+    if (type && canAllocate(type))
+        v->ty = Types::pointer(type);
+}
+
+// The bounds are checked when the slice is taken, an omitted one is the
+// start or end of var.
+void TypeChecker::visit(ast::Slice *v) {
+    const Type *type = check(v->var);
+    bool ok = type != nullptr;
+    for (ast::Node *n: { v->lo, v->hi, v->step }) {
+        const Type *bound = n ? check(n) : nullptr;
+        if (bound && !isInteger(bound)) {
+            error("slice bounds must be integers, not " + bound->str());
+            ok = false;
+        } else if (n && bound == nullptr)
+            ok = false;
+    }
+    if (type && !isSequence(type))
+        error("cannot slice " + type->str());
+    else if (ok && sliceOf(type->base))
+        v->ty = Types::slice(type->base);
+}
+
+void TypeChecker::visit(ast::GenericType *v) {
+    ast::UnionDef *u = v->tname < unions.size() ? unions[v->tname] : nullptr;
+    const Type *args = check(v->args);
+    if (u == nullptr || u->generics == nullptr)
+        error(ast::Symbols::name(v->tname) + " is not a generic type");
+    else if (args)
+        v->ty = instance(u, args->elems);
+}
+
+// Every arm names a different variant of the union matched on, an arm
+// that binds the payload sees it as a new variable.
+void TypeChecker::visit(ast::Match *v) {
+    const Type *type = check(v->expr);
+    ast::UnionDef *u = type ? lookupUnion(type) : nullptr;
+    if (type && u == nullptr)
+        error("cannot match on " + type->str());
+
+    std::vector<ast::symbol_t> seen;
+    for (auto n: v->arms->items) {
+        ast::MatchArm *arm = static_cast<ast::MatchArm *>(n);
+        const std::string &name = ast::Symbols::name(arm->name);
+        const Type *bound = nullptr;
+        if (u && arm->name != ast::Symbols::EMPTY) {
+            if (arm->name >= variants.size() || variants[arm->name].first != u)
+                error(name + " is not a variant of " + type->str());
+            else if (std::find(seen.begin(), seen.end(), arm->name) != seen.end())
+                error("variant " + name + " is matched twice");
+            else {
+                seen.push_back(arm->name);
+                bound = payload(type, variants[arm->name].second);
+                if (arm->var != ast::Symbols::EMPTY && bound == nullptr)
+                    error("variant " + name + " has no value to bind");
+            }
+        }
+        pushScope();
+        if (arm->var != ast::Symbols::EMPTY)
+            bind(arm->var, bound);
+        check(arm);
+        popScope();
+    }
+    v->arms->ty = VOID();
+    v->ty = VOID();
+}
+
+void TypeChecker::visit(ast::MatchArm *v) {
+    body(v->body);
+    v->ty = VOID();
+}
+
+// outside a record constructor, which checks the argument itself
+void TypeChecker::visit(ast::NamedArg *v) {
+    check(v->expr);
+    error("only records take named arguments, not " + ast::Symbols::name(v->name) + "=");
+}
+
+// Each element is checked against the matching one of the tuple it is
+// declared as, if any.
+void TypeChecker::visit(ast::Tuple *v) {
+    const Type *expected = hinted == v ? hint : nullptr;
+    if (expected && (expected->kind != Type::TUPLE || expected->elems.size() != v->elems->items.size()))
+        expected = nullptr;
+    std::vector<const Type *> elems;
+    bool ok = true;
+    for (size_t i = 0; i < v->elems->items.size(); i++) {
+        elems.push_back(check(v->elems->items[i], expected ? expected->elems[i] : nullptr));
+        ok = ok && elems.back();
+    }
+    v->elems->ty = VOID();
+    if (ok && tupleOf(elems))
+        v->ty = Types::tuple(elems);
+}
+
+void TypeChecker::visit(ast::Unpack *v) {
+    const Type *type = check(v->expr);
+    std::vector<const Type *> elems;
+    if (type && v->tname == ast::Symbols::EMPTY) {
+        if (type->kind == Type::TUPLE)
+            elems = type->elems;
+        else
+            error("cannot unpack " + type->str() + ", it is not a tuple");
+    } else if (type) {
+        ast::RecordDef *r = lookupRecord(type);
+        if (r == nullptr || r->name != v->tname)
+            error("cannot unpack " + type->str() + " as " + ast::Symbols::name(v->tname));
+        else
+            for (auto t: static_cast<ast::TypeList *>(r->decl_list)->types)
+                elems.push_back(t->ty);
+    }
+    if (!elems.empty() && elems.size() != v->vars->names.size()) {
+        error("cannot unpack " + type->str() + " into " + std::to_string(v->vars->names.size()) + " variables");
+        elems.clear();
+    }
+    for (size_t i = 0; i < v->vars->names.size(); i++)
+        bind(v->vars->names[i], elems.empty() ? nullptr : elems[i]);
+    v->ty = VOID();
+}
@@ -0,0 +1,206 @@
+#ifndef __TYPECHECK_H__
+#define __TYPECHECK_H__
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "arena.h"
+#include "ast.h"
+#include "types.h"
+
+/*
+ * Resolves the type of every node before code generation and reports
+ * type errors. Expressions get their type, statements the void type and
+ * type annotations the type they name. A node that failed to check is
+ * left with a null type; errors are not reported again for the nodes
+ * around it.
+ *
+ * Generic functions are checked once per instantiation: a call infers
+ * the type parameters from its arguments and gets a copy of the function
+ * checked under those types, which codegen emits as its own function.
+ * Instances are cached by declaration and type arguments, and named
+ * after the type arguments and a fingerprint of the declaration and of
+ * every declaration a name in it may resolve to, so the same instance
+ * from two modules has the same name and the linker keeps one copy.
+ *
+ * A type implements an interface when, for every method m, a function
+ * T.m exists whose type is the method's with T in place of Self. Self
+ * can only be the first parameter of a method.
+ *
+ * A union is a named type, Name{args} for an instance of a generic one.
+ * Variants are built by name, None or Some(x); the type arguments come
+ * from the payload or, failing that, from the type the value is declared,
+ * assigned or returned as.
+ *
+ * A record is a named type too. It is built by its name with its fields
+ * in order, Point(1.0, 2.0), or by name, Point(x=1.0, y=2.0), and its
+ * fields are read and assigned as p.x, also through a pointer *Point.
+ * Arrays of a record declared as soa cannot be sliced.
+ *
+ * Tuples are values: t[i] reads an element at a constant index and
+ * var (a, b) = t unpacks one, as var Name(a, b) = r does a record.
+ *
+ * for x in a walks the elements of an array or slice. for x in
+ * range(a, b, step) counts from a up or down to b, b excluded; range is
+ * builtin, like print, and only works as the iterable of a for. Any
+ * other value is an iterator *I when a function I.next |*I| -> U
+ * exists, for a union U with one variant without a payload and one with
+ * one, like Maybe{T}: x is each payload next returns, until it returns
+ * the other variant. A value T is iterable when T.iter |T| -> *I
+ * returns an iterator.
+ *
+ * arena(f) calls a function f without parameters or result, allocating
+ * every heap object it creates from a scope freed when f returns. A
+ * function without a result leaves out its -> type.
+ *
+ * A function that returns a value must return it on every path.
+ *
+ * Methods called on a heap value *T are those of T. Every value has the
+ * builtin methods copyToHeap, which returns a new *T, and copyToStack
+ * on heap values, which returns the T it points to.
+ */
+class TypeChecker: public ast::Visitor {
+    private:
+        typedef std::vector<std::pair<ast::symbol_t, const sema::Type *> > scope_t;
+
+        // innermost binding of every symbol, like Codegen
+        std::vector<const sema::Type *> bindings;
+        std::vector<scope_t> env;
+        std::vector<bool> type_names;
+        std::vector<const sema::Type *> returns;
+        unsigned loops;
+
+        Arena &arena;
+        // by symbol, like bindings
+        std::vector<ast::FuncDecl *> generics;
+        std::vector<const sema::Type *> type_params;
+        std::vector<ast::IfaceDef *> ifaces;
+        std::vector<ast::UnionDef *> unions;
+        std::vector<ast::RecordDef *> records;
+        // the union and index of every variant
+        std::vector<std::pair<ast::UnionDef *, size_t> > variants;
+        ast::symbol_t self;
+        ast::symbol_t fixed, soa;
+
+        // type a node is checked against, for variants like None whose
+        // type arguments cannot be inferred from a payload
+        ast::Node *hinted;
+        const sema::Type *hint;
+
+        typedef std::pair<ast::FuncDecl *, std::vector<const sema::Type *> > instance_key_t;
+        std::map<instance_key_t, ast::FuncDecl *> instances;
+        // bindings where each generic function is declared, its instances
+        // are checked in them rather than in the scope of a call
+        std::map<ast::FuncDecl *, std::vector<const sema::Type *> > generic_scopes;
+        // functions and types declared so far by name, methods T.m also
+        // by m, for the fingerprints of instances
+        std::multimap<ast::symbol_t, ast::Node *> declarations;
+
+        std::string errors;
+        int num_errors;
+
+        void error(const std::string &msg);
+        const sema::Type *check(ast::Node *n);
+        const sema::Type *check(ast::Node *n, const sema::Type *expected);
+        const sema::Type *lookup(ast::symbol_t name);
+        void bind(ast::symbol_t name, const sema::Type *type);
+        void defineType(ast::symbol_t name);
+        void pushScope();
+        void popScope();
+        void body(ast::Node *n);
+        void loop(ast::Node *n);
+        bool exits(ast::Node *n);
+
+        ast::FuncDecl *lookupGeneric(ast::symbol_t name);
+        const sema::Type *typeParam(ast::symbol_t name);
+        void setTypeParam(ast::symbol_t name, const sema::Type *type);
+        bool unify(ast::TypeList *generics, ast::Type *param, const sema::Type *arg, std::vector<const sema::Type *> &subst);
+        bool satisfies(const sema::Type *type, ast::Type *constraint);
+        void declare(ast::symbol_t name, ast::Node *n);
+        std::string mangle(ast::FuncDecl *decl, const std::vector<const sema::Type *> &subst);
+        ast::FuncDecl *instantiate(ast::FuncDecl *decl, const std::vector<const sema::Type *> &args);
+        ast::IfaceDef *lookupIface(ast::symbol_t name);
+        void defineIface(ast::IfaceDef *v);
+        bool implements(const sema::Type *type, const sema::Type *iface);
+        void declareUnion(ast::UnionDef *v);
+        ast::UnionDef *lookupUnion(const sema::Type *type);
+        const sema::Type *instance(ast::UnionDef *u, const std::vector<const sema::Type *> &args);
+        const sema::Type *payload(const sema::Type *type, size_t i);
+        const sema::Type *construct(ast::Node *n, ast::symbol_t name, const std::vector<const sema::Type *> &args);
+        void declareRecord(ast::RecordDef *v);
+        ast::RecordDef *lookupRecord(const sema::Type *type);
+        int field(ast::RecordDef *r, ast::symbol_t name);
+        const sema::Type *construct(ast::Call *v, ast::RecordDef *r);
+        bool contains(const sema::Type *type, ast::symbol_t name, std::vector<const sema::Type *> &seen);
+        bool references(const sema::Type *type);
+        bool canAllocate(const sema::Type *type);
+        bool arrayOf(const sema::Type *elem);
+        bool sliceOf(const sema::Type *elem);
+        bool tupleOf(const std::vector<const sema::Type *> &elems);
+        const sema::Type *apply(const sema::Type *func, const std::vector<const sema::Type *> &args);
+        const sema::Type *method(ast::Member *m, std::vector<const sema::Type *> args);
+        const sema::Type *literal(long val, const sema::Type *expected);
+        const sema::Type *range(ast::Call *v);
+        const sema::Type *iterate(ast::For *v, const sema::Type *type);
+
+    public:
+        // copies of generic functions are allocated in arena
+        TypeChecker(Arena &arena);
+
+        bool run(ast::Node *root);
+        const std::string &getErrors() const { return errors; }
+        int getNumErrors() const { return num_errors; }
+
+        virtual void visit(ast::True *v);
+        virtual void visit(ast::False *v);
+        virtual void visit(ast::Integer *v);
+        virtual void visit(ast::Real *v);
+        virtual void visit(ast::String *v);
+        virtual void visit(ast::Variable *v);
+        virtual void visit(ast::Declaration *v);
+        virtual void visit(ast::Assign *v);
+        virtual void visit(ast::Call *v);
+        virtual void visit(ast::Return *v);
+        virtual void visit(ast::Unary *v);
+        virtual void visit(ast::Binary *v);
+        virtual void visit(ast::And *v);
+        virtual void visit(ast::Or *v);
+        virtual void visit(ast::IfElse *v);
+        virtual void visit(ast::While *v);
+        virtual void visit(ast::Break *v);
+        virtual void visit(ast::Continue *v);
+        virtual void visit(ast::For *v);
+        virtual void visit(ast::Array *v);
+        virtual void visit(ast::Subscript *v);
+        virtual void visit(ast::Expr *v);
+        virtual void visit(ast::Function *v);
+        virtual void visit(ast::FuncDecl *v);
+        virtual void visit(ast::UnionItem *v);
+        virtual void visit(ast::UnionList *v);
+        virtual void visit(ast::RecordDef *v);
+        virtual void visit(ast::UnionDef *v);
+        virtual void visit(ast::ExprList *v);
+        virtual void visit(ast::StmtList *v);
+        virtual void visit(ast::SimpleType *v);
+        virtual void visit(ast::RefType *v);
+        virtual void visit(ast::PtrType *v);
+        virtual void visit(ast::ArrayType *v);
+        virtual void visit(ast::TupleType *v);
+        virtual void visit(ast::FuncType *v);
+        virtual void visit(ast::TypeList *v);
+        virtual void visit(ast::IfaceDef *v);
+        virtual void visit(ast::Cast *v);
+        virtual void visit(ast::Member *v);
+        virtual void visit(ast::New *v);
+        virtual void visit(ast::Slice *v);
+        virtual void visit(ast::SliceType *v);
+        virtual void visit(ast::GenericType *v);
+        virtual void visit(ast::Match *v);
+        virtual void visit(ast::MatchArm *v);
+        virtual void visit(ast::NamedArg *v);
+        virtual void visit(ast::Tuple *v);
+        virtual void visit(ast::Unpack *v);
+};
+
+#endif//__TYPECHECK_H__
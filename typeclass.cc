@@ -0,0 +1,144 @@
+#include "typeclass.h"
+
+::llvm::Type *typeIdType(::llvm::LLVMContext &ctx, TypeId id) {
+    switch (id) {
+        case TY_BOOL: return ::llvm::Type::getInt1Ty(ctx);
+        case TY_INT8: case TY_UNT8: return ::llvm::Type::getInt8Ty(ctx);
+        case TY_INT16: case TY_UNT16: return ::llvm::Type::getInt16Ty(ctx);
+        case TY_INT32: case TY_UNT32: return ::llvm::Type::getInt32Ty(ctx);
+        case TY_INT64: case TY_UNT64: return ::llvm::Type::getInt64Ty(ctx);
+        case TY_FLOAT32: return ::llvm::Type::getFloatTy(ctx);
+        case TY_FLOAT64: return ::llvm::Type::getDoubleTy(ctx);
+        case TY_STR: return ::llvm::Type::getInt8PtrTy(ctx);
+        default: return nullptr;
+    }
+}
+
+namespace {
+    typedef OpTable::builder_t builder_t;
+    using ::llvm::Value;
+
+    Expr *boolean(builder_t &b, Value *v) {
+        return new Expr(sema::Types::builtin(TY_BOOL), b.getInt1Ty(), v);
+    }
+
+    Expr *same(const Expr *e, Value *v) {
+        return new Expr(e->ty, e->type, v);
+    }
+
+#define BINARY(fname, body) \
+    Expr *fname(builder_t &b, Expr *LE, Expr *RE) { \
+        Value *L = LE->value, *R = RE->value; \
+        return body; \
+    }
+#define UNARY(fname, body) \
+    Expr *fname(builder_t &b, Expr *VE) { \
+        Value *V = VE->value; \
+        return body; \
+    }
+
+    BINARY(iadd, same(LE, b.CreateAdd(L, R)))
+    BINARY(isub, same(LE, b.CreateSub(L, R)))
+    BINARY(imul, same(LE, b.CreateMul(L, R)))
+    BINARY(ishl, same(LE, b.CreateShl(L, R)))
+    BINARY(iand, same(LE, b.CreateAnd(L, R)))
+    BINARY(ior, same(LE, b.CreateOr(L, R)))
+    BINARY(ixor, same(LE, b.CreateXor(L, R)))
+    BINARY(ieq, boolean(b, b.CreateICmpEQ(L, R)))
+    BINARY(ine, boolean(b, b.CreateICmpNE(L, R)))
+    UNARY(ipos, same(VE, V))
+    UNARY(ineg, same(VE, b.CreateNeg(V)))
+    UNARY(inot, same(VE, b.CreateNot(V)))
+
+    BINARY(sdiv, same(LE, b.CreateSDiv(L, R)))
+    BINARY(srem, same(LE, b.CreateSRem(L, R)))
+    BINARY(sshr, same(LE, b.CreateAShr(L, R)))
+    BINARY(slt, boolean(b, b.CreateICmpSLT(L, R)))
+    BINARY(sgt, boolean(b, b.CreateICmpSGT(L, R)))
+    BINARY(sle, boolean(b, b.CreateICmpSLE(L, R)))
+    BINARY(sge, boolean(b, b.CreateICmpSGE(L, R)))
+
+    BINARY(udiv, same(LE, b.CreateUDiv(L, R)))
+    BINARY(urem, same(LE, b.CreateURem(L, R)))
+    BINARY(ushr, same(LE, b.CreateLShr(L, R)))
+    BINARY(ult, boolean(b, b.CreateICmpULT(L, R)))
+    BINARY(ugt, boolean(b, b.CreateICmpUGT(L, R)))
+    BINARY(ule, boolean(b, b.CreateICmpULE(L, R)))
+    BINARY(uge, boolean(b, b.CreateICmpUGE(L, R)))
+
+    BINARY(fadd, same(LE, b.CreateFAdd(L, R)))
+    BINARY(fsub, same(LE, b.CreateFSub(L, R)))
+    BINARY(fmul, same(LE, b.CreateFMul(L, R)))
+    BINARY(fdiv, same(LE, b.CreateFDiv(L, R)))
+    BINARY(fmod, same(LE, b.CreateFRem(L, R)))
+    BINARY(flt, boolean(b, b.CreateFCmpOLT(L, R)))
+    BINARY(fgt, boolean(b, b.CreateFCmpOGT(L, R)))
+    BINARY(fle, boolean(b, b.CreateFCmpOLE(L, R)))
+    BINARY(fge, boolean(b, b.CreateFCmpOGE(L, R)))
+    BINARY(feq, boolean(b, b.CreateFCmpOEQ(L, R)))
+    BINARY(fne, boolean(b, b.CreateFCmpONE(L, R)))
+    UNARY(fpos, same(VE, V))
+    UNARY(fneg, same(VE, b.CreateFNeg(V)))
+
+#undef BINARY
+#undef UNARY
+}
+
+OpTable::OpTable() {
+    for (int t = 0; t < NUM_TYPE_IDS; t++) {
+        for (int op = 0; op < NUM_BINARY_OPS; op++)
+            binary_ops[t][op] = nullptr;
+        for (int op = 0; op < NUM_UNARY_OPS; op++)
+            unary_ops[t][op] = nullptr;
+    }
+
+    addInteger(TY_INT8, true);
+    addInteger(TY_INT16, true);
+    addInteger(TY_INT32, true);
+    addInteger(TY_INT64, true);
+    addInteger(TY_UNT8, false);
+    addInteger(TY_UNT16, false);
+    addInteger(TY_UNT32, false);
+    addInteger(TY_UNT64, false);
+    addFloat(TY_FLOAT32);
+    addFloat(TY_FLOAT64);
+    addBool();
+}
+
+void OpTable::addInteger(TypeId id, bool is_signed) {
+    binary_t *b = binary_ops[id];
+    b[OP_ADD] = iadd; b[OP_SUB] = isub; b[OP_MUL] = imul;
+    b[OP_SHL] = ishl; b[OP_AND] = iand; b[OP_OR] = ior; b[OP_XOR] = ixor;
+    b[OP_EQ] = ieq; b[OP_NE] = ine;
+    if (is_signed) {
+        b[OP_DIV] = sdiv; b[OP_MOD] = srem; b[OP_SHR] = sshr;
+        b[OP_LT] = slt; b[OP_GT] = sgt; b[OP_LE] = sle; b[OP_GE] = sge;
+    } else {
+        b[OP_DIV] = udiv; b[OP_MOD] = urem; b[OP_SHR] = ushr;
+        b[OP_LT] = ult; b[OP_GT] = ugt; b[OP_LE] = ule; b[OP_GE] = uge;
+    }
+
+    unary_t *u = unary_ops[id];
+    u[OP_POS] = ipos; u[OP_BITNEG] = inot;
+    if (is_signed)
+        u[OP_NEG] = ineg;
+}
+
+void OpTable::addFloat(TypeId id) {
+    binary_t *b = binary_ops[id];
+    b[OP_ADD] = fadd; b[OP_SUB] = fsub; b[OP_MUL] = fmul;
+    b[OP_DIV] = fdiv; b[OP_MOD] = fmod;
+    b[OP_LT] = flt; b[OP_GT] = fgt; b[OP_LE] = fle;
+    b[OP_GE] = fge; b[OP_EQ] = feq; b[OP_NE] = fne;
+
+    unary_t *u = unary_ops[id];
+    u[OP_POS] = fpos; u[OP_NEG] = fneg;
+}
+
+void OpTable::addBool() {
+    binary_t *b = binary_ops[TY_BOOL];
+    b[OP_AND] = iand; b[OP_OR] = ior; b[OP_XOR] = ixor;
+    b[OP_EQ] = ieq; b[OP_NE] = ine;
+
+    unary_ops[TY_BOOL][OP_NOT] = inot;
+}
@@ -1,68 +1,124 @@
 #ifndef _TYPECLASS_H__
 #define _TYPECLASS_H__
 
-class TypeClass {
-protected:
-    std::map<std::string,> func_list;
-    std::string signature;
+#include <string>
+#include <llvm/IR/IRBuilder.h>
+#include "mamba_context.h"
+#include "types.h"
 
-public:
-    bool has_function(std::string func_name, std::vector<TypeClass*> params) const;
-    void apply_function(std::string func_name);
-    std::string get_signature() const;
-};
+::llvm::Type *typeIdType(::llvm::LLVMContext &ctx, TypeId id);
 
-class FuncTypeClass: public TypeClass {
-protected:
-    TypeClass *return_type;
+// A generated value together with its resolved type. An owned value is
+// a heap reference the consumer must either keep or release.
+struct Expr {
+    const sema::Type *ty;
+    ::llvm::Type *type;
+    ::llvm::Value *value;
+    bool owned;
 
-public:
-    std::string get_name() const;
-    size_t get_num_params() const;
-    TypeClass *get_nth_param(size_t i);
-    TypeClass *get_return_type();
+    Expr(const sema::Type *_ty, ::llvm::Type *_type, ::llvm::Value *_value, bool _owned = false):
+        ty(_ty), type(_type), value(_value), owned(_owned) { }
+
+    TypeId id() const { return ty->kind == sema::Type::BUILTIN ? ty->id : TY_OTHER; }
 };
 
-class BoolExpr {
-private:
-    bool val;
+/*
+ * Operators of the builtin types, indexed by the type id of the operands
+ * and the operator. Both operands of a binary operator have the same
+ * type. The table is built once, a lookup is two array indexes.
+ */
+class OpTable {
 public:
-    BoolExpr(bool _val): Expr("Bool"), val(_val) {}
-    Value *value() {
-        return ConstantInt::get(getGlobalContext(), APInt(val ? 1 : 0));
+    typedef ::llvm::IRBuilder<> builder_t;
+    typedef Expr *(*binary_t)(builder_t &b, Expr *L, Expr *R);
+    typedef Expr *(*unary_t)(builder_t &b, Expr *V);
+
+    enum BinaryOp {
+        OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
+        OP_SHL, OP_SHR, OP_AND, OP_OR, OP_XOR,
+        OP_LT, OP_GT, OP_LE, OP_GE, OP_EQ, OP_NE,
+        NUM_BINARY_OPS
+    };
+
+    enum UnaryOp {
+        OP_POS, OP_NEG, OP_BITNEG, OP_NOT,
+        NUM_UNARY_OPS
+    };
+
+    // operator index of a parser token, -1 if it has none
+    static int binaryOp(int token) {
+        switch (token) {
+            case T_ADD: return OP_ADD;
+            case T_SUB: return OP_SUB;
+            case T_MUL: return OP_MUL;
+            case T_DIV: return OP_DIV;
+            case T_MOD: return OP_MOD;
+            case T_LSHIFT: return OP_SHL;
+            case T_RSHIFT: return OP_SHR;
+            case T_BITAND: return OP_AND;
+            case T_BITOR: return OP_OR;
+            case T_BITXOR: return OP_XOR;
+            case T_LT: return OP_LT;
+            case T_GT: return OP_GT;
+            case T_LE: return OP_LE;
+            case T_GE: return OP_GE;
+            case T_EQ: return OP_EQ;
+            case T_NE: return OP_NE;
+            default: return -1;
+        }
     }
-};
 
-class IntExpr {
-private:
-    int val;
-public:
-    IntExpr(int _val): Expr("Int"), val(_val) {}
-    Value *value() {
-        return ConstnatInt::get(getGlobalContext(), APInt(val));
+    static int unaryOp(int token) {
+        switch (token) {
+            case T_ADD: return OP_POS;
+            case T_SUB: return OP_NEG;
+            case T_BITNEG: return OP_BITNEG;
+            case NOT: return OP_NOT;
+            default: return -1;
+        }
     }
-};
 
-class FloatExpr {
-private:
-    float val;
-public:
-    IntExpr(int _val): Expr("Float"), val(_val) {}
-    Value *value() {
-        return ConstnatInt::get(getGlobalContext(), APFloat(val));
+    static binary_t binary(int token, TypeId L, TypeId R) {
+        int op = binaryOp(token);
+        if (op < 0 || L != R)
+            return nullptr;
+        return get().binary_ops[L][op];
     }
-};
 
-class StringExpr {
-private:
-    std::string val;
-public:
-    StringExpr(int _val): Expr("String"), val(_val) {}
-    Value *value() {
-        return ConstantArray::get(getGlobalContext(), val);
+    static unary_t unary(int token, TypeId V) {
+        int op = unaryOp(token);
+        return op < 0 ? nullptr : get().unary_ops[V][op];
     }
-};
 
+    // Result type of an operator, nullptr if the operands have none.
+    static const sema::Type *binaryType(int token, const sema::Type *L, const sema::Type *R) {
+        if (L != R || L->kind != sema::Type::BUILTIN || binary(token, L->id, R->id) == nullptr)
+            return nullptr;
+        int op = binaryOp(token);
+        return op >= OP_LT ? sema::Types::builtin(TY_BOOL) : L;
+    }
+
+    static const sema::Type *unaryType(int token, const sema::Type *V) {
+        if (V->kind != sema::Type::BUILTIN || unary(token, V->id) == nullptr)
+            return nullptr;
+        return V;
+    }
 
+private:
+    binary_t binary_ops[NUM_TYPE_IDS][NUM_BINARY_OPS];
+    unary_t unary_ops[NUM_TYPE_IDS][NUM_UNARY_OPS];
+
+    OpTable();
+
+    static const OpTable &get() {
+        // built once, thread-safe static initialization
+        static const OpTable table;
+        return table;
+    }
+
+    void addInteger(TypeId id, bool is_signed);
+    void addFloat(TypeId id);
+    void addBool();
+};
 
 #endif//_TYPECLASS_H__
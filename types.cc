@@ -0,0 +1,197 @@
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include "types.h"
+
+static const std::string TYPE_NAMES[NUM_TYPE_IDS] = {
+    "",
+    "Bool",
+    "Int8", "Int16", "Int", "Int64",
+    "Unt8", "Unt16", "Unt", "Unt64",
+    "Float", "Float64",
+    "Str",
+};
+
+const std::string &typeIdName(TypeId id) {
+    return TYPE_NAMES[id];
+}
+
+TypeId typeIdByName(const std::string &name) {
+    static const std::unordered_map<std::string, TypeId> ids = {
+        {"Bool", TY_BOOL},
+        {"Int8", TY_INT8}, {"Int16", TY_INT16}, {"Int", TY_INT32}, {"Int32", TY_INT32}, {"Int64", TY_INT64},
+        {"Unt8", TY_UNT8}, {"Byte", TY_UNT8}, {"Unt16", TY_UNT16}, {"Unt", TY_UNT32}, {"Unt32", TY_UNT32}, {"Unt64", TY_UNT64},
+        {"Float", TY_FLOAT32}, {"Float32", TY_FLOAT32}, {"Float64", TY_FLOAT64},
+        {"Str", TY_STR}, {"String", TY_STR},
+    };
+    auto it = ids.find(name);
+    return it != ids.end() ? it->second : TY_OTHER;
+}
+
+namespace sema {
+
+std::string Type::str() const {
+    std::string ret;
+    switch (kind) {
+        case VOID:
+            return "()";
+        case BUILTIN:
+            return typeIdName(id);
+        case POINTER:
+            return "*" + base->str();
+        case REFERENCE:
+            return "&" + base->str();
+        case ARRAY:
+            return "[" + base->str() + "]";
+        case SLICE:
+            return "[" + base->str() + ":]";
+        case NAMED:
+            for (size_t i = 0; i < elems.size(); i++)
+                ret += (i ? "," : "") + elems[i]->str();
+            return ast::Symbols::name(name) + (elems.empty() ? "" : "{" + ret + "}");
+        case IFACE:
+            return ast::Symbols::name(name);
+        case TUPLE:
+        case FUNCTION:
+            for (size_t i = 0; i < elems.size(); i++)
+                ret += (i ? "," : "") + elems[i]->str();
+            ret = "(" + ret + ")";
+            if (kind == FUNCTION)
+                ret += "->" + base->str();
+            return ret;
+    }
+    return ret;
+}
+
+namespace {
+    typedef std::vector<uintptr_t> key_t;
+
+    struct TypeTable {
+        std::mutex lock;
+        std::map<key_t, const Type *> types;
+        const Type *builtins[NUM_TYPE_IDS];
+        const Type *void_type;
+    };
+
+    key_t key(const Type *t) {
+        key_t k;
+        k.push_back(t->kind);
+        k.push_back(t->id);
+        k.push_back(t->name);
+        k.push_back((uintptr_t)t->base);
+        for (auto e: t->elems)
+            k.push_back((uintptr_t)e);
+        return k;
+    }
+}
+
+// The builtins are interned up front, looking them up never locks.
+static TypeTable &table();
+
+const Type *Types::intern(Type *type) {
+    TypeTable &t = table();
+    std::lock_guard<std::mutex> guard(t.lock);
+
+    auto res = t.types.insert(std::make_pair(key(type), type));
+    if (!res.second)
+        delete type;
+    return res.first->second;
+}
+
+static TypeTable *buildTable() {
+    TypeTable *t = new TypeTable();
+    Type *v = new Type(Type::VOID);
+    t->void_type = v;
+    t->types[key(v)] = v;
+    t->builtins[TY_OTHER] = nullptr;
+    for (int id = TY_OTHER + 1; id < NUM_TYPE_IDS; id++) {
+        Type *b = new Type(Type::BUILTIN);
+        b->id = (TypeId)id;
+        t->builtins[id] = b;
+        t->types[key(b)] = b;
+    }
+    return t;
+}
+
+static TypeTable &table() {
+    // built once, thread-safe static initialization
+    static TypeTable *t = buildTable();
+    return *t;
+}
+
+const Type *Types::voidType() {
+    return table().void_type;
+}
+
+const Type *Types::builtin(TypeId id) {
+    return table().builtins[id];
+}
+
+const Type *Types::pointer(const Type *base) {
+    Type *t = new Type(Type::POINTER);
+    t->base = base;
+    return intern(t);
+}
+
+const Type *Types::reference(const Type *base) {
+    Type *t = new Type(Type::REFERENCE);
+    t->base = base;
+    return intern(t);
+}
+
+const Type *Types::array(const Type *elem) {
+    Type *t = new Type(Type::ARRAY);
+    t->base = elem;
+    return intern(t);
+}
+
+const Type *Types::slice(const Type *elem) {
+    Type *t = new Type(Type::SLICE);
+    t->base = elem;
+    return intern(t);
+}
+
+const Type *Types::tuple(const std::vector<const Type *> &elems) {
+    Type *t = new Type(Type::TUPLE);
+    t->elems = elems;
+    return intern(t);
+}
+
+const Type *Types::function(const std::vector<const Type *> &params, const Type *ret) {
+    Type *t = new Type(Type::FUNCTION);
+    t->elems = params;
+    t->base = ret;
+    return intern(t);
+}
+
+const Type *Types::named(ast::symbol_t name, const std::vector<const Type *> &args) {
+    Type *t = new Type(Type::NAMED);
+    t->name = name;
+    t->elems = args;
+    return intern(t);
+}
+
+const Type *Types::iface(ast::symbol_t name) {
+    Type *t = new Type(Type::IFACE);
+    t->name = name;
+    return intern(t);
+}
+
+const Type *Types::substitute(const Type *type, const std::vector<ast::symbol_t> &params, const std::vector<const Type *> &args) {
+    if (type == nullptr || params.empty())
+        return type;
+    if (type->kind == Type::NAMED && type->elems.empty())
+        for (size_t i = 0; i < params.size(); i++)
+            if (type->name == params[i])
+                return args[i];
+
+    Type *t = new Type(type->kind);
+    t->id = type->id;
+    t->name = type->name;
+    t->base = substitute(type->base, params, args);
+    for (auto e: type->elems)
+        t->elems.push_back(substitute(e, params, args));
+    return intern(t);
+}
+
+}
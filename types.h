@@ -0,0 +1,75 @@
+#ifndef __TYPES_H__
+#define __TYPES_H__
+
+#include <string>
+#include <vector>
+#include "symbol.h"
+
+/*
+ * Builtin types. Every other type has TY_OTHER.
+ */
+enum TypeId {
+    TY_OTHER,
+    TY_BOOL,
+    TY_INT8, TY_INT16, TY_INT32, TY_INT64,
+    TY_UNT8, TY_UNT16, TY_UNT32, TY_UNT64,
+    TY_FLOAT32, TY_FLOAT64,
+    TY_STR,
+    NUM_TYPE_IDS
+};
+
+// canonical name of a builtin type, Int rather than Int32
+const std::string &typeIdName(TypeId id);
+
+// builtin type of a name or alias, TY_OTHER for anything else
+TypeId typeIdByName(const std::string &name);
+
+inline bool typeIdSigned(TypeId id) {
+    return (id >= TY_INT8 && id <= TY_INT64) || id == TY_FLOAT32 || id == TY_FLOAT64;
+}
+
+namespace sema {
+    /*
+     * A resolved type. Types are hash-consed: structurally equal types
+     * are the same object, so comparing two types is a pointer compare.
+     * Types live as long as the process and are safe to share between
+     * threads.
+     */
+    class Type {
+        public:
+            enum Kind { VOID, BUILTIN, POINTER, REFERENCE, ARRAY, TUPLE, FUNCTION, NAMED, IFACE, SLICE };
+
+            Kind kind;
+            TypeId id;                          // BUILTIN
+            const Type *base;                   // POINTER, REFERENCE, ARRAY, SLICE, FUNCTION result
+            std::vector<const Type *> elems;    // TUPLE members, FUNCTION parameters, NAMED type arguments
+            ast::symbol_t name;                 // NAMED, IFACE
+
+            // only Types creates types, anything else would not be interned
+            Type(Kind _kind): kind(_kind), id(TY_OTHER), base(nullptr), name(ast::Symbols::EMPTY) { }
+
+            bool is(TypeId _id) const { return kind == BUILTIN && id == _id; }
+            std::string str() const;
+    };
+
+    class Types {
+        public:
+            static const Type *voidType();
+            static const Type *builtin(TypeId id);
+            static const Type *pointer(const Type *base);
+            static const Type *reference(const Type *base);
+            static const Type *array(const Type *elem);
+            static const Type *slice(const Type *elem);
+            static const Type *tuple(const std::vector<const Type *> &elems);
+            static const Type *function(const std::vector<const Type *> &params, const Type *ret);
+            static const Type *named(ast::symbol_t name, const std::vector<const Type *> &args = std::vector<const Type *>());
+            static const Type *iface(ast::symbol_t name);
+            // type with the named types params replaced by args
+            static const Type *substitute(const Type *type, const std::vector<ast::symbol_t> &params, const std::vector<const Type *> &args);
+
+        private:
+            static const Type *intern(Type *type);
+    };
+}
+
+#endif//__TYPES_H__